@@ -0,0 +1,237 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "annotationimport.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+
+#include <cmath>
+#include <stdexcept>
+
+using namespace browser ;
+
+
+static const double WFDB_DEFAULT_RATE = 250.0 ;   // Samples/second if there's no header
+
+// MIT format annotation codes with special meanings
+static const int WFDB_SKIP = 59 ;
+static const int WFDB_NUM  = 60 ;
+static const int WFDB_SUB  = 61 ;
+static const int WFDB_CHN  = 62 ;
+static const int WFDB_AUX  = 63 ;
+
+// Mnemonics for annotation codes, from WFDB's ecgcodes.h
+static const char *WFDB_CODES[] = {
+  " ", "N", "L", "R", "a", "V", "F", "J", "A", "S", "E", "j", "/", "Q", "~", "",
+  "|", "",  "s", "T", "*", "D", "\"", "=", "p", "B", "^", "t", "+", "u", "?", "!",
+  "[", "]", "e", "n", "@", "x", "f", "(", ")", "r"
+  } ;
+
+
+QList<LoadedAnnotation> AnnotationReader::read(const QString &filename, QString &error)
+/*===================================================================================*/
+{
+  QString suffix = QFileInfo(filename).suffix().toLower() ;
+  return (suffix == "csv" || suffix == "txt") ? read_csv(filename, error)
+                                              : read_wfdb(filename, error) ;
+  }
+
+QStringList AnnotationReader::split_csv(const QString &line)
+/*--------------------------------------------------------*/
+{
+  QStringList fields ;
+  QString field ;
+  bool quoted = false ;
+  for (int n = 0 ;  n < line.size() ;  ++n) {
+    QChar c = line.at(n) ;
+    if (quoted) {
+      if (c == '"') {
+        if (n + 1 < line.size() && line.at(n + 1) == '"') {
+          field.append(c) ;
+          n += 1 ;
+          }
+        else quoted = false ;
+        }
+      else field.append(c) ;
+      }
+    else if (c == '"') quoted = true ;
+    else if (c == ',') {
+      fields.append(field.trimmed()) ;
+      field.clear() ;
+      }
+    else field.append(c) ;
+    }
+  fields.append(field.trimmed()) ;
+  return fields ;
+  }
+
+QList<LoadedAnnotation> AnnotationReader::read_csv(const QString &filename, QString &error)
+/*---------------------------------------------------------------------------------------*/
+{
+  QFile file(filename) ;
+  if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    throw std::runtime_error("Cannot open " + filename.toStdString()) ;
+  QList<LoadedAnnotation> result ;
+  QTextStream input(&file) ;
+  int lineno = 0 ;
+  while (!input.atEnd()) {
+    QString line = input.readLine() ;
+    lineno += 1 ;
+    if (line.trimmed() == "") continue ;
+    QStringList fields = split_csv(line) ;
+    bool ok ;
+    LoadedAnnotation ann{"", (float)fields[0].toDouble(&ok), NAN, "", QVector<int>(), true} ;
+    if (!ok) {
+      if (lineno == 1) continue ;       // Column headings
+      error = QString("Line %1: invalid start time").arg(lineno) ;
+      break ;
+      }
+    if (fields.size() > 1 && fields[1] != "") {
+      ann.end = (float)fields[1].toDouble(&ok) ;
+      if (!ok) {
+        error = QString("Line %1: invalid end time").arg(lineno) ;
+        break ;
+        }
+      }
+    if (fields.size() > 2) ann.text = fields[2] ;
+    if (fields.size() > 3) {
+      for (auto const &t : fields[3].split(' ', Qt::SkipEmptyParts))
+        ann.tags.append(UriTable::id(t)) ;
+      }
+    result.append(ann) ;
+    }
+  return result ;
+  }
+
+double AnnotationReader::wfdb_rate(const QString &filename)
+/*-------------------------------------------------------*/
+{
+  // The header has the record's name as its basename, e.g. `100.atr` --> `100.hea`
+  QFileInfo info(filename) ;
+  QFile header(info.dir().filePath(info.completeBaseName() + ".hea")) ;
+  if (header.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    QTextStream input(&header) ;
+    while (!input.atEnd()) {
+      QString line = input.readLine().trimmed() ;
+      if (line == "" || line.startsWith('#')) continue ;
+      QStringList fields = line.split(QRegExp("\\s+")) ;   // name nsig fs[/counterfreq][(base)] ...
+      if (fields.size() > 2) {
+        QString fs = fields[2].section('/', 0, 0).section('(', 0, 0) ;
+        bool ok ;
+        double rate = fs.toDouble(&ok) ;
+        if (ok && rate > 0.0) return rate ;
+        }
+      break ;
+      }
+    }
+  return WFDB_DEFAULT_RATE ;
+  }
+
+QList<LoadedAnnotation> AnnotationReader::read_wfdb(const QString &filename, QString &error)
+/*----------------------------------------------------------------------------------------*/
+{
+  QFile file(filename) ;
+  if (!file.open(QIODevice::ReadOnly))
+    throw std::runtime_error("Cannot open " + filename.toStdString()) ;
+  QByteArray data = file.readAll() ;
+  const uchar *bytes = (const uchar *)data.constData() ;
+  int size = data.size() ;
+  double rate = wfdb_rate(filename) ;
+
+  QList<LoadedAnnotation> result ;
+  qint64 time = 0 ;   // In samples
+  int pos = 0 ;
+  while (pos + 1 < size) {
+    int word = bytes[pos] | (bytes[pos+1] << 8) ;
+    pos += 2 ;
+    int code = word >> 10 ;
+    int value = word & 0x3FF ;
+    if (code == 0 && value == 0) break ;             // End of file
+    else if (code == WFDB_SKIP) {
+      if (pos + 3 >= size) break ;
+      qint32 skip = (qint32)(((quint32)(bytes[pos] | (bytes[pos+1] << 8)) << 16)
+                            | (quint32)(bytes[pos+2] | (bytes[pos+3] << 8))) ;
+      time += skip ;
+      pos += 4 ;
+      }
+    else if (code == WFDB_AUX) {
+      if (pos + value > size) {
+        error = "Truncated annotation file" ;
+        break ;
+        }
+      if (!result.isEmpty()) {
+        const char *aux = (const char *)bytes + pos ;
+        int length = qstrnlen(aux, value) ;        // May be null terminated
+        if (length > 0) result.last().text += " " + QString::fromLatin1(aux, length) ;
+        }
+      pos += value + (value & 1) ;                   // Padded to an even length
+      }
+    else if (code == WFDB_NUM || code == WFDB_SUB || code == WFDB_CHN) {
+      continue ;                                     // Not used
+      }
+    else {
+      time += value ;
+      QString text = (code < (int)(sizeof(WFDB_CODES)/sizeof(WFDB_CODES[0])) && WFDB_CODES[code][0])
+                   ? WFDB_CODES[code] : QString::number(code) ;
+      result.append(LoadedAnnotation{"", (float)(time/rate), NAN, text, QVector<int>(), true}) ;
+      }
+    }
+  return result ;
+  }
+
+
+AnnotationImportThread::AnnotationImportThread(const QString &filename)
+/*==================================================================*/
+: QObject(),
+  m_filename(filename)
+{
+  QObject::connect(&m_thread, &QThread::started, this, &AnnotationImportThread::run) ;
+  moveToThread(&m_thread) ;
+  }
+
+void AnnotationImportThread::start(void)
+/*------------------------------------*/
+{
+  m_thread.start() ;
+  }
+
+void AnnotationImportThread::run(void)
+/*----------------------------------*/
+{
+  auto batch = std::make_shared<QList<LoadedAnnotation>>() ;
+  QString error ;
+  try {
+    batch->append(AnnotationReader::read(m_filename, error)) ;
+    }
+  catch (std::exception &e) {
+    error = e.what() ;
+    }
+  emit finished(batch, error) ;
+  m_thread.exit(0) ;
+  }
+
+bool AnnotationImportThread::wait(unsigned long time)
+/*-------------------------------------------------*/
+{
+  return m_thread.wait(time) ;
+  }
@@ -0,0 +1,96 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_ANNOTATIONIMPORT_H
+#define BROWSER_ANNOTATIONIMPORT_H
+
+#include "annotationlist.h"
+
+#include <biosignalml/biosignalml.h>
+
+#include <QObject>
+#include <QString>
+#include <QThread>
+
+
+namespace browser {
+
+  /**
+   * Read annotations from a file.
+   *
+   * Two formats are read:
+   *
+   * * CSV, with columns of start time, end time, text and tags, the last
+   *   two being optional. End time may be empty for an instant and tags are
+   *   URIs separated by spaces. A first line of column headings is skipped.
+   *
+   * * WFDB (PhysioBank) annotation files, in MIT format. The sampling rate
+   *   is read from the record's header file when it is in the same directory.
+   *
+   * All times are in seconds from the start of the recording. A
+   * `std::runtime_error` is thrown if the file can't be opened. Reading
+   * stops at the first invalid line or record, setting `error`, and the
+   * annotations before it are returned.
+   */
+  class AnnotationReader
+  /*==================*/
+  {
+   public:
+    static QList<LoadedAnnotation> read(const QString &filename, QString &error) ;
+    static QList<LoadedAnnotation> read_csv(const QString &filename, QString &error) ;
+    static QList<LoadedAnnotation> read_wfdb(const QString &filename, QString &error) ;
+
+   private:
+    static QStringList split_csv(const QString &line) ;
+    static double wfdb_rate(const QString &filename) ;
+    } ;
+
+
+  /**
+   * Import an annotation file in a separate thread.
+   *
+   * All the file's annotations are passed back as a single batch, so the
+   * list and chart are only updated once. The list journals them, so they
+   * are added to the recording along with other annotation edits.
+   */
+  class AnnotationImportThread : public QObject
+  /*=========================================*/
+  {
+   Q_OBJECT
+
+   public:
+    AnnotationImportThread(const QString &filename) ;
+    void start(void) ;
+    bool wait(unsigned long time) ;
+
+   public slots:
+    void run(void) ;
+
+   signals:
+    void finished(AnnotationBatch batch, const QString &error) ;
+
+   private:
+    QString m_filename ;
+    QThread m_thread ;
+    } ;
+
+  } ;
+
+#endif
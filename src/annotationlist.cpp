@@ -19,114 +19,274 @@
  *****************************************************************************/
 
 #include "annotationlist.h"
+#include "annotationimport.h"
+#include "recordinglock.h"
+#include "logging.h"
 
-#include <cassert>
-
-using namespace browser ;
+#include <QElapsedTimer>
+#include <QFileDialog>
+#include <QMessageBox>
 
+#include <algorithm>
+#include <climits>
 
-StringDictionary PREFIXES {
-  StringPair("bsml",  "http://www.biosignalml.org/ontologies/2011/04/biosignalml#"),
-  StringPair("dct",   "http://purl.org/dc/terms/"),
-  StringPair("rdfs",  "http://www.w3.org/2000/01/rdf-schema#"),
-  StringPair("pbank", "http://www.biosignalml.org/ontologies/examples/physiobank#")
-  } ;
+using namespace browser ;
 
 
-QString abbreviate_uri(const QString &uri)
-/*--------------------------------------*/
+AnnotationModel::AnnotationModel(QObject *parent, const NumericRange &timemap)
+/*==========================================================================*/
+: TableModel(parent, this->header(), QStringList()),
+  m_ids(QVector<int>()),
+  m_nextid(0),
+  m_starts(QVector<float>()),
+  m_ends(QVector<float>()),
+  m_types(QVector<quint8>()),
+  m_texts(QVector<QString>()),
+  m_tags(QVector<QVector<int>>()),
+  m_tagtexts(QVector<QString>()),
+  m_editable(QVector<bool>()),
+  m_typenames(QStringList()),
+  m_timemap(timemap),
+  m_events(nullptr),
+  m_eventtypes(QStringList()),
+  m_eventtype(-1),
+  m_eventrows(QVector<int>()),
+  m_eventcount(0),
+  m_fetchall(false),
+  m_words(TokenIndex()),
+  m_typewords(TokenIndex()),
+  m_search(QString()),
+  m_searching(false),
+  m_found(QBitArray())
 {
-  for (auto const &pfx : PREFIXES)
-    if (uri.startsWith(PREFIXES[pfx])) return pfx + ":" + uri.right(PREFIXES[pfx].size()) ;
-  return uri ;
   }
 
-QString expand_uri(const QString &uri)
-/*----------------------------------*/
+QStringList AnnotationModel::header(void)
+/*-------------------------------------*/
 {
-  for (auto const &pfx : PREFIXES)
-    if (uri.startsWith(pfx + ":")) return PREFIXES[pfx] + uri.right(pfx.size()+1) ;
-  return uri ;
+  return QStringList{"", "Start", "End", "Duration",  "Type", "Annotation", "Tags"} ;
   }
 
+void AnnotationModel::add_row(float start, float end, const QString &type, const QString &text,
+/*-------------------------------------------------------------------------------------------*/
+                              const QVector<int> &tags, const QString &tagtext, bool editable)
+{
+  int t = m_typenames.indexOf(type) ;   // Only a few types
+  if (t < 0) {
+    t = m_typenames.size() ;
+    m_typenames.append(type) ;
+    }
+  m_words.add(m_nextid, text) ;
+  m_words.add(m_nextid, tagtext) ;
+  if (m_searching) {      // So the row is filtered when it's appended
+    m_found.resize(m_nextid + 1) ;
+    m_found.setBit(m_nextid, TokenIndex::matches(m_search, text + "\n" + tagtext)) ;
+    }
+  m_ids.append(m_nextid) ;
+  m_nextid += 1 ;
+  m_starts.append(start) ;
+  m_ends.append(isnan(start) ? NAN : end) ;
+  m_types.append((quint8)t) ;
+  m_texts.append(text) ;
+  m_tags.append(tags) ;
+  m_tagtexts.append(tagtext) ;
+  m_editable.append(editable) ;
+  }
 
-AnnotationModel::AnnotationModel(QObject *parent, const NumericRange &timemap)
-/*==========================================================================*/
-: TableModel(parent, this->header(), QStringList()),
-  m_rows(AnnRows()), m_timemap(timemap)
+QStringList AnnotationModel::tags(int row) const
+/*-------------------------------------------*/
 {
+  QStringList result ;
+  for (auto t : m_tags.at(row)) result.append(UriTable::uri(t)) ;
+  return result ;
   }
 
-QStringList AnnotationModel::header(void)
-/*-------------------------------------*/
+void AnnotationModel::remove_data(const RowPosns &posns)
+/*----------------------------------------------------*/
 {
-  return QStringList{"", "Start", "End", "Duration",  "Type", "Annotation", "Tags"} ;
+  int count = posns.second - posns.first + 1 ;
+  for (int n = posns.first ;  n <= posns.second ;  ++n) {
+    m_words.remove(m_ids.at(n), m_texts.at(n)) ;
+    m_words.remove(m_ids.at(n), m_tagtexts.at(n)) ;
+    }
+  m_ids.remove(posns.first, count) ;
+  m_starts.remove(posns.first, count) ;
+  m_ends.remove(posns.first, count) ;
+  m_types.remove(posns.first, count) ;
+  m_texts.remove(posns.first, count) ;
+  m_tags.remove(posns.first, count) ;
+  m_tagtexts.remove(posns.first, count) ;
+  m_editable.remove(posns.first, count) ;
   }
 
-const AnnRow &AnnotationModel::get_row(int row) const
-/*-------------------------------------------------*/
+void AnnotationModel::show_events(EventIndex::Ptr events, int type)
+/*---------------------------------------------------------------*/
 {
-  return m_rows.at(row) ;
+  if (events != m_events) {
+    m_events = events ;
+    m_eventtypes.clear() ;
+    m_typewords.clear() ;
+    if (events) {
+      for (auto const &t : events->types()) {
+        m_typewords.add(m_eventtypes.size(), UriTable::abbreviate(t)) ;
+        m_eventtypes.append(UriTable::abbreviate(t)) ;
+        }
+      }
+    }
+  m_eventtype = type ;
+  select_events() ;
   }
 
-bsml::Annotation::Ptr AnnotationModel::find_annotation(const QString &uri) const
-/*----------------------------------------------------------------------------*/
+bool AnnotationModel::search(const QString &text)
+/*---------------------------------------------*/
 {
-  for (auto const &row : m_rows) {
-    if (uri == (*std::get<1>(row))[0])
-      return std::get<0>(row) ;
+  bool narrower = m_searching && text.startsWith(m_search) ;
+  QBitArray before = m_found ;
+  m_search = text ;
+  m_searching = !TokenIndex::tokens(text).isEmpty() ;
+  m_found = m_searching ? m_words.match(text, m_nextid) : QBitArray() ;
+  select_events() ;
+  if (!narrower) return true ;
+
+  QBitArray dropped = before & ~m_found ;
+  int first = -1 ;
+  int last = -1 ;
+  for (int id = 0 ;  id < dropped.size() ;  ++id) {
+    if (!dropped.testBit(id)) continue ;
+    auto r = std::lower_bound(m_ids.cbegin(), m_ids.cend(), id) ;  // Ids are in row order
+    if (r == m_ids.cend() || *r != id) continue ;   // Row has been removed
+    int row = r - m_ids.cbegin() ;
+    if (row != last + 1) {
+      if (first >= 0) emit dataChanged(index(first, 0), index(last, columnCount() - 1)) ;
+      first = row ;
+      }
+    last = row ;
     }
-  return nullptr ;
+  if (first >= 0) emit dataChanged(index(first, 0), index(last, columnCount() - 1)) ;
+  return false ;
   }
 
-void AnnotationModel::add_row(bsml::Annotation::Ptr &ann, float start, float end,
-/*-----------------------------------------------------------------------------*/
-                              const QString &type, const QString &text,
-                              const QString &tagtext, bool editable)
-{
-  auto rowdata = std::make_shared<RowData>(7) ; // <uri, start, end, duration, type, text, tagtext>
-  RowData &data = *(rowdata.get()) ;
-  // This is on local stack...
-  data[0] = QVariant(QString(((std::string)ann->uri()).c_str())) ;
-  if (isnan(start)) {
-    data[1] = QVariant(QString("")) ;
-    data[2] = QVariant(QString("")) ;
-    data[3] = QVariant(QString("")) ;
+bool AnnotationModel::accepts(int row) const
+/*----------------------------------------*/
+{
+  if (!m_searching || row >= TableModel::rowCount()) return true ;  // Events are already selected
+  int id = m_ids.at(row) ;
+  return id < m_found.size() && m_found.testBit(id) ;
+  }
+
+void AnnotationModel::select_events(void)
+/*-------------------------------------*/
+{
+  if (m_eventcount > 0) {
+    int first = TableModel::rowCount() ;   // Event rows follow annotations
+    beginRemoveRows(QModelIndex(), first, first + m_eventcount - 1) ;
+    m_eventcount = 0 ;
+    endRemoveRows() ;
     }
-  else {
-    float nstart = m_timemap.map(start) ;  // Normalise for display
-    data[1] = QVariant(nstart) ;
-    if (isnan(end)) {
-      data[2] = QVariant(QString("")) ;
-      data[3] = QVariant(QString("")) ;
+  m_eventrows.clear() ;
+  if (m_events && !m_searching) {
+    m_eventrows = m_events->events(m_eventtype) ;
+    }
+  else if (m_events) {
+    QBitArray types = m_typewords.match(m_search, m_eventtypes.size()) ;
+    if (m_eventtype >= 0) {
+      if (types.testBit(m_eventtype)) m_eventrows = m_events->events(m_eventtype) ;
       }
-    else {
-      float nend = m_timemap.map(end) ;
-      data[2] = QVariant(nend) ;
-      data[3] = QVariant(nend - nstart) ;
+    else if (types.count(true) == types.size()) {
+      m_eventrows = m_events->events(-1) ;
+      }
+    else if (types.count(true) > 0) {
+      for (auto n : m_events->events(-1))   // Keep time order
+        if (types.testBit(m_events->type(n))) m_eventrows.append(n) ;
       }
     }
-  data[4] = QVariant(type) ;
-  data[5] = QVariant(text) ;
-  data[6] = QVariant(tagtext) ;
+  fetchMore(QModelIndex()) ;
+  }
 
-  m_rows.append(AnnRow(ann, rowdata, editable)) ;
+bool AnnotationModel::canFetchMore(const QModelIndex &parent) const
+/*---------------------------------------------------------------*/
+{
+  return !parent.isValid() && m_eventcount < m_eventrows.size() ;
   }
 
-//  [ AnnotationModel.row(uri,
-//    m_make_ann_times(start, end),
-//    'Annotation', text,
-//    m_tag_labels(tags)) ]) ;
+void AnnotationModel::fetchMore(const QModelIndex &parent)
+/*------------------------------------------------------*/
+{
+  int count = m_fetchall ? m_eventrows.size() - m_eventcount
+                         : std::min(EVENT_FETCH, m_eventrows.size() - m_eventcount) ;
+  if (parent.isValid() || count <= 0) return ;
+  int first = TableModel::rowCount() + m_eventcount ;
+  beginInsertRows(QModelIndex(), first, first + count - 1) ;
+  m_eventcount += count ;
+  endInsertRows() ;
+  }
 
-void AnnotationModel::delete_row(const QString &uri)
-/*------------------------------------------------*/
+void AnnotationModel::setFetchAll(bool all)
+/*---------------------------------------*/
 {
-  for (auto row = m_rows.begin() ;  row < m_rows.end() ;  ++row) {
-    if (uri == (*std::get<1>(*row))[0]) {
-      m_rows.erase(row) ;
-      return ;
-      }
+  m_fetchall = all ;
+  if (all) fetchMore(QModelIndex()) ;
+  }
+
+int AnnotationModel::event_at(int row) const
+/*----------------------------------------*/
+{
+  int n = row - TableModel::rowCount() ;
+  return (n >= 0 && n < m_eventcount) ? m_eventrows.at(n) : -1 ;
+  }
+
+int AnnotationModel::rowCount(const QModelIndex &parent) const
+/*----------------------------------------------------------*/
+{
+  return TableModel::rowCount(parent) + m_eventcount ;
+  }
+
+QVariant AnnotationModel::event_data(int event, int column) const
+/*-------------------------------------------------------------*/
+{
+  switch (column) {    // <uri, start, end, duration, type, text, tagtext>
+   case 0:
+    return m_events->uri(event) ;
+   case 1:
+    return (float)m_timemap.map(m_events->start(event)) ;
+   case 2:
+    return (float)m_timemap.map(m_events->start(event) + m_events->duration(event)) ;
+   case 3:
+    return (float)(m_timemap.map(m_events->start(event) + m_events->duration(event))
+                 - m_timemap.map(m_events->start(event))) ;
+   case 4:
+    return QString("Event") ;
+   case 5:
+    return m_eventtypes.at(m_events->type(event)) ;
+   case 6:
+    return QString("") ;
     }
+  return QVariant() ;
+  }
+
+QVariant AnnotationModel::row_data(int row, int column) const
+/*---------------------------------------------------------*/
+{
+  float start = m_starts.at(row) ;
+  float end = m_ends.at(row) ;
+  switch (column) {    // <uri, start, end, duration, type, text, tagtext>
+   case 0:
+    return rowid(row) ;
+   case 1:
+    return isnan(start) ? QVariant(QString("")) : QVariant((float)m_timemap.map(start)) ;
+   case 2:
+    return isnan(end) ? QVariant(QString("")) : QVariant((float)m_timemap.map(end)) ;
+   case 3:
+    return isnan(end) ? QVariant(QString(""))
+                      : QVariant((float)(m_timemap.map(end) - m_timemap.map(start))) ;
+   case 4:
+    return m_typenames.at(m_types.at(row)) ;
+   case 5:
+    return m_texts.at(row) ;
+   case 6:
+    return m_tagtexts.at(row) ;
+    }
+  return QVariant() ;
   }
 
 QVariant AnnotationModel::data(const QModelIndex &index, int role) const
@@ -134,66 +294,335 @@ QVariant AnnotationModel::data(const QModelIndex &index, int role) const
 {
   if (role == Qt::DisplayRole) {
     int row = index.row() ;
-    int col = index.column() ;
-    if (row >= 0 && row < m_rows.size()) {
-      const RowData &rowdata = *(std::get<1>(m_rows.at(row))) ;
-      if (col >= 0 && col < rowdata.size()) return rowdata.at(col) ;
-      }
+    int event = event_at(row) ;
+    if (event >= 0) return event_data(event, index.column()) ;
+    else if (row >= 0 && row < TableModel::rowCount()) return row_data(row, index.column()) ;
     else return QVariant() ;
     }
   return TableModel::data(index, role) ;
   }
 
+float AnnotationModel::time_key(int row, int column) const
+/*------------------------------------------------------*/
+{
+  float start, end ;
+  int event = event_at(row) ;
+  if (event >= 0) {
+    start = (float)m_events->start(event) ;
+    end = start + (float)m_events->duration(event) ;
+    }
+  else {
+    start = m_starts.at(row) ;
+    end = m_ends.at(row) ;
+    }
+  return (column == 1) ? start
+       : (column == 2) ? end
+       :                 end - start ;
+  }
+
+QString AnnotationModel::text_key(int row, int column) const
+/*--------------------------------------------------------*/
+{
+  int event = event_at(row) ;
+  if (event >= 0) {
+    return (column == 0) ? m_events->uri(event)
+         : (column == 4) ? QString("Event")
+         : (column == 5) ? m_eventtypes.at(m_events->type(event))
+         :                 QString("") ;
+    }
+  return (column == 0) ? rowid(row)
+       : (column == 4) ? m_typenames.at(m_types.at(row))
+       : (column == 5) ? m_texts.at(row)
+       : (column == 6) ? m_tagtexts.at(row)
+       :                 QString("") ;
+  }
+
+bool AnnotationModel::less_than(int left, int right, int column) const
+/*------------------------------------------------------------------*/
+{
+  if (column >= 1 && column <= 3) {
+    float a = time_key(left, column) ;
+    float b = time_key(right, column) ;
+    if (isnan(a)) return !isnan(b) ;   // Rows without times sort first
+    return !isnan(b) && a < b ;
+    }
+  return QString::compare(text_key(left, column), text_key(right, column)) < 0 ;
+  }
+
+
+AnnotationReadThread::AnnotationReadThread(bsml::Recording::Ptr recording)
+/*======================================================================*/
+: QObject(),
+  m_recording(recording),
+  m_exit(true)
+{
+  QObject::connect(&m_thread, &QThread::started, this, &AnnotationReadThread::run) ;
+  moveToThread(&m_thread) ;
+  }
+
+void AnnotationReadThread::start(void)
+/*----------------------------------*/
+{
+  m_exit = false ;
+  m_thread.start() ;
+  }
+
+void AnnotationReadThread::run(void)
+/*--------------------------------*/
+{
+  try {
+    auto batch = std::make_shared<QList<LoadedAnnotation>>() ;
+    QElapsedTimer elapsed ;
+    elapsed.start() ;
+    decltype(m_recording->get_annotation_uris()) uris ;
+    {
+      RecordingLock lock ;
+      uris = m_recording->get_annotation_uris() ;  // Or via graph() ??
+      }
+    for (auto const &u : uris) {
+      if (m_exit) break ;
+      {
+        RecordingLock lock ;   // For each annotation, so others can use the recording
+        auto a = m_recording->get_annotation(u) ;
+        LoadedAnnotation ann{((std::string)u).c_str(), NAN, NAN, a->comment().c_str(), QVector<int>(), false} ;
+        auto tm = a->time() ;
+        if (tm->is_valid()) {
+          ann.start = (float)tm->start() ;
+          float d = (float)tm->duration() ;
+          if (!isnan(d) && d != 0.0) ann.end = ann.start + d ;
+          }
+        for (auto const &t : a->tags()) ann.tags << UriTable::id(((std::string)t).c_str()) ;
+        batch->append(ann) ;
+        }
+      if (batch->size() >= ANNOTATION_BATCH || elapsed.elapsed() >= ANNOTATION_BATCH_TIME) {
+        emit loaded(batch) ;
+        batch = std::make_shared<QList<LoadedAnnotation>>() ;
+        elapsed.restart() ;
+        }
+      }
+    if (!m_exit && batch->size() > 0) emit loaded(batch) ;
+    }
+  catch (std::exception &e) {
+    qCritical("Annotations: %s", e.what()) ;
+    }
+  emit finished() ;
+  m_thread.exit(0) ;
+  }
+
+void AnnotationReadThread::stop(void)
+/*---------------------------------*/
+{
+  m_exit = true ;
+  }
+
+bool AnnotationReadThread::wait(unsigned long time)
+/*-----------------------------------------------*/
+{
+  return m_thread.wait(time) ;
+  }
+
+
+AnnotationCommitThread::AnnotationCommitThread(bsml::Recording::Ptr recording,
+/*==========================================================================*/
+                                               const QList<AnnotationJournal::Entry> &entries)
+: QObject(),
+  m_recording(recording),
+  m_entries(entries)
+{
+  QObject::connect(&m_thread, &QThread::started, this, &AnnotationCommitThread::run) ;
+  moveToThread(&m_thread) ;
+  }
+
+void AnnotationCommitThread::start(void)
+/*------------------------------------*/
+{
+  m_thread.start() ;
+  }
+
+void AnnotationCommitThread::run(void)
+/*----------------------------------*/
+{
+  QString error ;
+  try {
+    RecordingLock lock ;           // Once, for the whole batch
+    for (auto const &entry : m_entries) apply(m_recording, entry) ;
+    }
+  catch (std::exception &e) {
+    error = e.what() ;
+    }
+  emit finished(error) ;
+  m_thread.exit(0) ;
+  }
+
+bool AnnotationCommitThread::wait(unsigned long time)
+/*-------------------------------------------------*/
+{
+  return m_thread.wait(time) ;
+  }
+
+void AnnotationCommitThread::apply(bsml::Recording::Ptr recording, const AnnotationJournal::Entry &entry)
+/*----------------------------------------------------------------------------------------------------*/
+{
+  rdf::URI uri(entry.uri.toStdString()) ;
+  if (!entry.add) {
+    recording->delete_resource(uri) ;
+    return ;
+    }
+  bsml::Resource::Ptr about = nullptr ;
+  bsml::Annotation::Ptr predecessor = nullptr ;
+  if (entry.predecessor != "") {
+    predecessor = recording->get_annotation(rdf::URI(entry.predecessor.toStdString())) ;
+    if (predecessor && predecessor->is_valid()) about = predecessor->about() ;
+    else predecessor = nullptr ;
+    }
+  if (about == nullptr) {
+    float duration = isnan(entry.end) ? 0.0 : entry.end - entry.start ;
+    auto segment = bsml::Segment::create(recording->uri().make_URI(),
+                                         recording->uri(),
+                                         recording->new_interval(entry.start, duration)) ;
+    recording->add_resource<bsml::Segment>(segment) ;
+    about = segment ;
+    }
+  std::set<rdf::Node> taglist ;
+  for (auto const &tag : entry.tags) taglist.insert(rdf::URI(tag.toStdString())) ;
+  auto annotation = bsml::Annotation::create(uri, about, entry.text.toStdString(),
+                                             taglist, predecessor) ;
+  recording->add_resource<bsml::Annotation>(annotation) ;
+  }
+
 
 AnnotationList::AnnotationList(QWidget *parent, bsml::Recording::Ptr recording,
 /*===========================================================================*/
                                const StringDictionary &semantic_tags)
 : QWidget(parent),
   m_recording(recording),
-  m_semantic_tags(semantic_tags),
+  m_taglabels(QHash<int, QString>()),
   m_ui(Ui_AnnotationList()),
   m_model(new AnnotationModel(this, NumericRange(0.0, (float)recording->duration()))),
   m_table(nullptr),
-  m_events(EventDict()),
-  m_event_posns(RowPosns(-1, -1)),
-  m_settingup(true)
+  m_events(nullptr),
+  m_chartevents(QVector<int>()),
+  m_reader(nullptr),
+  m_eventreader(nullptr),
+  m_importer(nullptr),
+  m_committer(nullptr),
+  m_journal(AnnotationJournal::filename(((std::string)recording->uri()).c_str())),
+  m_pending(QList<AnnotationJournal::Entry>()),
+  m_loaded(false),
+  m_settingup(true),
+  m_eventspending(false)
 {
+  for (auto tag = semantic_tags.cbegin() ;  tag != semantic_tags.cend() ;  ++tag)
+    m_taglabels.insert(UriTable::id(tag.key()), tag.value()) ;
+
   m_ui.setupUi(this) ;
-  QStringList annrows ;
-  for (auto const &u : m_recording->get_annotation_uris()) {  // Or via graph() ??
-    auto a = m_recording->get_annotation(u) ;
-    float annstart = NAN ;
-    float annend = NAN ;
-    auto tm = a->time() ;
-    if (tm->is_valid()) {
-      annstart = (float)tm->start() ;
-      float d = (float)tm->duration() ;
-      if (!isnan(d) && d != 0.0) annend = annstart + d ;
-      }
-    QStringList tags ;
-    for (auto const &t : a->tags()) tags << ((std::string)t).c_str() ;
-    annrows.append(((std::string)a->uri()).c_str()) ;
-    m_model->add_row(a, annstart, annend, "Annotation", a->comment().c_str(), tag_labels(tags), false) ;
-    }
   m_table = new SortedTable(this, m_ui.annotations, m_model) ;
-  m_table->appendRows(annrows) ;
+
+  m_ui.events->addItem("None") ;   // Other choices are added once events are indexed
+  m_ui.import_file->setEnabled(false) ;  // Until annotations have been read
+
+  m_committimer.setSingleShot(true) ;
+  m_committimer.setInterval(JOURNAL_COMMIT_INTERVAL) ;
+  QObject::connect(&m_committimer, &QTimer::timeout, this, &AnnotationList::commit_edits) ;
+  }
+
+void AnnotationList::load_annotations(void)
+/*---------------------------------------*/
+{
+  // Edits that weren't saved last time are applied before annotations are read
+  QList<AnnotationJournal::Entry> unsaved ;
+  for (auto const &entry : m_journal.read()) merge_edit(unsaved, entry) ;
+  if (unsaved.size() > 0) {
+    qCInfo(browserLog, "Replaying %d unsaved annotation edits", unsaved.size()) ;
+    emit recording_changed(m_recording->uri()) ;
+    m_committer = new AnnotationCommitThread(m_recording, unsaved) ;
+    QObject::connect(m_committer, &AnnotationCommitThread::finished, this, &AnnotationList::commit_finished) ;
+    m_committer->start() ;         // Annotations are read once it has finished
+    }
+  else {
+    read_annotations() ;
+    }
+  }
+
+void AnnotationList::read_annotations(void)
+/*---------------------------------------*/
+{
+  m_reader = new AnnotationReadThread(m_recording) ;
+  QObject::connect(m_reader, &AnnotationReadThread::loaded,   this, &AnnotationList::append_batch) ;
+  QObject::connect(m_reader, &AnnotationReadThread::finished, this, &AnnotationList::loading_finished) ;
+  m_reader->start() ;
+
+  m_eventreader = new EventIndexThread(m_recording) ;
+  QObject::connect(m_eventreader, &EventIndexThread::loaded, this, &AnnotationList::events_loaded) ;
+  m_eventreader->start() ;
 
 //    for e in [m_recording->get_event(evt)
 //                for evt in self._recording.graph.get_event_uris(timetype=bsml::BSML::Interval)]:
 //      if e.time.end is None: e.time.end = e.time.start
 //      self._annotations.append( (str(e.uri), e.time.start, e.time.end, abbreviate_uri(e.eventtype), [], False, e) )
+  }
+
+void AnnotationList::append_batch(AnnotationBatch batch)
+/*----------------------------------------------------*/
+{
+  int first = m_model->size() ;
+  QStringList annrows ;
+  for (auto const &a : *batch) {
+    annrows.append(a.uri) ;
+    m_model->add_row(a.start, a.end, "Annotation", a.text, a.tags, tag_labels(a.tags), a.editable) ;
+    }
+  // Insert into the source model so that the proxy places just the new
+  // rows in sort order instead of re-sorting the whole table
+  m_model->appendRows(annrows) ;        // Filtered against any search as they're added
+  if (first == 0) m_ui.annotations->resizeCells() ;
+  show_rows(first) ;
+  }
 
-  m_ui.events->addItem("None") ;
-//  TODO ********  m_ui.events->insertItems(1, ['%s (%s)' % (abbreviate_uri(etype), count)
-//    for etype, count in m_recording.get_event_types(counts=true)]) ;
-  // if no duration ...
-  m_ui.events->addItem("All") ;
+void AnnotationList::events_loaded(EventIndex::Ptr index)
+/*-----------------------------------------------------*/
+{
+  if (index == nullptr || index->size() == 0) return ;
+  m_events = index ;
+  const QStringList &types = index->types() ;
+  for (int t = 0 ;  t < types.size() ;  ++t)
+    m_ui.events->addItem(QString("%1 (%2)").arg(UriTable::abbreviate(types[t])).arg(index->count(t)), t) ;
+  m_ui.events->addItem(QString("All (%1)").arg(index->size()), -1) ;
+  }
+
+void AnnotationList::loading_finished(void)
+/*---------------------------------------*/
+{
   m_settingup = false ;
+  m_loaded = true ;
+  m_ui.import_file->setEnabled(m_importer == nullptr) ;
+  if (m_eventspending) {      // Events were chosen while annotations were loading
+    m_eventspending = false ;
+    show_selected_events() ;
+    }
+  emit annotations_loaded() ;
   }
 
 AnnotationList::~AnnotationList()
 /*-----------------------------*/
 {
+  if (m_reader) {
+    m_reader->stop() ;
+    m_reader->wait(ULONG_MAX) ;
+    delete m_reader ;
+    }
+  if (m_eventreader) {
+    m_eventreader->stop() ;
+    m_eventreader->wait(ULONG_MAX) ;
+    delete m_eventreader ;
+    }
+  if (m_importer) {
+    m_importer->wait(ULONG_MAX) ;
+    delete m_importer ;
+    }
+  if (m_committer) {
+    m_committer->wait(ULONG_MAX) ;
+    delete m_committer ;
+    }
   delete m_model ;
   // m_table is a QObject with a parent so doesn't need deleting
   }
@@ -201,20 +630,28 @@ AnnotationList::~AnnotationList()
 void AnnotationList::show_annotations(void)
 /*--------------------------------------*/
 {
-  for (const auto &a : m_model->rows()) {  // AnnRow(ann, rowdata, editable)
-    RowData &data = *(std::get<1>(a).get()) ; // <uri, start, end, duration, type, text, tagtext>
-    if (!isnan(data[1].toFloat()))
-      emit annotationAdded(data[0].toString(), data[1].toFloat(), data[2].toFloat(),
-                           data[5].toString(), data[6].toStringList(), std::get<2>(a)) ;
+  show_rows(0) ;
+  show_chart_events() ;
+  }
+
+void AnnotationList::show_rows(int first)
+/*-------------------------------------*/
+{
+  for (int n = first ;  n < m_model->size() ;  ++n) {
+    if (!isnan(m_model->start(n)))
+      emit annotationAdded(m_model->uri(n), m_model->start(n), m_model->end(n),
+                           m_model->text(n), m_model->tags(n), m_model->editable(n)) ;
     }
   }
 
-QString AnnotationList::tag_labels(const QStringList &tags)
-/*-------------------------------------------------------*/
+QString AnnotationList::tag_labels(const QVector<int> &tags)
+/*--------------------------------------------------------*/
 {
   QStringList result ;
-  for (auto const &t : tags)
-    result.append(m_semantic_tags.value(t, t)) ;
+  for (auto t : tags) {
+    auto label = m_taglabels.constFind(t) ;
+    result.append((label != m_taglabels.cend()) ? label.value() : UriTable::uri(t)) ;
+    }
   std::sort(result.begin(), result.end()) ;
   return result.join(", ") ;
   }
@@ -222,22 +659,21 @@ QString AnnotationList::tag_labels(const QStringList &tags)
 void AnnotationList::on_annotations_doubleClicked(const QModelIndex &index)
 /*-----------------------------------------------------------------------*/
 {
-  auto annrow = m_model->get_row(index.row()) ;
-  const RowData &rowdata = *(std::get<1>(annrow)) ;
-  const QString &uri = rowdata[0].toString() ;
+  int row = m_table->mapToSource(index).row() ;
 
   float time = NAN ;
   float start = NAN ;
   float duration = NAN ;
 
-  auto evt = m_events.value(uri, floatPair(NAN, NAN)) ;
-  if (!isnan(evt.first)) {
-    time = evt.first ;
-    duration = evt.second ;
+  int event = m_model->event_at(row) ;
+  if (event >= 0) {
+    time = (float)m_events->start(event) ;
+    duration = (float)m_events->duration(event) ;
     }
-  else {
-    time = rowdata[1].toFloat() ;
-    if (rowdata[2].toFloat() > 0.0) duration = rowdata[2].toFloat() - time ;
+  else {        // Annotation times are shown, and used, as mapped by the timemap
+    time = (float)m_model->timemap().map(m_model->start(row)) ;
+    float end = (float)m_model->timemap().map(m_model->end(row)) ;
+    if (end > 0.0) duration = end - time ;
     }
 
   if (!isnan(time)) {
@@ -259,33 +695,80 @@ void AnnotationList::on_annotations_doubleClicked(const QModelIndex &index)
 void AnnotationList::on_events_currentIndexChanged(const QString &eventtype)
 /*------------------------------------------------------------------------*/
 {
-  if (m_settingup || eventtype == "") return ;  // Setting up
-
-  if (m_event_posns.first >= 0)
-    m_table->removeRows(m_event_posns) ;
-  if (eventtype == "None") {
-    m_event_posns = RowPosns(-1, -1) ;
+  if (eventtype == "") return ;
+  if (m_settingup) {               // Shown once annotations have loaded
+    m_eventspending = true ;
     return ;
     }
-  QString etype = (eventtype != "All") ? expand_uri(eventtype.mid(0, eventtype.lastIndexOf(" (")))
-                                       : "" ;
-  QStringList rows ;
-  m_events = EventDict() ;
-  for (auto const &u : m_recording->get_event_uris(bsml::BSML::Instant)) {
-    auto event = m_recording->get_event(u) ;
-    if (event->is_valid()) {
-      QString uri = ((std::string)u).c_str() ;
-      auto time = event->time() ;
-      m_events[uri] = floatPair((float)time->start(), (float)time->duration()) ;
-      rows.append(uri) ;
-      float end = (float)time->start() + (float)time->duration() ;
-      // Have pointers in table... (and pass nullptr here)
-      auto ann = bsml::Annotation::create() ;
-      m_model->add_row(ann, (float)time->start(), end, "Event",
-                       abbreviate_uri(((std::string)event->eventtype()).c_str())) ;
+  show_selected_events() ;
+  }
+
+void AnnotationList::show_selected_events(void)
+/*-------------------------------------------*/
+{
+  QVariant type = m_ui.events->currentData() ;  // Not set for "None"
+  m_model->show_events(type.isValid() ? m_events : nullptr, type.toInt()) ;
+  m_ui.annotations->resizeCells() ;
+  for (auto n : m_chartevents) emit annotationDeleted(m_events->uri(n)) ;
+  m_chartevents = (type.isValid() && m_events) ? m_events->events(type.toInt()) : QVector<int>() ;
+  show_chart_events() ;
+  }
+
+void AnnotationList::show_chart_events(void)
+/*----------------------------------------*/
+{
+  for (auto n : m_chartevents) {
+    double start = m_events->start(n) ;
+    emit annotationAdded(m_events->uri(n), (float)start, (float)(start + m_events->duration(n)),
+                         UriTable::abbreviate(m_events->types().at(m_events->type(n))),
+                         QStringList(), false) ;
+    }
+  }
+
+void AnnotationList::on_search_textChanged(const QString &text)
+/*-----------------------------------------------------------*/
+{
+  if (m_model->search(text)) m_table->refilter() ;
+  }
+
+void AnnotationList::on_import_file_clicked(void)
+/*--------------------------------------------*/
+{
+  QString filename = QFileDialog::getOpenFileName(this, "Import annotations", "",
+    "Annotation files (*.csv *.txt *.atr *.qrs *.ecg);;CSV files (*.csv *.txt);;"
+    "WFDB annotations (*)") ;
+  if (filename == "" || m_importer) return ;
+  m_ui.import_file->setEnabled(false) ;
+  m_importer = new AnnotationImportThread(filename) ;
+  QObject::connect(m_importer, &AnnotationImportThread::finished, this, &AnnotationList::import_finished) ;
+  m_importer->start() ;
+  }
+
+void AnnotationList::import_finished(AnnotationBatch batch, const QString &error)
+/*-----------------------------------------------------------------------------*/
+{
+  m_importer->wait(ULONG_MAX) ;
+  delete m_importer ;
+  m_importer = nullptr ;
+  if (batch->size() > 0) {
+    // Imported annotations are journalled, as are other edits, so they
+    // aren't lost if we stop before they are committed.
+    QList<AnnotationJournal::Entry> entries ;
+    entries.reserve(batch->size()) ;
+    for (auto &a : *batch) {
+      a.uri = QString(((std::string)m_recording->uri().make_URI()).c_str()) ;
+      QStringList tags ;
+      for (auto t : a.tags) tags.append(UriTable::uri(t)) ;
+      entries.append(AnnotationJournal::Entry{true, a.uri, a.start, a.end, a.text, tags, ""}) ;
       }
+    journal_edits(entries) ;
+    append_batch(batch) ;                  // One model insert and chart update
+    emit recording_changed(m_recording->uri()) ;
+    qCInfo(browserLog, "Imported %d annotations", batch->size()) ;
+    commit_edits() ;                       // As one batch, in the background
     }
-  m_event_posns = m_table->appendRows(rows) ;
+  m_ui.import_file->setEnabled(m_loaded) ;
+  if (error != "") QMessageBox::warning(this, "Import annotations", error) ;
   }
 
 void AnnotationList::add_annotation(float start, float end, const QString &text,
@@ -293,33 +776,21 @@ void AnnotationList::add_annotation(float start, float end, const QString &text,
                                     const QStringList &tags)
 {
   if (text.size() > 0 || tags.size() > 0) {
-    auto segment = bsml::Segment::create(m_recording->uri().make_URI(),
-                                         m_recording->uri(),
-                                         m_recording->new_interval(start, end-start)) ;
-    m_recording->add_resource<bsml::Segment>(segment) ;
-    append_annotation(segment, text, tags) ;
+    append_annotation(start, end, text, tags) ;
     emit recording_changed(m_recording->uri()) ;
     }
   }
 
-void AnnotationList::append_annotation(bsml::Resource::Ptr about, const QString &text,
-/*----------------------------------------------------------------------------------*/
-                                       const QStringList &tags,
-                                       const bsml::Annotation::Ptr &predecessor)
+void AnnotationList::append_annotation(float start, float end, const QString &text,
+/*-------------------------------------------------------------------------------*/
+                                       const QStringList &tags, const QString &predecessor)
 {
-  std::set<rdf::Node> taglist ;
-  for (auto const tag : tags) taglist.insert(rdf::URI(tag.toStdString())) ;
-  auto annotation = bsml::Annotation::create(m_recording->uri().make_URI(), about,
-                                             text.toStdString(), taglist, predecessor) ;
-  m_recording->add_resource<bsml::Annotation>(annotation) ;
-
-  auto tm = annotation->time() ;
-  assert(tm->is_valid()) ;
-  float start = (float)tm->start() ;
-  float end = start + (float)tm->duration() ;
-
-  QString uri = QString(((std::string)annotation->uri()).c_str()) ;
-  m_model->add_row(annotation, start, end, "Annotation", text, tag_labels(tags), true) ;
+  QString uri = QString(((std::string)m_recording->uri().make_URI()).c_str()) ;
+  journal_edit(AnnotationJournal::Entry{true, uri, start, end, text, tags, predecessor}) ;
+
+  QVector<int> tagids ;
+  for (auto const &t : tags) tagids.append(UriTable::id(t)) ;
+  m_model->add_row(start, end, "Annotation", text, tagids, tag_labels(tagids), true) ;
   m_table->appendRows(QStringList(uri)) ;
   emit annotationAdded(uri, start, end, text, tags, true) ;
   }
@@ -328,7 +799,6 @@ void AnnotationList::remove_annotation(const QString &id)
 /*-----------------------------------------------------*/
 {
   m_table->deleteRow(id) ;
-  m_model->delete_row(id) ;
   emit annotationDeleted(id) ;
   }
 
@@ -336,11 +806,13 @@ void AnnotationList::modify_annotation(const QString &uri, const QString &text,
 /*---------------------------------------------------------------------------*/
                                        const QStringList &tags)
 {
-  auto ann = m_model->find_annotation(uri) ;
-  if (ann) {
+  int row = m_model->find_row(uri) ;
+  if (row >= 0) {
+    float start = m_model->start(row) ;
+    float end = m_model->end(row) ;
     remove_annotation(uri) ;
-    if ((text.size() > 0 || tags.size() > 0) && ann->is_valid()) {
-      append_annotation(ann->about(), text, tags, ann) ;
+    if (text.size() > 0 || tags.size() > 0) {
+      append_annotation(start, end, text, tags, uri) ;  // The new annotation replaces `uri`
       }
     emit recording_changed(m_recording->uri()) ;
     }
@@ -350,6 +822,115 @@ void AnnotationList::delete_annotation(const QString &uri)
 /*------------------------------------------------------*/
 {
   remove_annotation(uri) ;
-  m_recording->delete_resource(rdf::URI(uri.toStdString())) ;
+  journal_edit(AnnotationJournal::Entry{false, uri, NAN, NAN, "", QStringList(), ""}) ;
   emit recording_changed(m_recording->uri()) ;
   }
+
+void AnnotationList::journal_edit(const AnnotationJournal::Entry &entry)
+/*--------------------------------------------------------------------*/
+{
+  m_journal.append(entry) ;
+  merge_edit(m_pending, entry) ;
+  if (!m_committimer.isActive()) m_committimer.start() ;
+  }
+
+void AnnotationList::journal_edits(const QList<AnnotationJournal::Entry> &entries)
+/*------------------------------------------------------------------------------*/
+{
+  m_journal.append(entries) ;
+  for (auto const &entry : entries) merge_edit(m_pending, entry) ;
+  if (!m_committimer.isActive()) m_committimer.start() ;
+  }
+
+void AnnotationList::merge_edit(QList<AnnotationJournal::Entry> &edits,
+/*-------------------------------------------------------------------*/
+                                const AnnotationJournal::Entry &entry)
+// Deleting an annotation whose addition is still to be committed cancels
+// the addition, so neither leaves resources in the metadata. If the
+// addition replaced an earlier annotation, that is deleted instead.
+{
+  if (!entry.add) {
+    for (int n = edits.size() - 1 ;  n >= 0 ;  --n) {
+      if (edits.at(n).add && edits.at(n).uri == entry.uri) {
+        QString predecessor = edits.at(n).predecessor ;
+        edits.removeAt(n) ;
+        if (predecessor != "")
+          merge_edit(edits, AnnotationJournal::Entry{false, predecessor, NAN, NAN, "", QStringList(), ""}) ;
+        return ;
+        }
+      }
+    }
+  edits.append(entry) ;
+  }
+
+bool AnnotationList::commit_edits(void)
+/*-----------------------------------*/
+{
+  m_committimer.stop() ;
+  if (!m_loaded || m_committer) {     // Don't change metadata while it's being read
+    m_committimer.start() ;           // or an earlier commit is still being applied
+    return false ;
+    }
+  if (m_pending.isEmpty()) return true ;
+  m_committer = new AnnotationCommitThread(m_recording, m_pending) ;
+  QObject::connect(m_committer, &AnnotationCommitThread::finished, this, &AnnotationList::commit_finished) ;
+  m_committer->start() ;
+  m_pending.clear() ;
+  return false ;
+  }
+
+void AnnotationList::commit_finished(const QString &error)
+/*------------------------------------------------------*/
+{
+  if (m_committer == nullptr) return ;   // Already waited for by flush_edits()
+  m_committer->wait(ULONG_MAX) ;
+  int count = m_committer->size() ;
+  delete m_committer ;
+  m_committer = nullptr ;
+  if (error != "") qWarning("Committing annotation edits: %s", qPrintable(error)) ;
+  else             qCInfo(browserLog, "Committed %d annotation edits", count) ;
+  if (m_reader == nullptr) {          // Edits replayed from the journal
+    read_annotations() ;
+    return ;
+    }
+  if (!m_pending.isEmpty() && !m_committimer.isActive()) m_committimer.start() ;
+  emit edits_committed() ;
+  }
+
+void AnnotationList::flush_edits(void)
+/*----------------------------------*/
+{
+  m_committimer.stop() ;
+  if (m_committer) {
+    m_committer->wait(ULONG_MAX) ;
+    delete m_committer ;
+    m_committer = nullptr ;
+    }
+  if (!m_loaded || m_pending.isEmpty()) return ;  // Left in the journal to replay
+  RecordingLock lock ;
+  for (auto const &entry : m_pending) AnnotationCommitThread::apply(m_recording, entry) ;
+  qCInfo(browserLog, "Committed %d annotation edits", m_pending.size()) ;
+  m_pending.clear() ;
+  }
+
+void AnnotationList::recording_saved(void)
+/*--------------------------------------*/
+{
+  if (m_pending.isEmpty()) m_journal.clear() ;  // Otherwise replay them next time
+  }
+
+AnnotationBatch AnnotationList::annotations_between(float start, float end) const
+/*------------------------------------------------------------------------------*/
+{
+  auto batch = std::make_shared<QList<LoadedAnnotation>>() ;
+  for (int row = 0 ; row < m_model->size() ; ++row) {
+    float a_start = m_model->start(row) ;
+    float a_end = isnan(m_model->end(row)) ? a_start : m_model->end(row) ;
+    if (a_end >= start && a_start <= end) {
+      batch->append(LoadedAnnotation{m_model->uri(row), a_start, m_model->end(row),
+                                     m_model->text(row), m_model->tag_ids(row),
+                                     m_model->editable(row)}) ;
+      }
+    }
+  return batch ;
+  }
@@ -24,68 +24,271 @@
 #include "typedefs.h"
 #include "table.h"
 #include "nrange.h"
+#include "eventindex.h"
+#include "tokenindex.h"
+#include "uritable.h"
+#include "journal.h"
 
 #include "ui_annotationlist.h"
 
 #include <biosignalml/biosignalml.h>
 
 #include <QWidget>
+#include <QThread>
+#include <QTimer>
 
+#include <atomic>
 #include <memory>
 
 
 namespace browser {
 
-  using AnnRow = std::tuple<bsml::Annotation::Ptr, std::shared_ptr<RowData>, bool> ;
+  static const int ANNOTATION_BATCH = 2000 ;      // Maximum annotations in a loaded batch
+  static const int ANNOTATION_BATCH_TIME = 100 ;  // Maximum msecs to collect a batch
+  static const int EVENT_FETCH = 1000 ;           // Event rows added as the table is scrolled
+  static const int JOURNAL_COMMIT_INTERVAL = 60000 ;  // Msecs from an edit until it's committed
 
+
+  /**
+   * An annotation as read from a recording, before it is added to a model.
+   */
+  struct LoadedAnnotation
+  /*===================*/
+  {
+    QString uri ;
+    float start ;
+    float end ;
+    QString text ;
+    QVector<int> tags ;   //!< Interned tag URIs
+    bool editable ;
+    } ;
+
+  using AnnotationBatch = std::shared_ptr<QList<LoadedAnnotation>> ;
+
+
+  /**
+   * Read a recording's annotations in a separate thread, passing
+   * them back in batches so the list can be filled while it is in use.
+   */
+  class AnnotationReadThread : public QObject
+  /*=======================================*/
+  {
+   Q_OBJECT
+
+   public:
+    AnnotationReadThread(bsml::Recording::Ptr recording) ;
+    void start(void) ;
+    void stop(void) ;
+    bool wait(unsigned long time) ;
+
+   public slots:
+    void run(void) ;
+
+   signals:
+    void loaded(AnnotationBatch) ;
+    void finished(void) ;
+
+   private:
+    bsml::Recording::Ptr m_recording ;
+    std::atomic<bool> m_exit ;
+    QThread m_thread ;
+    } ;
+
+
+  /**
+   * Apply journalled annotation edits to a recording's metadata in a
+   * separate thread, holding the recording lock once for the batch.
+   */
+  class AnnotationCommitThread : public QObject
+  /*=========================================*/
+  {
+   Q_OBJECT
+
+   public:
+    AnnotationCommitThread(bsml::Recording::Ptr recording,
+                           const QList<AnnotationJournal::Entry> &entries) ;
+    void start(void) ;
+    bool wait(unsigned long time) ;
+    inline int size(void) const { return m_entries.size() ; }
+
+    /** Apply an edit to a recording, while the caller holds the recording lock. */
+    static void apply(bsml::Recording::Ptr recording, const AnnotationJournal::Entry &entry) ;
+
+   public slots:
+    void run(void) ;
+
+   signals:
+    void finished(const QString &error) ;
+
+   private:
+    bsml::Recording::Ptr m_recording ;
+    QList<AnnotationJournal::Entry> m_entries ;
+    QThread m_thread ;
+    } ;
+
+
+  /**
+   * A table of annotations.
+   *
+   * Annotations are held in columns, with a row's URI being its
+   * key in the underlying :class:`TableModel`. Display values are
+   * only created when a cell is asked for.
+   */
   class AnnotationModel : public TableModel
   /*=====================================*/
   {
    Q_OBJECT
 
-    // <annotation, rowdata, editable>
-    typedef QList<AnnRow> AnnRows ;
-
    public:
     AnnotationModel(QObject *parent, const NumericRange &timemap) ;
 
-    const AnnRow &get_row(int row) const ;
-    bsml::Annotation::Ptr find_annotation(const QString &uri) const ;
-    void add_row(bsml::Annotation::Ptr &ann, float start, float end, const QString &type,
-                 const QString &text, const QString &tagtext="", bool editable=false) ;
-    void delete_row(const QString &uri) ;
-    const AnnRows &rows(void) const { return m_rows ; }
+    /**
+     * Add an annotation's columns.
+     *
+     * The row is shown once its URI is added with :meth:`appendRows`.
+     */
+    void add_row(float start, float end, const QString &type, const QString &text,
+                 const QVector<int> &tags=QVector<int>(), const QString &tagtext="",
+                 bool editable=false) ;
+
+    /** The number of annotation rows, which precede any event rows. */
+    inline int size(void) const { return m_starts.size() ; }
+    /** The row of an annotation, or -1 if the URI is unknown. */
+    inline int find_row(const QString &uri) const { return key_row(uri) ; }
+
+    inline QString uri(int row) const { return rowid(row) ; }
+    inline float start(int row) const { return m_starts.at(row) ; }
+    inline float end(int row) const { return m_ends.at(row) ; }
+    inline const QString &text(int row) const { return m_texts.at(row) ; }
+    QStringList tags(int row) const ;
+    inline const QVector<int> &tag_ids(int row) const { return m_tags.at(row) ; }
+    inline bool editable(int row) const { return m_editable.at(row) ; }
+    inline const NumericRange &timemap(void) const { return m_timemap ; }
+
+    /**
+     * Show events from an index after the annotation rows.
+     *
+     * Event rows are added to the table in time order as it is
+     * scrolled, rather than all at once, unless the table is sorted
+     * other than by ascending start time.
+     *
+     * :param events: The event index, or nullptr to show no events.
+     * :param type: Only show events of this type, or all events if negative.
+     */
+    void show_events(EventIndex::Ptr events, int type) ;
+    /** The event index position of a row, or -1 if the row is an annotation. */
+    int event_at(int row) const ;
+
+    /**
+     * Only show annotations with text or tags, and events with a type,
+     * that contain words starting with those in the search text.
+     *
+     * Event rows are reselected; annotation rows are filtered by
+     * :meth:`accepts`. When the text extends the previous search only
+     * rows that matched can stop matching, so just those that no longer
+     * do are signalled as changed, for the table to filter again.
+     *
+     * :return: Whether the whole table needs to be refiltered.
+     */
+    bool search(const QString &text) ;
+    inline bool searching(void) const { return m_searching ; }
+    bool accepts(int row) const ;
 
     static QStringList header(void) ;
 
+    int rowCount(const QModelIndex &parent=QModelIndex()) const ;
+    bool canFetchMore(const QModelIndex &parent) const ;
+    void fetchMore(const QModelIndex &parent) ;
+    void setFetchAll(bool all) ;
     QVariant data(const QModelIndex &index, int role) const ;
+    bool less_than(int left, int right, int column) const ;
+
+   protected:
+    void remove_data(const RowPosns &posns) ;
 
    private:
-    AnnRows m_rows ;
+    QVariant row_data(int row, int column) const ;
+    QVariant event_data(int event, int column) const ;
+    float time_key(int row, int column) const ;
+    QString text_key(int row, int column) const ;
+    void select_events(void) ;
+
+    QVector<int> m_ids ;         // Never reused, to identify rows in m_words
+    int m_nextid ;
+    QVector<float> m_starts ;    // NAN if not set
+    QVector<float> m_ends ;
+    QVector<quint8> m_types ;    // Index into m_typenames
+    QVector<QString> m_texts ;
+    QVector<QVector<int>> m_tags ;   // Interned tag URIs
+    QVector<QString> m_tagtexts ;
+    QVector<bool> m_editable ;
+    QStringList m_typenames ;
     NumericRange m_timemap ;
+    EventIndex::Ptr m_events ;
+    QStringList m_eventtypes ;   // Abbreviated type of each event type
+    int m_eventtype ;
+    QVector<int> m_eventrows ;   // Positions in the index of events being shown
+    int m_eventcount ;           // How many of these are in the table
+    bool m_fetchall ;            // Fetch all event rows, as not sorted by start time
+    TokenIndex m_words ;         // Words in annotation text and tags
+    TokenIndex m_typewords ;     // Words in event types
+    QString m_search ;
+    bool m_searching ;
+    QBitArray m_found ;          // Ids of annotations matching the search
     } ;
 
 
+  class AnnotationImportThread ;
+
+
   class AnnotationList : public QWidget
   /*=================================*/
   {
     Q_OBJECT
 
-    using EventDict = QHash<QString, floatPair> ;  //!< uri: (start, duration)
-
    public:
     AnnotationList(QWidget *parent, bsml::Recording::Ptr recording,
                    const StringDictionary &semantic_tags) ;
     ~AnnotationList() ;
 
+    /** Start reading the recording's annotations into the list. */
+    void load_annotations(void) ;
+
+    /**
+     * Commit all edits at once in this thread, after any commit in
+     * progress, as when the window is closed.
+     */
+    void flush_edits(void) ;
+    /** Clear the journal once the recording has been written with all edits committed. */
+    void recording_saved(void) ;
+
+    /** Copies of the annotations that overlap an interval. */
+    AnnotationBatch annotations_between(float start, float end) const ;
+    /** The recording's events, or nullptr if they haven't been loaded. */
+    inline EventIndex::Ptr events(void) const { return m_events ; }
+
    public slots:
     void show_annotations(void) ;
+    void append_batch(AnnotationBatch batch) ;
+    void loading_finished(void) ;
+    void events_loaded(EventIndex::Ptr index) ;
 
     void on_annotations_doubleClicked(const QModelIndex &index) ;
     void on_events_currentIndexChanged(const QString &eventtype) ;
+    void on_search_textChanged(const QString &text) ;
+    void on_import_file_clicked(void) ;
+    void import_finished(AnnotationBatch batch, const QString &error) ;
     void add_annotation(float start, float end, const QString &text, const QStringList &tags) ;
     void modify_annotation(const QString &id, const QString &text, const QStringList &tags) ;
     void delete_annotation(const QString &id) ;
+    /**
+     * Start applying journalled edits to the recording's metadata in the
+     * background. Returns true only if there are none to apply, so the
+     * metadata is up to date; otherwise :meth:`edits_committed` is
+     * emitted once they have been, or once annotations have been read.
+     */
+    bool commit_edits(void) ;
+    void commit_finished(const QString &error) ;
 
    signals:
     void annotationAdded(const QString &, float, float, const QString &, const QStringList &, bool) ;
@@ -95,26 +298,46 @@ namespace browser {
     void set_slider_value(float) ;
     void show_slider_time(float) ;
     void recording_changed(const rdf::URI &uri) ;
+    void annotations_loaded(void) ;
+    void edits_committed(void) ;
 
    private:
-    QString tag_labels(const QStringList &tags) ;
+    QString tag_labels(const QVector<int> &tags) ;
+    void show_rows(int first) ;
+    void show_selected_events(void) ;
+    void show_chart_events(void) ;
 
-    void append_annotation(bsml::Resource::Ptr about, const QString &text,
-                           const QStringList &tags,
-                           const bsml::Annotation::Ptr &predecessor=nullptr) ;
+    void append_annotation(float start, float end, const QString &text,
+                           const QStringList &tags, const QString &predecessor="") ;
     void remove_annotation(const QString &id) ;
+    void journal_edit(const AnnotationJournal::Entry &entry) ;
+    void journal_edits(const QList<AnnotationJournal::Entry> &entries) ;
+    void read_annotations(void) ;
+    static void merge_edit(QList<AnnotationJournal::Entry> &edits,
+                           const AnnotationJournal::Entry &entry) ;
 
     bsml::Recording::Ptr m_recording ;
-    StringDictionary m_semantic_tags ;
+    QHash<int, QString> m_taglabels ;   //!< Interned tag URI --> label
     Ui_AnnotationList m_ui ;
 
     SortedTable *m_table ;
     AnnotationModel *m_model ;
 
-    EventDict m_events ;
-    RowPosns m_event_posns ;
+    EventIndex::Ptr m_events ;
+    QVector<int> m_chartevents ;   // Positions in m_events of events drawn on the chart
+
+    AnnotationReadThread *m_reader ;
+    EventIndexThread *m_eventreader ;
+    AnnotationImportThread *m_importer ;
+    AnnotationCommitThread *m_committer ;   //!< Only one commit at a time
+
+    AnnotationJournal m_journal ;
+    QList<AnnotationJournal::Entry> m_pending ;   // Edits not yet committed
+    QTimer m_committimer ;
 
+    bool m_loaded ;
     bool m_settingup ;
+    bool m_eventspending ;         // Events chosen while setting up
     } ;
 
   } ;
@@ -0,0 +1,230 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "batchrender.h"
+#include "overview.h"
+#include "chartimage.h"
+#include "recordinglock.h"
+#include "logging.h"
+
+#include <QFile>
+#include <QRegularExpression>
+#include <QTextStream>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+
+using namespace browser ;
+
+
+RenderThread::RenderThread(const QList<RenderJob> &jobs, std::atomic<int> *next, const QSize &size)
+/*==============================================================================================*/
+: QObject(),
+  m_chart(),
+  m_jobs(jobs),
+  m_next(next),
+  m_size(size),
+  m_failed(0),
+  m_path(""),
+  m_recording(nullptr),
+  m_signals(nullptr)
+{
+  QObject::connect(&m_thread, &QThread::started, this, &RenderThread::run) ;
+  moveToThread(&m_thread) ;
+  }
+
+void RenderThread::start(void)
+/*--------------------------*/
+{
+  m_thread.start() ;
+  }
+
+void RenderThread::run(void)
+/*------------------------*/
+{
+  int n ;
+  while ((n = (*m_next)++) < m_jobs.size()) {
+    const RenderJob &job = m_jobs.at(n) ;
+    try {
+      render_job(job) ;
+      }
+    catch (std::exception &e) {
+      qCritical("%s: %s", job.output.toLocal8Bit().constData(), e.what()) ;
+      m_failed += 1 ;
+      }
+    }
+  if (m_recording != nullptr) {
+    RecordingLock lock ;
+    m_recording->close() ;
+    }
+  m_thread.exit(0) ;
+  }
+
+void RenderThread::open_recording(const QString &path)
+/*--------------------------------------------------*/
+{
+  if (path == m_path) return ;
+  m_path = "" ;
+  m_signals = nullptr ;
+  {
+    RecordingLock lock ;
+    if (m_recording != nullptr) m_recording->close() ;
+    m_recording = nullptr ;
+    m_recording = bsml::HDF5::Recording::create(path.toStdString(), true) ;  // Read only
+    }
+  m_signals = std::make_shared<SignalTable>(m_recording) ;   // Takes the lock itself
+  m_path = path ;
+  }
+
+void RenderThread::render_job(const RenderJob &job)
+/*-----------------------------------------------*/
+{
+  open_recording(job.recording) ;
+  float duration = job.duration ;
+  if (isnan(duration)) {
+    RecordingLock lock ;
+    duration = (float)m_recording->duration() - job.start ;
+    }
+  if (isnan(duration) || duration <= 0.0)
+    throw std::runtime_error("Nothing to render") ;
+
+  BatchRenderer::load_chart(&m_chart, m_signals, job.ids, job.start, duration, m_size.width()) ;
+  ChartImage::save(&m_chart, m_size, job.output) ;
+  }
+
+bool RenderThread::wait(unsigned long time)
+/*---------------------------------------*/
+{
+  return m_thread.wait(time) ;
+  }
+
+
+BatchRenderer::BatchRenderer(const QSize &size, int threads)
+/*========================================================*/
+: m_size(size),
+  m_threads(threads)
+{
+  }
+
+QList<RenderJob> BatchRenderer::read_jobs(const QString &filename)
+/*--------------------------------------------------------------*/
+{
+  QFile file(filename) ;
+  if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    throw std::runtime_error(QString("Cannot open %1").arg(filename).toStdString()) ;
+  QList<RenderJob> jobs ;
+  QTextStream stream(&file) ;
+  int lineno = 0 ;
+  while (!stream.atEnd()) {
+    QString line = stream.readLine().trimmed() ;
+    lineno += 1 ;
+    if (line == "" || line.startsWith("#")) continue ;
+    QStringList fields = line.split(QRegularExpression("\\s+")) ;
+    bool ok = (fields.size() == 4 || fields.size() == 5) ;
+    RenderJob job ;
+    if (ok) {
+      job.recording = fields[0] ;
+      job.start = fields[1].toFloat(&ok) ;
+      }
+    if (ok) {
+      if (fields[2] == "-") job.duration = NAN ;
+      else                  job.duration = fields[2].toFloat(&ok) ;
+      }
+    if (!ok) throw std::runtime_error(QString("%1:%2: invalid job").arg(filename).arg(lineno).toStdString()) ;
+    job.output = fields[3] ;
+    if (fields.size() == 5) job.ids = fields[4].split(",", Qt::SkipEmptyParts) ;
+    jobs.append(job) ;
+    }
+  return jobs ;
+  }
+
+int BatchRenderer::render(const QList<RenderJob> &jobs)
+/*---------------------------------------------------*/
+{
+  int threads = (m_threads > 0) ? m_threads : QThread::idealThreadCount() ;
+  threads = std::max(1, std::min(threads, jobs.size())) ;
+  std::atomic<int> next(0) ;
+
+  QList<RenderThread *> workers ;
+  for (int n = 0 ;  n < threads ;  ++n)
+    workers.append(new RenderThread(jobs, &next, m_size)) ;
+  for (auto const &w : workers) w->start() ;
+
+  int failed = 0 ;
+  for (auto const &w : workers) {
+    w->wait(ULONG_MAX) ;
+    failed += w->failed() ;
+    delete w ;
+    }
+  qCInfo(browserLog, "Rendered %d of %d images", jobs.size() - failed, jobs.size()) ;
+  return failed ;
+  }
+
+void BatchRenderer::load_chart(ChartRenderer *chart, SignalTable::Ptr table, const QStringList &ids,
+/*------------------------------------------------------------------------------------------------*/
+                               float start, float duration, int width)
+{
+  chart->clearTraces() ;
+  chart->resetAnnotations() ;
+  chart->setTimeRange(start, duration) ;
+  auto interval = bsml::Interval::create(rdf::URI(), start, duration) ;
+  int pixels = std::max(width - (MARGIN_LEFT + MARGIN_RIGHT), 1) ;
+  for (auto const &e : table->entries()) {
+    if (ids.size() > 0 && !ids.contains(e.id) && !ids.contains(e.label)) continue ;
+    chart->addSignalTrace(e.id, e.label, e.units) ;
+    chart->appendData(e.id, read_window(e, interval, pixels)) ;
+    }
+  }
+
+bsml::data::TimeSeries::Ptr BatchRenderer::read_window(const SignalTable::Entry &entry,
+/*-----------------------------------------------------------------------------------*/
+                                                       bsml::Interval::Ptr interval, int pixels)
+{
+  double duration = interval->duration() ;
+  if (isnan(entry.rate)) {
+    RecordingLock lock ;
+    return entry.signal->read(interval, 20000) ;
+    }
+  else if (SignalOverview::use_raw(entry.rate, duration, pixels)) {
+    RecordingLock lock ;
+    return entry.signal->read(interval, (int)(entry.rate*duration) + 2) ;
+    }
+
+  // Too many samples to draw, so reduce them to a min/max envelope
+  // a chunk at a time, as the chart does for a long window.
+  double start = interval->start() ;
+  double end = start + duration ;
+  double chunk = OVERVIEW_CHUNK/entry.rate ;
+  SignalOverview overview(entry.rate, start) ;
+  while (!overview.complete() && overview.end() < end) {
+    bsml::data::TimeSeries::Ptr d ;
+    {
+      RecordingLock lock ;    // Released while the chunk is reduced
+      d = entry.signal->read(bsml::Interval::create(rdf::URI(), overview.end(),
+                             std::min(chunk, end - overview.end())), OVERVIEW_CHUNK) ;
+      }
+    if (d->size() == 0) overview.setComplete() ;
+    else                overview.appendSamples(d->data()) ;
+    }
+  return overview.envelope(start, end, pixels) ;
+  }
@@ -0,0 +1,141 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_BATCHRENDER_H
+#define BROWSER_BATCHRENDER_H
+
+#include "chartplot.h"
+#include "signaltable.h"
+
+#include <biosignalml/biosignalml.h>
+#include <biosignalml/data/hdf5.h>
+
+#include <QObject>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+
+#include <atomic>
+
+
+namespace browser {
+
+  /**
+   * A chart image to render.
+   */
+  struct RenderJob
+  /*============*/
+  {
+    QString recording ;            //!< HDF5 file
+    float start ;
+    float duration ;               //!< NAN for the rest of the recording
+    QString output ;               //!< PNG, SVG or PDF file
+    QStringList ids ;              //!< Signal ids or labels; all signals if empty
+    } ;
+
+
+  /**
+   * Render jobs, taken in turn from a shared list, with a
+   * :class:`ChartRenderer` of its own in a separate thread.
+   */
+  class RenderThread : public QObject
+  /*===============================*/
+  {
+   Q_OBJECT
+
+   public:
+    RenderThread(const QList<RenderJob> &jobs, std::atomic<int> *next, const QSize &size) ;
+    void start(void) ;
+    bool wait(unsigned long time) ;
+    inline int failed(void) const { return m_failed ; }
+
+   public slots:
+    void run(void) ;
+
+   private:
+    void render_job(const RenderJob &job) ;
+    void open_recording(const QString &path) ;
+
+    ChartRenderer m_chart ;
+    const QList<RenderJob> &m_jobs ;
+    std::atomic<int> *m_next ;     //!< Index of the next job to render
+    QSize m_size ;
+    int m_failed ;
+    QString m_path ;               //!< Of the open recording
+    bsml::HDF5::Recording::Ptr m_recording ;
+    SignalTable::Ptr m_signals ;
+    QThread m_thread ;
+    } ;
+
+
+  /**
+   * Render chart images without a window, for the `--render` option.
+   *
+   * Jobs are listed one per line in a text file, as fields separated
+   * by white space::
+   *
+   *   RECORDING START DURATION OUTPUT [SIGNAL,SIGNAL,...]
+   *
+   * with a DURATION of `-` for the rest of the recording. Blank lines
+   * and those starting with `#` are ignored.
+   *
+   * Jobs are rendered in parallel by a :class:`RenderThread` per core,
+   * each drawing with a :class:`ChartRenderer` rather than a widget. Images
+   * are saved as a :class:`ChartImage`, in the format given by the output
+   * file's extension.
+   */
+  class BatchRenderer
+  /*===============*/
+  {
+   public:
+    BatchRenderer(const QSize &size, int threads=0) ;
+
+    /** Read a job list, throwing `std::runtime_error` if it's invalid. */
+    static QList<RenderJob> read_jobs(const QString &filename) ;
+
+    /** Render jobs, returning the number that failed. */
+    int render(const QList<RenderJob> &jobs) ;
+
+    /**
+     * Show signals over a window in a chart that will be drawn `width` pixels
+     * wide, replacing any traces the chart has.
+     *
+     * :param ids: Signal ids or labels; all signals if empty.
+     */
+    static void load_chart(ChartRenderer *chart, SignalTable::Ptr table, const QStringList &ids,
+                           float start, float duration, int width) ;
+
+    /**
+     * Read a signal over a window to be drawn `pixels` wide, as raw samples
+     * if they are sparse enough and otherwise as a min/max envelope.
+     * Each read takes the :class:`RecordingLock`.
+     */
+    static bsml::data::TimeSeries::Ptr read_window(const SignalTable::Entry &entry,
+                                                   bsml::Interval::Ptr interval, int pixels) ;
+
+   private:
+    QSize m_size ;
+    int m_threads ;
+    } ;
+
+  } ;
+
+#endif
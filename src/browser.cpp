@@ -23,11 +23,21 @@
 #include "signallist.h"
 #include "annotationlist.h"
 #include "scroller.h"
+#include "regionexport.h"
+#include "sampleexport.h"
+#include "tail.h"
+#include "recordinglock.h"
+#include "logging.h"
+
+#include <biosignalml/data/hdf5.h>
 
 #include <QMetaType>
 #include <QMessageLogger>
+#include <QMessageBox>
+#include <QTimer>
 
 #include <cmath>
+#include <climits>
 #include <exception>
 
 using namespace browser ;
@@ -39,10 +49,23 @@ Browser::Browser(bsml::Recording::Ptr recording, float start, float end,
 : QMainWindow(),
   m_ui(new Ui::MainWindow()),
   m_recording(recording),
+  m_signaltable(nullptr),
+  m_metadata(nullptr),
   m_modified(false),
+  m_savepending(false),
   m_closekey(new QShortcut(QKeySequence::Close, this)),
-  m_readers(QList<SignalReadThread *>())
+  m_savekey(new QShortcut(QKeySequence::Save, this)),
+  m_readers(QList<SignalReadThread *>()),
+  m_overviews(QHash<QString, SignalOverview::Ptr>()),
+  m_exporter(nullptr),
+  m_exportprogress(nullptr),
+  m_tail(nullptr),
+  m_followfile(""),
+  m_followduration(NAN),
+  m_reading(0),
+  m_firstdata(false)
 {
+  m_startup.start() ;
   float duration ;
   if (isnan(end)) {
     duration = (float)recording->duration() ;
@@ -59,8 +82,9 @@ Browser::Browser(bsml::Recording::Ptr recording, float start, float end,
     start = end ;
     }
   m_start = start ;        //# Used in adjust_layout
+  m_duration = duration ;
 
-  m_signals = new SignalList(this, recording) ; // TODO , annotator) ;
+  m_signals = new SignalList(this) ; // TODO , annotator) ;
   m_annotations = new AnnotationList(this, recording, semantic_tags) ;
   m_scroller = new Scroller(this, recording, start, duration) ;
 
@@ -69,6 +93,10 @@ Browser::Browser(bsml::Recording::Ptr recording, float start, float end,
 
   // So can be passed between threads using signal/slot
   qRegisterMetaType<bsml::data::TimeSeries::Ptr>("const bsml::data::TimeSeries::Ptr &") ;
+  qRegisterMetaType<bsml::data::TimeSeries::Ptr>("bsml::data::TimeSeries::Ptr") ;
+  qRegisterMetaType<SignalTable::Ptr>("SignalTable::Ptr") ;
+  qRegisterMetaType<AnnotationBatch>("AnnotationBatch") ;
+  qRegisterMetaType<EventIndex::Ptr>("EventIndex::Ptr") ;
 
   // Close with the close-key shortcut.
   QObject::connect(m_closekey, &QShortcut::activated, this, &Browser::close) ;
@@ -79,6 +107,9 @@ Browser::Browser(bsml::Recording::Ptr recording, float start, float end,
   chart->setId(((std::string)m_recording->uri()).c_str()) ;
   chart->setSemanticTags(semantic_tags) ;
   QObject::connect(chart, &ChartPlot::exportRecording, this, &Browser::exportRecording) ;
+  QObject::connect(chart, &ChartPlot::windowChanged,   this, &Browser::plot_window) ;
+  QObject::connect(chart, &ChartPlot::tracesExposed,   this, &Browser::load_traces,
+                   Qt::QueuedConnection) ;    // Exposed while painting
 
   // Connections with signal list
   QObject::connect(m_signals,          &SignalList::add_event_trace,  chart, &ChartPlot::addEventTrace) ;
@@ -87,6 +118,7 @@ Browser::Browser(bsml::Recording::Ptr recording, float start, float end,
 
   QObject::connect(m_signals->model(), &SignalModel::rowVisible,     chart, &ChartPlot::setTraceVisible) ;
   QObject::connect(m_signals->model(), &SignalModel::rowMoved,       chart, &ChartPlot::moveTrace) ;
+  QObject::connect(m_signals->model(), &SignalModel::rowsVisible,    chart, &ChartPlot::setTracesVisible) ;
   QObject::connect(m_signals->ui().signallist, &SignalView::rowSelected, chart, &ChartPlot::plotSelected) ;
 
   // Connections with annotation list
@@ -97,9 +129,12 @@ Browser::Browser(bsml::Recording::Ptr recording, float start, float end,
   QObject::connect(m_annotations, &AnnotationList::set_slider_value,  m_scroller,    &Scroller::set_slidervalue) ;
   QObject::connect(m_annotations, &AnnotationList::show_slider_time,  m_scroller,    &Scroller::show_slidertime) ;
   QObject::connect(m_annotations, &AnnotationList::recording_changed, this,          &Browser::set_modified) ;
+  QObject::connect(m_annotations, &AnnotationList::annotations_loaded, this,         &Browser::annotations_loaded) ;
+  QObject::connect(m_annotations, &AnnotationList::edits_committed,   this,          &Browser::save_pending) ;
   QObject::connect(chart,         &ChartPlot::annotationAdded,        m_annotations, &AnnotationList::add_annotation) ;
   QObject::connect(chart,         &ChartPlot::annotationModified,     m_annotations, &AnnotationList::modify_annotation) ;
   QObject::connect(chart,         &ChartPlot::annotationDeleted,      m_annotations, &AnnotationList::delete_annotation) ;
+  QObject::connect(m_savekey,     &QShortcut::activated,              this,          &Browser::save_recording) ;
 
   // Connections with scroller
   QObject::connect(m_scroller, &Scroller::set_plot_timerange, chart, &ChartPlot::setTimeRange) ;
@@ -111,10 +146,14 @@ Browser::Browser(bsml::Recording::Ptr recording, float start, float end,
   //#    resize_annotation_list.connect(m_annotations->annotations.resizeCells)
   //#    show_slider_time.connect(m_scroller->show_slider_time)
 
-  // Everything connected, let's go...
-  m_signals->plot_signals(start, duration) ;
-  m_annotations->show_annotations() ;
+  // Everything connected, so show the window straight away and fill it
+  // in as signal metadata, the first data window and annotations arrive.
+  chart->setMessage("Loading...") ;
   m_scroller->setup_slider() ;
+  m_metadata = new SignalTableThread(m_recording) ;
+  QObject::connect(m_metadata, &SignalTableThread::loaded, this, &Browser::signals_loaded) ;
+  m_metadata->start() ;
+  log_startup("window constructed") ;
 
   //    m_ui->chartform._user_zoom_index = m_ui->timezoom.count()
   //    m_ui->chartform.ui.chart.zoomChart.connect(zoom_chart)
@@ -127,45 +166,277 @@ Browser::~Browser()
 /*---------------*/
 {
   stop_readers() ;
+  for (auto const &t : m_stopping) {
+    t->wait(ULONG_MAX) ;
+    delete t ;
+    }
+  if (m_tail) {
+    m_tail->stop() ;
+    m_tail->wait(ULONG_MAX) ;
+    delete m_tail ;
+    }
+  if (m_exporter) {
+    m_exporter->stop() ;
+    m_exporter->wait(ULONG_MAX) ;
+    delete m_exporter ;
+    }
+  if (m_metadata) {
+    m_metadata->wait(ULONG_MAX) ;
+    delete m_metadata ;
+    }
   delete m_ui ;
   }
 
+void Browser::log_startup(const char *stage)
+/*----------------------------------------*/
+{
+  qCInfo(browserLog, "Startup: %s at %lld ms", stage, m_startup.elapsed()) ;
+  }
+
+void Browser::signals_loaded(SignalTable::Ptr table)
+/*------------------------------------------------*/
+{
+  log_startup("signal metadata loaded") ;
+  ChartPlot *chart = m_ui->chartform->ui().chart ;
+  if (table == nullptr) {
+    chart->setMessage("Unable to read signals") ;
+    return ;
+    }
+  m_signaltable = table ;
+  m_signals->setSignals(table) ;
+  chart->setMessage("") ;
+  m_signals->plot_signals(m_start, m_duration) ;
+  if (m_followfile != "") start_tail() ;
+  // Let the event loop draw the traces before reading annotations
+  QTimer::singleShot(0, this, &Browser::load_annotations) ;
+  }
+
+void Browser::load_annotations(void)
+/*--------------------------------*/
+{
+  m_annotations->load_annotations() ;
+  }
+
+void Browser::annotations_loaded(void)
+/*----------------------------------*/
+{
+  log_startup("annotations loaded") ;
+  save_pending() ;
+  }
+
+void Browser::save_pending(void)
+/*----------------------------*/
+{
+  if (m_savepending) {
+    m_savepending = false ;
+    save_recording() ;
+    }
+  }
+
+void Browser::reader_done(void)
+/*---------------------------*/
+{
+  m_reading -= 1 ;
+  if (m_reading == 0 && !m_firstdata) {
+    m_firstdata = true ;
+    log_startup("first data window loaded") ;
+    }
+  }
+
+void Browser::reader_finished(void)
+/*-------------------------------*/
+{
+  auto reader = qobject_cast<SignalReadThread *>(sender()) ;
+  if (m_stopping.removeOne(reader)) delete reader ;
+  }
+
+void Browser::retire_reader(SignalReadThread *reader)
+/*-------------------------------------------------*/
+// Stop a reader without waiting for it, as it may be part way through
+// a chunk while holding the recording lock. It's deleted once finished.
+{
+  reader->stop() ;
+  if (reader->wait(0)) delete reader ;
+  else                 m_stopping.append(reader) ;   // Before its queued finished()
+  }
+
 void Browser::stop_readers(void)
 /*----------------------------*/
 {
   for (auto const &t : m_readers)
-    t->stop() ;
-  while (1) {
-    bool stopped = true ;
-    for (auto const &t : m_readers)
-      stopped = stopped && t->wait(10) ;
-    if (stopped) break ;
-    }
+    retire_reader(t) ;
   m_readers.clear() ;
   }
 
 void Browser::plot_signals(bsml::Interval::Ptr interval)
 /*----------------------------------------------------*/
 {
-  stop_readers() ;
   emit reset_annotations() ;
-  for (auto const &u : m_recording->get_signal_uris()) {   //# Why not only ones currently selected ????  std::cout << "STORED: " << hdf5.serialise_metadata(rdf::Graph::Format::TURTLE) << std::endl ;
-    auto s = m_recording->get_signal(u) ;
+  load_signals(interval) ;
+  }
+
+void Browser::plot_window(float start, float duration)
+/*--------------------------------------------------*/
+{
+  if (m_interval != nullptr                 // Scrolled back to what's loaded
+   && (float)m_interval->start() == start && (float)m_interval->duration() == duration) return ;
+  load_signals(m_recording->new_interval(start, duration)) ;
+  }
+
+void Browser::load_signals(bsml::Interval::Ptr interval)
+/*----------------------------------------------------*/
+{
+  stop_readers() ;
+  m_interval = interval ;
+  // Only traces in the chart's viewport are read; others are
+  // loaded by load_traces() when they are scrolled into view.
+  load_traces(m_ui->chartform->ui().chart->tracesInView()) ;
+  }
+
+void Browser::load_traces(const QStringList &ids)
+/*---------------------------------------------*/
+{
+  if (m_interval == nullptr || m_signaltable == nullptr) return ;
+  for (auto const &id : ids) {
+    int n = m_signaltable->index(id) ;
 // What is dynamic type of each signal?? Needs to be HDF5::Signal...
-    auto reader = new SignalReadThread(s, interval, m_ui->chartform->ui().chart) ;
-    m_readers.append(reader) ;
-    reader->start() ;
+    if (n >= 0) {
+      stop_reader(id) ;    // A trace re-exposed while still being read
+      start_reader(m_signaltable->at(n)) ;
+      }
     }
   }
 
+void Browser::stop_reader(const QString &id)
+/*----------------------------------------*/
+{
+  for (int n = 0 ;  n < m_readers.size() ;  ++n) {
+    auto reader = m_readers.at(n) ;
+    if (reader->id() == id) {
+      retire_reader(reader) ;
+      m_readers.removeAt(n) ;
+      return ;
+      }
+    }
+  }
+
+void Browser::start_reader(const SignalTable::Entry &entry)
+/*-------------------------------------------------------*/
+{
+  ChartPlot *chart = m_ui->chartform->ui().chart ;
+  SignalOverview::Ptr overview = m_overviews.value(entry.id, nullptr) ;
+  if (overview == nullptr && !isnan(entry.rate)) {
+    overview = std::make_shared<SignalOverview>(entry.rate) ;
+    m_overviews.insert(entry.id, overview) ;
+    }
+  if (overview != nullptr) chart->setTraceOverview(entry.id, overview) ;
+  auto reader = new SignalReadThread(entry.signal, m_interval, chart, overview, chart->plotWidth()) ;
+  QObject::connect(reader, &SignalReadThread::read_done, this, &Browser::reader_done) ;
+  QObject::connect(reader, &SignalReadThread::finished, this, &Browser::reader_finished) ;
+  m_reading += 1 ;
+  m_readers.append(reader) ;
+  reader->start() ;
+  }
+
+
+void Browser::follow(const QString &filename, double duration)
+/*-----------------------------------------------------------*/
+{
+  m_followfile = filename ;
+  m_followduration = duration ;
+  if (m_signaltable != nullptr) start_tail() ;   // Otherwise once signals are loaded
+  }
+
+void Browser::start_tail(void)
+/*--------------------------*/
+{
+  if (m_tail) return ;
+  m_tail = new TailThread(m_followfile, m_signaltable, m_followduration) ;
+  QObject::connect(m_tail, &TailThread::appended, this, &Browser::tail_appended) ;
+  QObject::connect(m_tail, &TailThread::extended, this, &Browser::tail_extended) ;
+  QObject::connect(m_tail, &TailThread::finished, this, &Browser::tail_finished) ;
+  m_tail->start() ;
+  }
+
+void Browser::tail_appended(const QString &id, const bsml::data::TimeSeries::Ptr &data)
+/*-----------------------------------------------------------------------------------*/
+{
+  if (data->size() == 0) return ;
+  double first = data->point(0).time() ;
+  // A complete overview is no longer being built by a reader, so can
+  // have the new samples added when they follow on from its end.
+  SignalOverview::Ptr overview = m_overviews.value(id, nullptr) ;
+  if (overview != nullptr && overview->complete()
+   && std::abs(overview->end() - first) < 0.5/overview->rate())
+    overview->appendSamples(data->data()) ;
+
+  // Samples in the loaded window are added to its trace if it shows
+  // raw samples; otherwise the trace draws them from the overview.
+  ChartPlot *chart = m_ui->chartform->ui().chart ;
+  if (m_interval != nullptr
+   && first < (m_interval->start() + m_interval->duration())
+   && (overview == nullptr
+    || SignalOverview::use_raw(overview->rate(), m_interval->duration(), chart->plotWidth())))
+    chart->appendData(id, data) ;
+  else if (overview != nullptr)
+    chart->update() ;
+  }
+
+void Browser::tail_extended(double duration)
+/*----------------------------------------*/
+{
+  {
+    RecordingLock lock ;
+    m_recording->set_duration(duration) ;
+    }
+  m_scroller->extend_range() ;
+  }
+
+void Browser::tail_finished(const QString &error)
+/*---------------------------------------------*/
+{
+  if (error != "") qWarning("Following recording: %s", qPrintable(error)) ;
+  }
+
 
 void Browser::exportRecording(const QString &filename, float start, float end)
 /*--------------------------------------------------------------------------*/
-//# This is where we create a BSML file with current set of displayed signals
-//# along with events and annotations starting or ending in the interval, and
-//# provenance linking back to the original.
+// Create a BSML file with the current set of displayed signals along with
+// events and annotations overlapping the interval, and provenance linking
+// back to the original, or write the signals as CSV or EDF. Copying is
+// done in the background.
 {
-  // TODOprint('export', start, end) ;
+  if (m_exporter || m_signaltable == nullptr) return ;
+  QVector<SignalTable::Entry> exported ;
+  for (auto const &id : m_ui->chartform->ui().chart->visibleTraces()) {
+    int n = m_signaltable->index(id) ;
+    if (n >= 0) exported.append(m_signaltable->at(n)) ;
+    }
+  if (SampleExportThread::handles(filename))
+    m_exporter = new SampleExportThread(m_recording, filename, start, end, exported, m_overviews) ;
+  else
+    m_exporter = new RegionExportThread(m_recording, filename, start, end, exported,
+                                        m_annotations->annotations_between(start, end),
+                                        m_annotations->events()) ;
+  m_exportprogress = new QProgressDialog("Exporting region...", "Cancel", 0, 100, this) ;
+  m_exportprogress->setWindowModality(Qt::NonModal) ;
+  m_exportprogress->setMinimumDuration(500) ;
+  QObject::connect(m_exporter, &ExportThread::progress, m_exportprogress, &QProgressDialog::setValue) ;
+  QObject::connect(m_exporter, &ExportThread::finished, this, &Browser::export_finished) ;
+  QObject::connect(m_exportprogress, &QProgressDialog::canceled, m_exporter, &ExportThread::stop,
+                   Qt::DirectConnection) ;    // Exporter's thread is busy
+  m_exporter->start() ;
+  }
+
+void Browser::export_finished(const QString &error)
+/*-----------------------------------------------*/
+{
+  m_exporter->wait(ULONG_MAX) ;
+  delete m_exporter ;
+  m_exporter = nullptr ;
+  m_exportprogress->deleteLater() ;
+  m_exportprogress = nullptr ;
+  if (error != "") QMessageBox::warning(this, "Export region", error) ;
   }
 
 //def keyPressEvent(self, event):   ## Also need to do so in chart...
@@ -179,17 +450,39 @@ void Browser::set_modified(const rdf::URI &uri)
   if (m_recording->uri() == uri) m_modified = true ;
   }
 
+void Browser::save_recording(void)
+/*------------------------------*/
+{
+  if (!m_annotations->commit_edits()) {  // Wait until edits have been committed
+    m_savepending = true ;
+    return ;
+    }
+  if (m_modified) {
+    auto hdf5 = std::dynamic_pointer_cast<bsml::HDF5::Recording>(m_recording) ;
+    if (hdf5) {                          // Remote recordings keep their journal
+      RecordingLock lock ;
+      hdf5->save_metadata() ;
+      m_modified = false ;
+      qCInfo(browserLog, "Saved recording metadata") ;
+      }
+    }
+  if (!m_modified) m_annotations->recording_saved() ;  // Journal no longer needed
+  }
+
 void Browser::closeEvent(QCloseEvent *event)
 /*----------------------------------------*/
 {
+  m_annotations->flush_edits() ;
   if (m_modified) {
     m_modified = false ;
 // Ask user if they want to save...
-// Have ^S for Save changes
+// Have ^S for Save changes -- only of HDF5 recordings, see save_recording()
 // Add a menu...
 // Multiple main windows, one per file...
+    RecordingLock lock ;
     m_recording->close() ;
     }
+  m_annotations->recording_saved() ;  // Journal no longer needed
   QMainWindow::closeEvent(event) ;
   }
 
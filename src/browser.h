@@ -23,11 +23,15 @@
 
 #include "browser_exports.h"
 #include "typedefs.h"
+#include "overview.h"
+#include "signaltable.h"
 
 #include <biosignalml/biosignalml.h>
 
 #include <QMainWindow>
 #include <QShortcut>
+#include <QProgressDialog>
+#include <QElapsedTimer>
 
 
 namespace Ui {
@@ -41,6 +45,9 @@ namespace browser {
   class AnnotationList ;
   class Scroller ;
   class SignalReadThread ;
+  class SignalTableThread ;
+  class ExportThread ;
+  class TailThread ;
 
   class BROWSER_EXPORT Browser : public QMainWindow
   /*=============================================*/
@@ -53,11 +60,32 @@ namespace browser {
     ~Browser() ;
 
     void exportRecording(const QString &filename, float start, float end) ;
+    /**
+     * Follow an HDF5 recording as it is written, showing new samples as they
+     * arrive. `duration` is the recording's when it was opened, or NAN.
+     */
+    void follow(const QString &filename, double duration) ;
     void closeEvent(QCloseEvent *event) ;
 
    public slots:
     void plot_signals(bsml::Interval::Ptr interval) ;
+    void plot_window(float start, float duration) ;
+    void load_traces(const QStringList &ids) ;
     void set_modified(const rdf::URI &uri) ;
+    void signals_loaded(SignalTable::Ptr table) ;
+    void reader_done(void) ;
+    void reader_finished(void) ;
+    void annotations_loaded(void) ;
+    void save_pending(void) ;
+    /**
+     * Commit journalled annotation edits and, for an HDF5 recording,
+     * write its metadata to the file.
+     */
+    void save_recording(void) ;
+    void export_finished(const QString &error) ;
+    void tail_appended(const QString &id, const bsml::data::TimeSeries::Ptr &data) ;
+    void tail_extended(double duration) ;
+    void tail_finished(const QString &error) ;
 
    signals:
     void reset_annotations(void) ;
@@ -66,13 +94,37 @@ namespace browser {
 
    private:
     void stop_readers(void) ;
+    void stop_reader(const QString &id) ;
+    void retire_reader(SignalReadThread *reader) ;
+    void load_signals(bsml::Interval::Ptr interval) ;
+    void start_reader(const SignalTable::Entry &entry) ;
+    void start_tail(void) ;
+    void load_annotations(void) ;
+    void log_startup(const char *stage) ;
 
     Ui::MainWindow *m_ui ;
     bsml::Recording::Ptr m_recording ;
+    SignalTable::Ptr m_signaltable ;  //!< Signal handles, shared with SignalList
+    SignalTableThread *m_metadata ;   //!< Builds m_signaltable at startup
     bool m_modified ;
+    bool m_savepending ;              //!< Save once edits have been committed
     QShortcut *m_closekey ;
+    QShortcut *m_savekey ;            //!< Saves annotation edits to the recording
     QList<SignalReadThread  *> m_readers ;
+    QList<SignalReadThread  *> m_stopping ;  //!< Stopped, deleted once finished
+    QHash<QString, SignalOverview::Ptr> m_overviews ;  //!< Signal id --> min/max pyramid
+    ExportThread *m_exporter ;        //!< Only one export at a time
+    QProgressDialog *m_exportprogress ;
+    TailThread *m_tail ;              //!< When following a recording
+    QString m_followfile ;
+    double m_followduration ;
     float m_start ;
+    float m_duration ;
+    bsml::Interval::Ptr m_interval ;  //!< Currently loaded
+
+    QElapsedTimer m_startup ;      //!< Time since construction, for startup log
+    int m_reading ;                //!< Number of readers still running
+    bool m_firstdata ;             //!< Have logged the first data window
 
     SignalList *m_signals ;
     AnnotationList *m_annotations ;
@@ -21,6 +21,7 @@
 #include "chartform.h"
 
 #include <QKeySequence>
+#include <QSignalBlocker>
 
 using namespace browser ;
 
@@ -35,7 +36,9 @@ ChartForm::ChartForm(QWidget *parent)
   m_ui.setupUi(this) ;
   QObject::connect(m_ui.chart, &ChartPlot::chartPosition,    this, &ChartForm::chart_resize) ;
   QObject::connect(m_ui.chart, &ChartPlot::updateTimeScroll, this, &ChartForm::position_timescroll) ;
+  QObject::connect(m_ui.chart, &ChartPlot::updateTraceScroll, this, &ChartForm::position_tracescroll) ;
   m_ui.timescroll->hide() ;
+  m_ui.tracescroll->hide() ;
   }
 
 void ChartForm::setTimeRange(float start, float duration)
@@ -111,10 +114,25 @@ void ChartForm::on_timescroll_valueChanged(int position)
 void ChartForm::position_timescroll(bool visible)
 /*---------------------------------------------*/
 {
+  const QSignalBlocker blocker(m_ui.timescroll) ;  // Chart has already set its window
   m_ui.chart->setTimeScroll(*m_ui.timescroll) ;
   m_ui.timescroll->setVisible(visible) ;
   }
 
+void ChartForm::on_tracescroll_valueChanged(int position)
+/*-----------------------------------------------------*/
+{
+  m_ui.chart->moveTraceScroll(*m_ui.tracescroll) ;
+  }
+
+void ChartForm::position_tracescroll(bool visible)
+/*----------------------------------------------*/
+{
+  const QSignalBlocker blocker(m_ui.tracescroll) ;
+  m_ui.chart->setTraceScroll(*m_ui.tracescroll) ;
+  m_ui.tracescroll->setVisible(visible) ;
+  }
+
 /**
   def on_timezoom_currentIndexChanged(self, text):
   #-----------------------------------------------
@@ -44,6 +44,8 @@ namespace browser {
      
    public slots:
     void position_timescroll(bool visible) ;
+    void position_tracescroll(bool visible) ;
+    void on_tracescroll_valueChanged(int position) ;
     void chart_resize(int offset, int width, int bottom) ;
 
    private:
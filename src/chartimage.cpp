@@ -0,0 +1,83 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "chartimage.h"
+#include "tiledimage.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QPageSize>
+#include <QPdfWriter>
+#include <QSvgGenerator>
+
+#include <stdexcept>
+
+using namespace browser ;
+
+
+static const int VECTOR_DPI = 96 ;      // Chart pixels per inch in vector output
+
+
+void ChartImage::save(ChartRenderer *chart, const QSize &size, const QString &filename)
+/*===================================================================================*/
+{
+  QString suffix = QFileInfo(filename).suffix().toLower() ;
+  // Vector files are only checked for afterwards, so mustn't already exist
+  if ((suffix == "svg" || suffix == "pdf")
+   && QFileInfo(filename).exists() && !QFile::remove(filename))
+    throw std::runtime_error(QString("Cannot replace %1").arg(filename).toStdString()) ;
+  if (suffix == "svg") {
+    QSvgGenerator svg ;
+    svg.setFileName(filename) ;
+    svg.setSize(size) ;
+    svg.setViewBox(QRect(QPoint(0, 0), size)) ;
+    svg.setResolution(VECTOR_DPI) ;
+    svg.setTitle(QFileInfo(filename).baseName()) ;
+    chart->drawChart(&svg) ;
+    if (!QFileInfo(filename).exists())
+      throw std::runtime_error("Cannot write SVG") ;
+    }
+  else if (suffix == "pdf") {
+    QPdfWriter pdf(filename) ;
+    pdf.setResolution(VECTOR_DPI) ;
+    pdf.setPageSize(QPageSize(QSizeF(size)*72.0/VECTOR_DPI, QPageSize::Point)) ;
+    pdf.setPageMargins(QMarginsF(0, 0, 0, 0)) ;
+    chart->drawChart(&pdf) ;
+    if (!QFileInfo(filename).exists())
+      throw std::runtime_error("Cannot write PDF") ;
+    }
+  else if ((qint64)size.width()*size.height() > TILED_IMAGE_PIXELS) {
+    TiledImage::save(chart, size, filename) ;
+    }
+  else {
+    QImage image(size, QImage::Format_ARGB32_Premultiplied) ;
+    image.fill(Qt::white) ;
+    chart->drawChart(&image) ;
+    if (!image.save(filename, "PNG"))
+      throw std::runtime_error("Cannot write image") ;
+    }
+  }
+
+const char *ChartImage::filter(void)
+/*--------------------------------*/
+{
+  return "PNG image (*.png);;SVG drawing (*.svg);;PDF document (*.pdf)" ;
+  }
@@ -0,0 +1,55 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_CHARTIMAGE_H
+#define BROWSER_CHARTIMAGE_H
+
+#include "chartplot.h"
+
+#include <QSize>
+#include <QString>
+
+
+namespace browser {
+
+  /**
+   * Save a chart as a PNG, SVG or PDF file, chosen by the file's extension.
+   *
+   * Traces are drawn with at most a minimum and maximum point in each
+   * column of the output (see :data:`DECIMATE_PER_COLUMN`), so the size of
+   * a vector file depends on its width rather than on the number of samples.
+   * Vector output is laid out at 96 dots per inch, as on screen. Very large
+   * PNGs are drawn as a :class:`TiledImage`.
+   *
+   * A `std::runtime_error` is thrown if the file can't be written.
+   */
+  class ChartImage
+  /*============*/
+  {
+   public:
+    static void save(ChartRenderer *chart, const QSize &size, const QString &filename) ;
+
+    /** File types for a save dialog. */
+    static const char *filter(void) ;
+    } ;
+
+  } ;
+
+#endif
@@ -21,6 +21,7 @@
 #include "chartplot.h"
 
 #include "annotationdialog.h"
+#include "chartimage.h"
 
 #include <QMenu>
 #include <QDialog>
@@ -28,8 +29,10 @@
 #include <QMessageBox>
 #include <QFileDialog>
 #include <QMessageLogger>
+#include <QNativeGestureEvent>
 
 #include <algorithm>
+#include <exception>
 
 
 using namespace browser ;
@@ -47,7 +50,7 @@ void browser::drawtext(QPainter &painter, float x, float y, const QString &text,
     if (mapX) x = pt.x() ;
     if (mapY) y = pt.y() ;
     }
-  painter.resetTransform() ;
+  painter.setWorldTransform(QTransform()) ;
   QFont font = painter.font() ;
   if (fontSize > 0.0 || fontWeight > 0) {
     QFont newfont(font) ;
@@ -91,7 +94,8 @@ SignalTrace::SignalTrace(const QString &label, const QString &units,
   m_ymin(ymin),
   m_ymax(ymax),
   m_polygon(QPolygonF()),
-  m_path(QPainterPath())
+  m_capacity(0),
+  m_overview(nullptr)
 {
   m_label = (units == "") ? label : QString("%1\n%2").arg(label, units) ;
   m_selected = false ;
@@ -137,7 +141,6 @@ void SignalTrace::appendData(const bsml::data::TimeSeries::Ptr &data, float ymin
     m_ymin = NAN ;
     m_ymax = NAN ;
     m_polygon = QPolygonF() ;
-    m_path = QPainterPath() ;
     return ;
     }
 
@@ -154,11 +157,46 @@ void SignalTrace::appendData(const bsml::data::TimeSeries::Ptr &data, float ymin
     poly.push_back(QPointF(p.time(), p.value())) ;
     }
   //for (auto const &p : data->points()) poly.push_back(QPointF(p.time(), p.value())) ;
-
-  QPainterPath path = QPainterPath() ;
-  path.addPolygon(poly) ;
-  m_path.connectPath(path) ;
   m_polygon += poly ;
+  if (m_capacity > 0 && m_polygon.size() >= 2*m_capacity) {  // Drop the oldest
+    m_polygon.remove(0, m_polygon.size() - m_capacity) ;
+    trimYrange() ;
+    }
+  }
+
+
+void SignalTrace::trimYrange(void)         // Range of only the points kept
+/*------------------------------*/
+{
+  if (m_polygon.isEmpty()) return ;
+  m_ymin = m_polygon.at(0).y() ;
+  m_ymax = m_ymin ;
+  for (auto const &p : m_polygon) {
+    if      (m_ymin > p.y()) m_ymin = p.y() ;
+    else if (m_ymax < p.y()) m_ymax = p.y() ;
+    }
+  setYrange() ;
+  }
+
+
+void SignalTrace::setOverview(const SignalOverview::Ptr &overview)
+/*--------------------------------------------------------------*/
+{
+  m_overview = overview ;
+  }
+
+
+void SignalTrace::setCapacity(int points)
+/*-------------------------------------*/
+{
+  m_capacity = points ;
+  if (m_capacity > 0) {
+    if (m_polygon.size() > m_capacity) {
+      m_polygon.remove(0, m_polygon.size() - m_capacity) ;
+      trimYrange() ;
+      }
+    m_polygon.reserve(2*m_capacity) ;
+    }
   }
 
 
@@ -193,12 +231,78 @@ int SignalTrace::index(float time) const
   }
 
 
+static void draw_visible(QPainter &painter, const QPolygonF &points, float start, float end)
+/*---------------------------------------------------------------------------------------*/
+{
+  // Only draw the points that are on the device, along with one either side,
+  // so the cost of drawing depends on the device's size, as when drawing an
+  // image in tiles, rather than on the number of points. Pictures have no
+  // size until they have been drawn.
+  QTransform xfm = painter.combinedTransform() ;
+  QPaintDevice *device = painter.device() ;
+  qreal left = start ;
+  qreal right = end ;
+  if (device->devType() != QInternal::Picture) {
+    QRectF visible = xfm.inverted().mapRect(QRectF(0, 0, device->width(), device->height())) ;
+    left = std::max(left, visible.left()) ;
+    right = std::min(right, visible.right()) ;
+    }
+  auto before = [](const QPointF &p, qreal x) { return p.x() < x ; } ;
+  auto first = std::lower_bound(points.begin(), points.end(), left, before) ;
+  auto last = std::lower_bound(first, points.end(), right, before) ;
+  if (first != points.begin()) --first ;
+  if (last != points.end()) ++last ;
+  int count = (int)(last - first) ;
+  if (count < 2) return ;
+  int columns = (int)std::ceil(std::abs(xfm.m11())*(right - left)) + 1 ;
+  if (count <= DECIMATE_PER_COLUMN*columns) {
+    painter.drawPolyline(&(*first), count) ;
+    return ;
+    }
+
+  // Reduce to the minimum and maximum in each device column, in the order they
+  // occur, so vector output has a size set by its width and not by the data.
+  QPolygonF reduced ;
+  reduced.reserve(2*columns + 2) ;
+  auto p = first ;
+  while (p != last) {
+    int column = (int)std::floor(xfm.map(*p).x()) ;
+    auto min = p ;
+    auto max = p ;
+    while (++p != last && (int)std::floor(xfm.map(*p).x()) == column) {
+      if (p->y() < min->y()) min = p ;
+      if (p->y() > max->y()) max = p ;
+      }
+    if (min == max) reduced.append(*min) ;
+    else if (min < max) reduced << *min << *max ;
+    else reduced << *max << *min ;
+    }
+  painter.drawPolyline(reduced) ;
+  }
+
 void SignalTrace::drawTrace(QPainter &painter, float start, float end, int labelfreq,
 /*---------------------------------------------------------------------------------*/
                             const QVector<float> &markers)
 {
+  // Appended data may not span the window while zooming, in which
+  // case we draw what the overview has until the window is reloaded.
+  bool covered = false ;
+  if (m_polygon.size() > 1) {
+    float spacing = (m_polygon.last().x() - m_polygon.first().x())/(m_polygon.size() - 1) ;
+    covered = (m_polygon.first().x() <= (start + spacing)
+            && m_polygon.last().x() >= (end - spacing)) ;
+    }
+  QPolygonF envelope ;
+  if (!covered && m_overview != nullptr) {
+    int pixels = (int)(std::abs(painter.transform().m11())*(end - start)) ;
+    auto data = m_overview->envelope(start, end, pixels) ;
+    for (auto n = 0 ;  n < data->size() ;  ++n) {
+      auto p = data->point(n) ;
+      envelope.push_back(QPointF(p.time(), p.value())) ;
+      }
+    }
 
-  if (m_path.isEmpty()) return ;
+  if (m_polygon.isEmpty() && envelope.isEmpty()) return ;
   painter.scale(1.0, 1.0/(m_range_ymax - m_range_ymin)) ;
   painter.translate(0.0, -m_range_ymin) ;
   // draw and label y-gridlines.
@@ -219,12 +323,12 @@ void SignalTrace::drawTrace(QPainter &painter, float start, float end, int label
     if (-1e-10 < y && y < 1e-10) y = 0.0 ; // #####
     n += 1 ;
     }
-  painter.setClipping(true) ;
+  painter.save() ;
+  painter.setClipRect(QRectF(start, m_range_ymin, end - start, m_range_ymax - m_range_ymin),
+                      Qt::IntersectClip) ;
   painter.setPen(QPen(!m_selected ? traceColour : selectedColour, 0)) ;
-  // Could find start/end indices and only draw segment
-  // rather than rely on clipping...
-  painter.drawPath(m_path) ;
-  painter.setClipping(false) ;
+  draw_visible(painter, envelope.isEmpty() ? m_polygon : envelope, start, end) ;
+  painter.restore() ;
   if (markers.size() > 0) {
     QTransform xfm = painter.transform() ;
     int n = 0 ;
@@ -302,7 +406,8 @@ void EventTrace::drawTrace(QPainter &painter, float start, float end,
                            int labelfreq, const QVector<float> &markers)
 {
   if (m_events.size() == 0) return ;
-  painter.setClipping(true) ;
+  painter.save() ;
+  painter.setClipRect(QRectF(start, 0.0, end - start, 1.0), Qt::IntersectClip) ;
   m_eventpos = QList<EventPosInfo>() ;
   for (auto const &e : m_events) {
     if (e.second != "") {
@@ -316,7 +421,7 @@ void EventTrace::drawTrace(QPainter &painter, float start, float end,
       m_eventpos.append(EventPosInfo(floor(xy.x()+0.5), floor(xy.y()+0.5), text)) ;
       }
     }
-  painter.setClipping(false) ;
+  painter.restore() ;
   }
 
 
@@ -325,59 +430,52 @@ void EventTrace::drawTrace(QPainter &painter, float start, float end,
   and all sharing the same X-axis (time axis).
 
 */
-ChartPlot::ChartPlot(QWidget *parent)
-/*---------------------------------*/
-: QWidget(parent),
-  m_id(""), m_plotwidth(0), m_plotheight(0),
-  m_timezoom(1.0), m_mousebutton(Qt::NoButton)
+ChartRenderer::ChartRenderer()
+/*--------------------------*/
+: m_id(""), m_timezoom(1.0),
+  m_plotwidth(0), m_plotheight(0),
+  m_traceoffset(0)
 {
-  setPalette(QPalette(QColor("black"), QColor("white"))) ;
-  setMouseTracking(true) ;
-
   m_traces = QMap<QString, int>() ;
   m_tracelist = TraceList() ;
 
   m_markers = QList<PosnTime>() ;
-  m_marker = -1 ;
 
   m_selectstart = PosnTime(0, NAN) ;
   m_selectend = PosnTime(0, NAN) ;
-  m_selectmove = 0 ;
-  m_selecting = false ;
-  
+
   m_annotations = AnnotationDict() ;
   m_annrects = AnnRectList() ;
   m_semantictags = StringDictionary() ;
   }
 
-void ChartPlot::setId(const QString &id)
-/*------------------------------------*/
+void ChartRenderer::setId(const QString &id)
+/*----------------------------------------*/
 {
   m_id = id ;
   }
 
-void ChartPlot::setSemanticTags(const StringDictionary &tags)
-/*----------------------------------------------------------*/
+void ChartRenderer::setSemanticTags(const StringDictionary &tags)
+/*-------------------------------------------------------------*/
 {
   m_semantictags = tags ;
   }
 
-const StringDictionary &ChartPlot::semanticTags(void) const
-/*--------------------------------------------------------*/
+const StringDictionary &ChartRenderer::semanticTags(void) const
+/*-----------------------------------------------------------*/
 {
   return m_semantictags ;
   }
 
-void ChartPlot::addTrace(const QString &id, bool visible, const std::shared_ptr<Trace> &trace)
-/*------------------------------------------------------------------------------------------*/
+void ChartRenderer::addTrace(const QString &id, bool visible, const std::shared_ptr<Trace> &trace)
+/*----------------------------------------------------------------------------------------------*/
 {
   m_traces[id] = m_tracelist.size() ;
   m_tracelist.append(TraceInfo(id, visible, trace)) ;
-  update() ;
   }
 
-void ChartPlot::addSignalTrace(const QString &id, const QString &label, const QString &units,
-/*-----------------------------------------------------------------------------------------*/
+void ChartRenderer::addSignalTrace(const QString &id, const QString &label, const QString &units,
+/*---------------------------------------------------------------------------------------------*/
                                bool visible)
 //TODO                               const bsml::data::TimeSeries::Ptr &data,
 //TODO                               float ymin, float ymax)
@@ -385,44 +483,67 @@ void ChartPlot::addSignalTrace(const QString &id, const QString &label, const QS
   addTrace(id, visible, std::make_shared<SignalTrace>(label, units)) ;//TODO, data, ymin, ymax)) ;
   }
 
-void ChartPlot::addEventTrace(const QString &id, const QString &label, bool visible)
-/*--------------------------------------------------------------------------------*/
+void ChartRenderer::addEventTrace(const QString &id, const QString &label, bool visible)
+/*------------------------------------------------------------------------------------*/
 //TODO                              const EventMap &mapping,
 //TODO                              const bsml::data::TimeSeries::Ptr &data)
 {
   addTrace(id, visible, std::make_shared<EventTrace>(label)) ;//TODO, mapping, data)) ;
   }
 
-void ChartPlot::appendData(const QString &id, const bsml::data::TimeSeries::Ptr &data)
-/*----------------------------------------------------------------------------------*/
+void ChartRenderer::appendData(const QString &id, const bsml::data::TimeSeries::Ptr &data)
+/*--------------------------------------------------------------------------------------*/
+{
+  int n = m_traces.value(id, -1) ;
+  if (n >= 0) std::get<2>(m_tracelist[n])->appendData(data) ;
+  }
+
+void ChartRenderer::setTraceVisible(const QString &id, bool visible)
+/*----------------------------------------------------------------*/
+{
+  int n = m_traces.value(id, -1) ;
+  if (n >= 0) std::get<1>(m_tracelist[n]) = visible ;
+  }
+
+void ChartRenderer::setTracesVisible(const QStringList &ids, bool visible)
+/*----------------------------------------------------------------------*/
+{
+  for (auto const &id : ids) {
+    int n = m_traces.value(id, -1) ;
+    if (n >= 0) std::get<1>(m_tracelist[n]) = visible ;
+    }
+  }
+
+void ChartRenderer::setTraceOverview(const QString &id, const SignalOverview::Ptr &overview)
+/*----------------------------------------------------------------------------------------*/
 {
   int n = m_traces.value(id, -1) ;
   if (n >= 0) {
-    std::get<2>(m_tracelist[n])->appendData(data) ;
-    update() ;
+    auto trace = std::dynamic_pointer_cast<SignalTrace>(std::get<2>(m_tracelist[n])) ;
+    if (trace) trace->setOverview(overview) ;
     }
   }
 
-void ChartPlot::setTraceVisible(const QString &id, bool visible)
-/*------------------------------------------------------------*/
+void ChartRenderer::setTraceCapacity(const QString &id, int points)
+/*---------------------------------------------------------------*/
 {
   int n = m_traces.value(id, -1) ;
   if (n >= 0) {
-    std::get<1>(m_tracelist[n]) = visible ;
-    update() ;
+    auto trace = std::dynamic_pointer_cast<SignalTrace>(std::get<2>(m_tracelist[n])) ;
+    if (trace) trace->setCapacity(points) ;
     }
   }
 
-QStringList ChartPlot::traceOrder(void)
-/*-----------------------------------*/
+QStringList ChartRenderer::traceOrder(void)
+/*---------------------------------------*/
 {
   QStringList traces ;
   for (auto const &p : m_tracelist) traces.append(std::get<0>(p)) ;
   return traces ;
   }
 
-void ChartPlot::orderTraces(const QStringList &ids)
-/*-----------------------------------------------*/
+void ChartRenderer::orderTraces(const QStringList &ids)
+/*---------------------------------------------------*/
 {
   QList<int> order ;
   TraceList traces ;
@@ -441,11 +562,10 @@ void ChartPlot::orderTraces(const QStringList &ids)
     m_traces[std::get<0>(traces[i])] = n ;
     i += 1 ;
     }
-  update() ;
   }
 
-void ChartPlot::moveTrace(const QString &from, const QString &to)
-/*-------------------------------------------------------------*/
+void ChartRenderer::moveTrace(const QString &from, const QString &to)
+/*-----------------------------------------------------------------*/
 {
   int n = m_traces.value(from, -1) ;
   int m = m_traces.value(to, -1) ;
@@ -460,74 +580,53 @@ void ChartPlot::moveTrace(const QString &from, const QString &to)
         m_traces[std::get<0>(m_tracelist[i])] = i ;
       }
     }
-  update() ;
   }
 
-void ChartPlot::plotSelected(const int &row)
-/*----------------------------------------*/
+void ChartRenderer::plotSelected(const int &row)
+/*--------------------------------------------*/
 {
   int n = 0 ;
   for (auto const &p : m_tracelist) {
     std::get<2>(p)->select((n == row)) ;
     n += 1 ;
     }
-  update() ;
   }
 
-void ChartPlot::resetAnnotations(void)
-/*----------------------------------*/
+void ChartRenderer::resetAnnotations(void)
+/*--------------------------------------*/
 {
   m_annotations = AnnotationDict() ;
   m_annrects = AnnRectList() ;
+  m_annids.clear() ;
   }
 
-void ChartPlot::addAnnotation(const QString &id, float start, float end, const QString &text,
-/*-----------------------------------------------------------------------------------------*/
+void ChartRenderer::addAnnotation(const QString &id, float start, float end, const QString &text,
+/*---------------------------------------------------------------------------------------------*/
                               const QStringList &tags, bool edit)
 {
   if (isnan(end)) end = start ;
-  if (end > m_segmentstart && start < m_segmentend) {
-    m_annotations[id] = std::make_tuple(start, end, text, tags, edit) ;
-    }
-  }
-
-void ChartPlot::deleteAnnotation(const QString &id)
-/*-----------------------------------------------*/
-{
-  m_annotations.remove(id) ;
-  update() ;
-  }
-
-void ChartPlot::resizeEvent(QResizeEvent *e)
-/*----------------------------------------*/
-{
-  emit chartPosition(pos().x() + MARGIN_LEFT,
-                     width() - (MARGIN_LEFT + MARGIN_RIGHT),
-                     pos().y() + height()) ;
+  if (end > m_segmentstart && start < m_segmentend)
+    m_annotations[m_annids.id(id)] = std::make_tuple(start, end, text, tags, edit) ;
   }
 
-
-//QSize ChartPlot::sizeHint(void) const
-//{
-//    return QSize(640, 480);
-//}
-
-
-void ChartPlot::paintEvent(QPaintEvent *e)
-/*--------------------------------------*/
+void ChartRenderer::deleteAnnotation(const QString &id)
+/*---------------------------------------------------*/
 {
-  draw_window(this) ;
+  m_annotations.remove(m_annids.find(id)) ;
   }
 
-void ChartPlot::draw_window(QPaintDevice *device)
-/*---------------------------------------------*/
+void ChartRenderer::draw_window(QPaintDevice *device, const QSize &size, const QPoint &offset)
+/*------------------------------------------------------------------------------------------*/
 {
   QPainter qp ;
   qp.begin(device) ;
   qp.setRenderHint(QPainter::Antialiasing) ;
 
-  int w = device->width() ;
-  int h = device->height() ;
+  int w = size.isValid() ? size.width()  : device->width() ;
+  int h = size.isValid() ? size.height() : device->height() ;
+  // The device shows the part of the chart at offset, with the world
+  // transform, and text drawn without it, in chart co-ordinates.
+  if (!offset.isNull()) qp.setWindow(offset.x(), offset.y(), device->width(), device->height()) ;
   m_plotwidth  = w - (MARGIN_LEFT + MARGIN_RIGHT) ;
   m_plotheight = h - (MARGIN_TOP + MARGIN_BOTTOM) ;
 
@@ -563,43 +662,38 @@ void ChartPlot::draw_window(QPaintDevice *device)
   showTimeMarkers(qp) ;       // Position markers
   draw_time_grid(qp) ;
 
-  // Draw each each visible trace
-  int gridheight = 0 ;
-  QList<std::shared_ptr<Trace>> traces ;
-  for (auto const &p : m_tracelist) {
-    if (std::get<1>(p)) {
-      auto trace = std::get<2>(p) ;
-      gridheight += trace->gridheight() ;
-      traces.append(trace) ;
-      }
-    }
-
-  int labelfreq ;
-  if (m_plotheight == 0) labelfreq = 0 ;
-  else                   labelfreq = (int)(10.0/(float)m_plotheight/(float)(gridheight + 1)) + 1 ;
-
-  float traceposition = gridheight ;
-  for (auto const &tp : traces) {
+  // Draw each visible trace that is in the viewport, for the device's
+  // height. Traces only partly in view, and their labels, are clipped
+  // to the plotting region's rows.
+  QList<TraceLayout> layout ;
+  int traceoffset = m_traceoffset ;
+  layout_traces(m_plotheight, traceoffset, layout) ;
+  QTransform timexfm = qp.transform() ;
+  qp.setWorldTransform(QTransform()) ;
+  qp.setClipRect(0, MARGIN_TOP, w, m_plotheight) ;
+  qp.setTransform(timexfm) ;
+
+  QVector<float> markers(m_markers.size()) ;
+  for (auto const &m : m_markers) markers.append(m.second) ;
+  for (auto const &l : layout) {
     qp.save() ;
-    float traceheight = tp->gridheight() ;
-    qp.scale(1.0, traceheight/(float)gridheight) ;
-    traceposition -= traceheight ;
-    qp.translate(0.0, traceposition/traceheight) ;
-    QVector<float> markers(m_markers.size()) ;
-    for (auto const &m : m_markers) markers.append(m.second) ;
-    tp->drawTrace(qp, m_windowstart, m_windowend, labelfreq, markers) ;
+    float traceheight = std::get<3>(l)/(float)m_plotheight ;
+    qp.translate(0.0, 1.0 - std::get<2>(l)/(float)m_plotheight - traceheight) ;
+    qp.scale(1.0, traceheight) ;
+    int gridheight = std::get<1>(l)->gridheight() ;   // Keep labels 10 pixels apart
+    int labelfreq = (std::get<3>(l) > 0.0) ? (int)(10.0*gridheight/std::get<3>(l)) + 1 : 0 ;
+    std::get<1>(l)->drawTrace(qp, m_windowstart, m_windowend, labelfreq, markers) ;
     qp.restore() ;
     }
 
   // Event labels have now been assigned (by drawTrace() above) so now show them
   qp.setTransform(labelxfm) ;
-  traceposition = gridheight ;
-  for (auto const &tp : traces) {
+  for (auto const &l : layout) {
+    auto const &tp = std::get<1>(l) ;
     qp.save() ;
-    float traceheight = tp->gridheight() ;
-    qp.scale(1.0, traceheight/(float)gridheight) ;
-    traceposition -= traceheight ;
-    qp.translate(0.0, traceposition/traceheight) ;
+    float traceheight = std::get<3>(l)/(float)m_plotheight ;
+    qp.translate(0.0, 1.0 - std::get<2>(l)/(float)m_plotheight - traceheight) ;
+    qp.scale(1.0, traceheight) ;
     qp.setPen(QPen(textColour, 0)) ;
     drawtext(qp, (MARGIN_LEFT-40)/2, 0.5, tp->label(), false) ;
     int n = 0 ;
@@ -613,12 +707,79 @@ void ChartPlot::draw_window(QPaintDevice *device)
       }
     qp.restore() ;
     }
+  qp.setClipping(false) ;
+
+  if (m_message != "") {
+    qp.setWorldTransform(QTransform()) ;
+    qp.setPen(QPen(textColour, 0)) ;
+    drawtext(qp, MARGIN_LEFT + m_plotwidth/2.0, MARGIN_TOP + m_plotheight/2.0, m_message,
+             false, false, alignCentred, 16) ;
+    }
 
   qp.end() ;                     // Done all drawing
   }
 
-void ChartPlot::showSelectionRegion(QPainter &painter)
-/*--------------------------------------------------*/
+float ChartRenderer::layout_traces(int plotheight, int &traceoffset, QList<TraceLayout> &layout) const
+/*--------------------------------------------------------------------------------------------------*/
+{
+  // Share the plot's height between visible traces in proportion to
+  // their grid heights, but with no trace less than MIN_TRACE_HEIGHT.
+  int gridheight = 0 ;
+  for (auto const &p : m_tracelist)
+    if (std::get<1>(p)) gridheight += std::get<2>(p)->gridheight() ;
+  float scale = (gridheight > 0) ? plotheight/(float)gridheight : 0.0 ;
+  float height = 0.0 ;
+  for (auto const &p : m_tracelist)
+    if (std::get<1>(p)) height += std::max(scale*std::get<2>(p)->gridheight(), (float)MIN_TRACE_HEIGHT) ;
+  traceoffset = std::max(0, std::min(traceoffset, (int)height - plotheight)) ;
+
+  // Only traces intersecting the viewport are laid out
+  layout.clear() ;
+  float top = -traceoffset ;
+  for (auto const &p : m_tracelist) {
+    if (std::get<1>(p)) {
+      auto trace = std::get<2>(p) ;
+      float h = std::max(scale*trace->gridheight(), (float)MIN_TRACE_HEIGHT) ;
+      if ((top + h) > 0.0 && top < plotheight)
+        layout.append(TraceLayout(std::get<0>(p), trace, top, h)) ;
+      top += h ;
+      }
+    }
+  return height ;
+  }
+
+void ChartRenderer::drawChart(QPaintDevice *device)
+/*-----------------------------------------------*/
+{
+  draw_window(device) ;
+  }
+
+void ChartRenderer::drawTile(QPaintDevice *device, const QSize &size, const QPoint &offset)
+/*---------------------------------------------------------------------------------------*/
+{
+  draw_window(device, size, offset) ;
+  }
+
+void ChartRenderer::clearTraces(void)
+/*---------------------------------*/
+{
+  m_traces.clear() ;
+  m_tracelist.clear() ;
+  m_traceoffset = 0 ;
+  }
+
+QStringList ChartRenderer::visibleTraces(void) const
+/*------------------------------------------------*/
+{
+  QStringList ids ;
+  for (auto const &t : m_tracelist) {
+    if (std::get<1>(t)) ids.append(std::get<0>(t)) ;
+    }
+  return ids ;
+  }
+
+void ChartRenderer::showSelectionRegion(QPainter &painter)
+/*------------------------------------------------------*/
 {
   if (m_selectstart.second != m_selectend.second) {
     float duration = (m_selectend.second - m_selectstart.second) ;
@@ -631,8 +792,8 @@ void ChartPlot::showSelectionRegion(QPainter &painter)
     }
   }
 
-void ChartPlot::showSelectionTimes(QPainter &painter)
-/*-------------------------------------------------*/
+void ChartRenderer::showSelectionTimes(QPainter &painter)
+/*-----------------------------------------------------*/
 {
   if (m_selectstart.second != m_selectend.second) {
     float duration = (m_selectend.second - m_selectstart.second) ;
@@ -647,11 +808,11 @@ void ChartPlot::showSelectionTimes(QPainter &painter)
     }
   }
 
-void ChartPlot::draw_time_grid(QPainter &painter)
-/*---------------------------------------------*/
+void ChartRenderer::draw_time_grid(QPainter &painter)
+/*-------------------------------------------------*/
 {
   QTransform xfm = painter.transform() ;
-  painter.resetTransform() ;
+  painter.setWorldTransform(QTransform()) ;
   int ypos = MARGIN_TOP + m_plotheight ;
   painter.setPen(QPen(gridMinorColour, 0)) ;
   float t = m_timerange.start() ;
@@ -676,19 +837,19 @@ void ChartPlot::draw_time_grid(QPainter &painter)
   painter.setTransform(xfm) ;
   }
 
-void ChartPlot::setTimeGrid(float start, float end)
-/*-----------------------------------------------*/
+void ChartRenderer::setTimeGrid(float start, float end)
+/*---------------------------------------------------*/
 {
   m_timerange = NumericRange(start, end) ;
   m_windowstart = start ;
   m_windowend = end ;
   }
 
-void ChartPlot::showTimeMarkers(QPainter &painter)
-/*----------------------------------------------*/
+void ChartRenderer::showTimeMarkers(QPainter &painter)
+/*--------------------------------------------------*/
 {
   QTransform xfm = painter.transform() ;
-  painter.resetTransform() ;
+  painter.setWorldTransform(QTransform()) ;
 
   int n = 0 ;
   PosnTime last(0, 0.0) ;
@@ -710,11 +871,11 @@ void ChartPlot::showTimeMarkers(QPainter &painter)
   painter.setTransform(xfm) ;
   }
 
-void ChartPlot::showAnnotations(QPainter &painter)
-/*----------------------------------------------*/
+void ChartRenderer::showAnnotations(QPainter &painter)
+/*--------------------------------------------------*/
 {
   QTransform xfm = painter.transform() ;
-  painter.resetTransform() ;
+  painter.setWorldTransform(QTransform()) ;
   int right_side = MARGIN_LEFT + m_plotwidth ;
   int line_space = ANN_LINE_WIDTH + ANN_LINE_GAP ;
   // Sort (into time order), start from top, and not
@@ -726,10 +887,10 @@ void ChartPlot::showAnnotations(QPainter &painter)
   int nextcolour = 0 ;
   QHash<QString, int> colourdict ;  // key by text, to use the same colour for the same text
 
-  typedef QPair<AnnInfo, QString> AnnSort ;
+  typedef QPair<AnnInfo, int> AnnSort ;
   QList<AnnSort> sorted ;
-  for (auto const &id : m_annotations.keys())
-    sorted.append(QPair<AnnInfo, QString>(m_annotations[id], id)) ;
+  for (auto ann = m_annotations.cbegin() ;  ann != m_annotations.cend() ;  ++ann)
+    sorted.append(AnnSort(ann.value(), ann.key())) ;
   auto compare = [] (const AnnSort &s1, const AnnSort &s2)
     { return std::get<0>(s1.first) < std::get<0>(s2.first)
          || (std::get<0>(s1.first) == std::get<0>(s2.first)
@@ -739,7 +900,7 @@ void ChartPlot::showAnnotations(QPainter &painter)
 
   for (auto const &annid : sorted) {
     AnnInfo ann = annid.first ;
-    QString id = annid.second ;
+    int id = annid.second ;
     QList<int> colours ;  colours << -1 << -1 << -1 ;   // Left, above, below
     int row = -1 ;
 
@@ -800,14 +961,14 @@ void ChartPlot::showAnnotations(QPainter &painter)
       // pen.setWidth(ANN_LINE_WIDTH)
       // painter.setPen(pen)
       painter.fillRect(rect, colour) ;
-      m_annrects.append(QPair<QRect, QString>(rect, id)) ;
+      m_annrects.append(QPair<QRect, int>(rect, id)) ;
       }
     }
   painter.setTransform(xfm) ;
   }
 
-float ChartPlot::pos_to_time(int pos)
-/*---------------------------------*/
+float ChartRenderer::pos_to_time(int pos)
+/*-------------------------------------*/
 {
   float time = m_windowstart + m_windowduration*(pos - MARGIN_LEFT)/(float)m_plotwidth ;
   if (time < m_windowstart) time = m_windowstart ;
@@ -815,14 +976,14 @@ float ChartPlot::pos_to_time(int pos)
   return m_timerange.map(time) ;
   }
 
-int ChartPlot::time_to_pos(float time)
-/*----------------------------------*/
+int ChartRenderer::time_to_pos(float time)
+/*--------------------------------------*/
 {
   return MARGIN_LEFT + (time - m_windowstart)*m_plotwidth/m_windowduration ;
   }
 
-void ChartPlot::setTimeRange(float start, float duration)
-/*-----------------------------------------------------*/
+void ChartRenderer::setTimeRange(float start, float duration)
+/*---------------------------------------------------------*/
 {
   m_segmentstart = m_windowstart = start ;
   m_segmentend = m_windowend = start + duration ;
@@ -831,8 +992,8 @@ void ChartPlot::setTimeRange(float start, float duration)
   m_markers = QList<PosnTime>{PosnTime(0, m_windowstart), PosnTime(0, m_windowstart)} ; // Two markers
   }
 
-void ChartPlot::setTimeZoom(float scale)
-/*------------------------------------*/
+void ChartRenderer::setTimeZoom(float scale)
+/*----------------------------------------*/
 {
   m_timezoom = scale ;
   m_windowduration = m_duration/scale ;
@@ -850,6 +1011,247 @@ void ChartPlot::setTimeZoom(float scale)
     }
   setTimeGrid(newstart, newend) ;
   //for m in self._markers: m[0] = self._time_to_pos(m[1])
+  }
+
+void ChartRenderer::setMessage(const QString &message)
+/*--------------------------------------------------*/
+{
+  m_message = message ;
+  }
+
+QString ChartRenderer::annotation_display_text(const AnnInfo &ann)
+/*--------------------------------------------------------------*/
+{
+  QStringList text ;
+  if (std::get<2>(ann) != "")
+    text.append("<p>" + std::get<2>(ann) + "</p>") ;
+  if (std::get<3>(ann).size() > 0) {
+    QStringList tags ;
+    for (auto const &t : std::get<3>(ann))
+      tags.append(m_semantictags.value(t, t)) ;
+    text.append("<p>Tags: " + tags.join(", ") + "</p>") ;
+    }
+  return text.join("") ;
+  }
+
+
+ChartPlot::ChartPlot(QWidget *parent)
+/*---------------------------------*/
+: QWidget(parent),
+  ChartRenderer(),
+  m_layoutheight(0.0),
+  m_mousebutton(Qt::NoButton), m_refinetimer(0)
+{
+  setPalette(QPalette(QColor("black"), QColor("white"))) ;
+  setMouseTracking(true) ;
+
+  m_marker = -1 ;
+  m_selectmove = 0 ;
+  m_selecting = false ;
+  }
+
+void ChartPlot::addSignalTrace(const QString &id, const QString &label, const QString &units,
+/*-----------------------------------------------------------------------------------------*/
+                               bool visible)
+{
+  ChartRenderer::addSignalTrace(id, label, units, visible) ;
+  update_layout() ;
+  update() ;
+  }
+
+void ChartPlot::addEventTrace(const QString &id, const QString &label, bool visible)
+/*--------------------------------------------------------------------------------*/
+{
+  ChartRenderer::addEventTrace(id, label, visible) ;
+  update_layout() ;
+  update() ;
+  }
+
+void ChartPlot::appendData(const QString &id, const bsml::data::TimeSeries::Ptr &data)
+/*----------------------------------------------------------------------------------*/
+{
+  ChartRenderer::appendData(id, data) ;
+  update_layout() ;        // A trace's grid may have grown
+  update() ;
+  }
+
+void ChartPlot::setTraceVisible(const QString &id, bool visible)
+/*------------------------------------------------------------*/
+{
+  ChartRenderer::setTraceVisible(id, visible) ;
+  update_layout() ;
+  update() ;
+  }
+
+void ChartPlot::setTracesVisible(const QStringList &ids, bool visible)
+/*------------------------------------------------------------------*/
+{
+  ChartRenderer::setTracesVisible(ids, visible) ;
+  update_layout() ;
+  update() ;
+  }
+
+void ChartPlot::setTraceOverview(const QString &id, const SignalOverview::Ptr &overview)
+/*------------------------------------------------------------------------------------*/
+{
+  ChartRenderer::setTraceOverview(id, overview) ;
+  }
+
+void ChartPlot::setTraceCapacity(const QString &id, int points)
+/*-----------------------------------------------------------*/
+{
+  ChartRenderer::setTraceCapacity(id, points) ;
+  }
+
+void ChartPlot::orderTraces(const QStringList &ids)
+/*-----------------------------------------------*/
+{
+  ChartRenderer::orderTraces(ids) ;
+  update_layout() ;
+  update() ;
+  }
+
+void ChartPlot::moveTrace(const QString &from, const QString &to)
+/*-------------------------------------------------------------*/
+{
+  ChartRenderer::moveTrace(from, to) ;
+  update_layout() ;
+  update() ;
+  }
+
+void ChartPlot::plotSelected(const int &row)
+/*----------------------------------------*/
+{
+  ChartRenderer::plotSelected(row) ;
+  update() ;
+  }
+
+void ChartPlot::resetAnnotations(void)
+/*----------------------------------*/
+{
+  ChartRenderer::resetAnnotations() ;
+  update() ;
+  }
+
+void ChartPlot::addAnnotation(const QString &id, float start, float end, const QString &text,
+/*-----------------------------------------------------------------------------------------*/
+                              const QStringList &tags, bool edit)
+{
+  ChartRenderer::addAnnotation(id, start, end, text, tags, edit) ;
+  update() ;
+  }
+
+void ChartPlot::deleteAnnotation(const QString &id)
+/*-----------------------------------------------*/
+{
+  ChartRenderer::deleteAnnotation(id) ;
+  update() ;
+  }
+
+void ChartPlot::clearTraces(void)
+/*-----------------------------*/
+{
+  ChartRenderer::clearTraces() ;
+  m_layout.clear() ;
+  m_inview.clear() ;
+  m_layoutheight = 0.0 ;
+  update() ;
+  }
+
+void ChartPlot::setTimeRange(float start, float duration)
+/*-----------------------------------------------------*/
+{
+  ChartRenderer::setTimeRange(start, duration) ;
+  update() ;
+  }
+
+void ChartPlot::setTimeZoom(float scale)
+/*------------------------------------*/
+{
+  ChartRenderer::setTimeZoom(scale) ;
+  update() ;
+  }
+
+void ChartPlot::setMessage(const QString &message)
+/*----------------------------------------------*/
+{
+  ChartRenderer::setMessage(message) ;
+  update() ;
+  }
+
+void ChartPlot::resizeEvent(QResizeEvent *e)
+/*----------------------------------------*/
+{
+  emit chartPosition(pos().x() + MARGIN_LEFT,
+                     width() - (MARGIN_LEFT + MARGIN_RIGHT),
+                     pos().y() + height()) ;
+  update_layout() ;
+  }
+
+
+//QSize ChartPlot::sizeHint(void) const
+//{
+//    return QSize(640, 480);
+//}
+
+
+void ChartPlot::paintEvent(QPaintEvent *e)
+/*--------------------------------------*/
+{
+  draw_window(this) ;
+  }
+
+void ChartPlot::update_layout(void)
+/*-------------------------------*/
+{
+  m_plotwidth  = std::max(width() - (MARGIN_LEFT + MARGIN_RIGHT), 0) ;
+  m_plotheight = std::max(height() - (MARGIN_TOP + MARGIN_BOTTOM), 0) ;
+  float height = layout_traces(m_plotheight, m_traceoffset, m_layout) ;
+  if (height != m_layoutheight) {
+    bool scrolling = ((int)height > m_plotheight) || ((int)m_layoutheight > m_plotheight) ;
+    m_layoutheight = height ;
+    if (scrolling) emit updateTraceScroll((int)height > m_plotheight) ;
+    }
+
+  // Traces that have left the viewport release their data, and
+  // those that have come into view are asked for theirs.
+  QSet<QString> inview ;
+  for (auto const &l : m_layout) inview.insert(std::get<0>(l)) ;
+  if (inview != m_inview) {
+    QStringList exposed ;
+    for (auto const &p : m_tracelist) {
+      const QString &id = std::get<0>(p) ;
+      if      (inview.contains(id) && !m_inview.contains(id)) exposed.append(id) ;
+      else if (!inview.contains(id) && m_inview.contains(id)) std::get<2>(p)->appendData(nullptr) ;
+      }
+    m_inview = inview ;
+    if (exposed.size() > 0) emit tracesExposed(exposed) ;
+    }
+  }
+
+QStringList ChartPlot::tracesInView(void) const
+/*-------------------------------------------*/
+{
+  QStringList ids ;
+  for (auto const &l : m_layout) ids.append(std::get<0>(l)) ;
+  return ids ;
+  }
+
+void ChartPlot::setTraceScroll(QScrollBar &scrollbar)
+/*-------------------------------------------------*/
+{
+  scrollbar.setMinimum(0) ;
+  scrollbar.setPageStep(m_plotheight) ;
+  scrollbar.setSingleStep(MIN_TRACE_HEIGHT) ;
+  scrollbar.setMaximum(std::max(0, (int)m_layoutheight - m_plotheight)) ;
+  scrollbar.setValue(m_traceoffset) ;
+  }
+
+void ChartPlot::moveTraceScroll(QScrollBar &scrollbar)
+/*--------------------------------------------------*/
+{
+  m_traceoffset = scrollbar.value() ;
+  update_layout() ;
   update() ;
   }
 
@@ -872,9 +1274,84 @@ void ChartPlot::moveTimeScroll(QScrollBar &scrollbar)
   //    for m in self._markers:                       ## But markers need to scroll...
   //      if m[1] < self._start: m[1] = self._start
   //      if m[1] > self._end: m[1] = self._end
+  if (m_timezoom > 1.0) start_refinetimer() ;
+  update() ;
+  }
+
+int ChartPlot::plotWidth(void) const
+/*--------------------------------*/
+{
+  return std::max(width() - (MARGIN_LEFT + MARGIN_RIGHT), 1) ;
+  }
+
+void ChartPlot::zoomAt(int xpos, float factor)
+/*------------------------------------------*/
+{
+  if (m_plotwidth <= 0 || factor <= 0.0) return ;
+  float scale = std::min(std::max(m_timezoom*factor, 1.0f), MAX_TIMEZOOM) ;
+  if (scale == m_timezoom) return ;
+
+  float anchor = m_windowstart + m_windowduration*(xpos - MARGIN_LEFT)/(float)m_plotwidth ;
+  if (anchor < m_windowstart) anchor = m_windowstart ;
+  if (anchor > m_windowend) anchor = m_windowend ;
+  float duration = m_duration/scale ;
+  float start = anchor - (anchor - m_windowstart)*duration/m_windowduration ;
+  if (start < m_segmentstart) start = m_segmentstart ;
+  else if ((start + duration) > m_segmentend) start = m_segmentend - duration ;
+
+  m_timezoom = scale ;
+  m_windowduration = duration ;
+  setTimeGrid(start, start + duration) ;
+  emit updateTimeScroll(m_timezoom > 1.0) ;
+  start_refinetimer() ;      // Drawn from what's cached, reload once zooming stops
   update() ;
   }
 
+void ChartPlot::start_refinetimer(void)
+/*-----------------------------------*/
+{
+  if (m_refinetimer) killTimer(m_refinetimer) ;
+  m_refinetimer = startTimer(REFINE_DELAY) ;
+  }
+
+void ChartPlot::timerEvent(QTimerEvent *event)
+/*------------------------------------------*/
+{
+  if (m_refinetimer && event->timerId() == m_refinetimer) {
+    killTimer(m_refinetimer) ;
+    m_refinetimer = 0 ;
+    emit windowChanged(m_windowstart, m_windowduration) ;
+    }
+  }
+
+void ChartPlot::wheelEvent(QWheelEvent *event)
+/*------------------------------------------*/
+{
+  QPoint delta = event->angleDelta() ;            // Eighths of a degree, 15 degrees a notch
+  float steps = ((delta.y() != 0) ? delta.y() : delta.x())/120.0 ;  // Shift may swap axes
+  if (event->modifiers() & Qt::ShiftModifier) {    // Scroll traces
+    m_traceoffset -= (int)(steps*MIN_TRACE_HEIGHT) ;
+    update_layout() ;
+    emit updateTraceScroll((int)m_layoutheight > m_plotheight) ;
+    update() ;
+    }
+  else if (steps != 0.0) zoomAt((int)event->position().x(), std::pow(WHEEL_ZOOM, steps)) ;
+  event->accept() ;
+  }
+
+bool ChartPlot::event(QEvent *event)
+/*--------------------------------*/
+{
+  if (event->type() == QEvent::NativeGesture) {    // Trackpad pinch
+    auto gesture = static_cast<QNativeGestureEvent *>(event) ;
+    if (gesture->gestureType() == Qt::ZoomNativeGesture) {
+      zoomAt(gesture->localPos().x(), 1.0 + gesture->value()) ;
+      return true ;
+      }
+    }
+  return QWidget::event(event) ;
+  }
+
 void ChartPlot::setMarker(float time)
 /*---------------------------------*/
 {
@@ -964,21 +1441,6 @@ void ChartPlot::mousePressEvent(QMouseEvent *event)
   update() ;
   }
 
-QString ChartPlot::annotation_display_text(const AnnInfo &ann)
-/*----------------------------------------------------------*/
-{
-  QStringList text ;
-  if (std::get<2>(ann) != "")
-    text.append("<p>" + std::get<2>(ann) + "</p>") ;
-  if (std::get<3>(ann).size() > 0) {
-    QStringList tags ;
-    for (auto const &t : std::get<3>(ann))
-      tags.append(m_semantictags.value(t, t)) ;
-    text.append("<p>Tags: " + tags.join(", ") + "</p>") ;
-    }
-  return text.join("") ;
-  }
-
 void ChartPlot::mouseMoveEvent(QMouseEvent *event)
 /*----------------------------------------------*/
 {
@@ -1044,8 +1506,8 @@ void ChartPlot::contextMenuEvent(QContextMenuEvent *event)
   m_mousebutton = Qt::NoButton ;
   for (auto const &a : m_annrects) {
     if (a.first.contains(pos)) {
-      QString ann_id = a.second ;
-      AnnInfo ann = m_annotations[ann_id] ;
+      QString ann_id = m_annids.uri(a.second) ;
+      AnnInfo ann = m_annotations[a.second] ;
       if (std::get<4>(ann)) {  // editable
         QMenu menu ;
         menu.addAction("Edit") ;
@@ -1090,6 +1552,7 @@ void ChartPlot::contextMenuEvent(QContextMenuEvent *event)
           m_windowend   = m_selectend.second ;
           // emit zoomChart(scale) ;      // Results in setTimeZoom() being called
           setTimeZoom(scale) ;            // TEMP ???
+          emit windowChanged(m_windowstart, m_windowduration) ;
           clearselection = true ;
           }
         else if (item->text() == "Annotate") {
@@ -1104,7 +1567,8 @@ void ChartPlot::contextMenuEvent(QContextMenuEvent *event)
             }
           }
         else if (item->text() == "Export") {
-          QString filename = QFileDialog::getSaveFileName(this, "Export region", "", "*.bsml") ;
+          QString filename = QFileDialog::getSaveFileName(this, "Export region", "",
+            "BioSignalML (*.bsml);;CSV (*.csv);;EDF (*.edf)") ;
           if (filename != "") {
             emit exportRecording(filename, m_selectstart.second, m_selectend.second) ;
             clearselection = true ;
@@ -1116,20 +1580,24 @@ void ChartPlot::contextMenuEvent(QContextMenuEvent *event)
       }
     else {
       if (m_timezoom > 1.0) menu.addAction("Reset zoom") ;   // Have but disabled...
-      menu.addAction("Save as PNG") ;
+      menu.addAction("Save image") ;
       QAction *item = menu.exec(QWidget::mapToGlobal(pos)) ;
       if (item) {
         if (item->text() == "Reset zoom") {
           // emit zoomChart(1.0) ;       // Results in setTimeZoom() being called
           m_timezoom = 1.0 ;             // ????
           setTimeRange(0.0, m_duration) ;       //# TEMP ???
+          emit windowChanged(m_windowstart, m_windowduration) ;
           }
-        else if (item->text() == "Save as PNG") {
-          QString filename = QFileDialog::getSaveFileName(this, "Save chart", "", "*.png") ;
+        else if (item->text() == "Save image") {
+          QString filename = QFileDialog::getSaveFileName(this, "Save chart", "", ChartImage::filter()) ;
           if (filename != "") {
-            QImage output(width(), height(), QImage::Format_ARGB32_Premultiplied) ;
-            draw_window(&output) ;
-            output.save(filename, "PNG") ;
+            try {
+              ChartImage::save(this, size(), filename) ;
+              }
+            catch (std::exception &e) {
+              QMessageBox::warning(this, "Save chart", e.what()) ;
+              }
             }
           }
         }
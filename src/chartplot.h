@@ -23,6 +23,8 @@
 
 #include "typedefs.h"
 #include "nrange.h"
+#include "overview.h"
+#include "uritable.h"
 
 #include <biosignalml/data/data.h>
 
@@ -31,8 +33,10 @@
 #include <QPolygonF>
 #include <QPainterPath>
 #include <QVector>
+#include <QSet>
 #include <QScrollBar>
 #include <QMouseEvent>
+#include <QWheelEvent>
 #include <QWidget>
 
 #include <cmath>
@@ -46,6 +50,14 @@ namespace browser {
   static const int MARGIN_TOP    =  100 ;
   static const int MARGIN_BOTTOM =   40 ;
 
+  // Traces are never squeezed below this height, in pixels; the
+  // chart scrolls vertically when they don't all fit
+  static const int MIN_TRACE_HEIGHT = 40 ;
+
+  // Traces with more points than this for each device column are drawn
+  // as the minimum and maximum in each column
+  static const int DECIMATE_PER_COLUMN = 4 ;
+
   static const QColor traceColour("green") ;
   static const QColor selectedColour("red") ; // When signal is selected in controller
   static const QColor textColour("darkBlue") ;
@@ -58,6 +70,10 @@ namespace browser {
   static const QColor selectTimeColour("black") ;
   static const QColor selectLenColour("darkRed") ;
 
+  static const float MAX_TIMEZOOM = 10000.0 ;    // Limit of wheel and pinch zooming
+  static const float WHEEL_ZOOM   =     1.25 ;   // Zoom for one wheel notch
+  static const int   REFINE_DELAY =   150 ;      // ms after zooming stops to reload data
+
   static const int ANN_START =       20 ;          // Pixels from top to first bar
   static const int ANN_LINE_WIDTH =   8 ;
   static const int ANN_LINE_GAP =     2 ;
@@ -133,19 +149,35 @@ namespace browser {
     void drawTrace(QPainter &painter, float start, float end, int labelfreq,
                    const QVector<float> &markers) override ;
 
+    /**
+     * Use a signal's overview to draw parts of a window that
+     * aren't covered by data that has been appended.
+     */
+    void setOverview(const SignalOverview::Ptr &overview) ;
+
+    /**
+     * Keep at most `points` of the most recent data, as when following
+     * a live source. The oldest points are dropped in batches, so
+     * appending stays cheap and the points remain contiguous for drawing.
+     * The y-range then follows the points that are kept.
+     */
+    void setCapacity(int points) ;
+
    private:
     /** Find the y-value corresponding to a time. */
     float yValue(float time) const ;
     int index(float time) const ;
     void setYrange(void) ;
+    void trimYrange(void) ;
 
     float m_ymin ;
     float m_ymax ;
     NumericRange m_range ;
     float m_range_ymin ;
     float m_range_ymax ;
-    QPainterPath m_path ;
     QPolygonF m_polygon ;
+    int m_capacity ;               //!< Most points kept, or 0 for all
+    SignalOverview::Ptr m_overview ;
     } ;
 
 
@@ -173,41 +205,42 @@ namespace browser {
 
 
   /**
-   * A Chart is made up of several Traces stacked vertically
-   * and all sharing the same X-axis (time axis).
+   * The traces, annotations, markers and time window of a chart, and
+   * their drawing.
+   *
+   * A renderer isn't a widget, so a worker thread can have one of its own
+   * to draw charts as images. A :class:`ChartPlot` is a renderer that is
+   * shown and interacted with in the GUI thread.
    */
-  class ChartPlot : public QWidget
-  /*============================*/
+  class ChartRenderer
+  /*===============*/
   {
-    Q_OBJECT
    public:
-    ChartPlot(QWidget *parent=nullptr) ;
+    ChartRenderer() ;
+    virtual ~ChartRenderer() = default ;
 
     void setId(const QString &id) ;
     void setSemanticTags(const StringDictionary &tags) ;
     const StringDictionary &semanticTags(void) const ;
-    void setTimeScroll(QScrollBar &scrollbar) ;
-    void moveTimeScroll(QScrollBar &scrollbar) ;
 
-    void resizeEvent(QResizeEvent *e) ;
-    void paintEvent(QPaintEvent *e) ;
-    void mousePressEvent(QMouseEvent *event) ;
-    void mouseMoveEvent(QMouseEvent *event) ;
-    void mouseReleaseEvent(QMouseEvent *event) ;
-    void contextMenuEvent(QContextMenuEvent *event) ;
+    /** Ids of all visible traces, in display order. */
+    QStringList visibleTraces(void) const ;
 
-//    QSize sizeHint(void) const ;
+    /** Draw the chart on a device, such as an image, at the device's size. */
+    void drawChart(QPaintDevice *device) ;
+    /** Draw the part of a chart of the given size at offset on a device. */
+    void drawTile(QPaintDevice *device, const QSize &size, const QPoint &offset) ;
+    /** Remove all traces. */
+    void clearTraces(void) ;
 
-   public slots:
     void addSignalTrace(const QString &id, const QString &label, const QString &units,
                         bool visible=true) ;
-//TODO                        const bsml::data::TimeSeries::Ptr &data=nullptr,
-//TODO                        float ymin=NAN, float ymax=NAN) ;
     void addEventTrace(const QString &id, const QString &label, bool visible=true) ;
-//TODO                       const EventMap &mapping=[](float x) { return QString("%1").arg(x) ; },
-//TODO                       const bsml::data::TimeSeries::Ptr &data=nullptr) ;
     void appendData(const QString &id, const bsml::data::TimeSeries::Ptr &data) ;
     void setTraceVisible(const QString &id, bool visible=true) ;
+    void setTracesVisible(const QStringList &ids, bool visible=true) ;
+    void setTraceOverview(const QString &id, const SignalOverview::Ptr &overview) ;
+    void setTraceCapacity(const QString &id, int points) ;
 
     /** Get list of trace ids in display order. */
     QStringList traceOrder(void) ;
@@ -231,22 +264,17 @@ namespace browser {
     void deleteAnnotation(const QString &id) ;
     void setTimeRange(float start, float duration) ;
     void setTimeZoom(float scale) ;
-    void setMarker(float time) ;
 
-   signals:
-    void chartPosition(int offset, int width, int bottom) ;
-    void updateTimeScroll(bool visible) ;
-    void annotationAdded(float start, float end, const QString &text, const QStringList &tags) ;
-    void annotationModified(const QString &id, const QString &text, const QStringList &tags) ;
-    void annotationDeleted(const QString &id) ;
-    void exportRecording(const QString &filename, float start, float end) ;
-    void zoomChart(float scale) ;
+    /** Show a message, such as "Loading...", in the middle of the plot. */
+    void setMessage(const QString &message) ;
 
-   private:
-    void draw_window(QPaintDevice *device) ;
+   protected:
+    void draw_window(QPaintDevice *device, const QSize &size=QSize(),
+                     const QPoint &offset=QPoint()) ;
 
     void addTrace(const QString &id, bool visible, const std::shared_ptr<Trace> &trace) ;
     void draw_trace_labels(QPainter &painter) ;
+    float layout_traces(int plotheight, int &traceoffset, QList<TraceLayout> &layout) const ;
     void showSelectionRegion(QPainter &painter) ;
     void showSelectionTimes(QPainter &painter) ;
     void draw_time_grid(QPainter &painter) ;
@@ -258,6 +286,7 @@ namespace browser {
     QString annotation_display_text(const AnnInfo &ann) ;
 
     QString m_id ;                 //!< Identifier (URI) of segment
+    QString m_message ;            //!< Placeholder text, shown when not empty
     float m_segmentstart ;         //!< Start time of segment
     float m_segmentend  ;          //!< End time of segment
     float m_duration ;             //!< Duration of segment
@@ -274,23 +303,121 @@ namespace browser {
     TraceList m_tracelist ;        //!< [id, visible, plot] triples as a list
 
     NumericRange m_timerange ;
+    int m_traceoffset ;            //!< Pixels scrolled down from first trace
 
     QList<PosnTime> m_markers ;    //!< List of [xpos, time] pairs
-    int m_marker ;                 //!< Index of marker being dragged
 
     PosnTime m_selectstart ;
     PosnTime m_selectend ;
-    int m_selectmove ;
-    bool m_selecting ;
-
-    Qt::MouseButton m_mousebutton ;
 
     StringDictionary m_semantictags ; //!< uri --> label
 
+    UriIds m_annids ;              //!< Annotation URIs, cleared with the annotations
     AnnotationDict m_annotations ; //!< id --> to tuple(start, end, text, tags, editable)
     AnnRectList m_annrects ;
     } ;
 
+
+  /**
+   * A Chart is made up of several Traces stacked vertically
+   * and all sharing the same X-axis (time axis).
+   *
+   * Changes to traces, annotations and the time window relayout
+   * and repaint the widget, so must be made in the GUI thread.
+   */
+  class ChartPlot : public QWidget, public ChartRenderer
+  /*==================================================*/
+  {
+    Q_OBJECT
+   public:
+    ChartPlot(QWidget *parent=nullptr) ;
+
+    void setTimeScroll(QScrollBar &scrollbar) ;
+    void moveTimeScroll(QScrollBar &scrollbar) ;
+
+    /** The width, in pixels, of the plotting region. */
+    int plotWidth(void) const ;
+
+    void setTraceScroll(QScrollBar &scrollbar) ;
+    void moveTraceScroll(QScrollBar &scrollbar) ;
+
+    /** Ids of the traces currently within the vertical viewport. */
+    QStringList tracesInView(void) const ;
+
+    void clearTraces(void) ;
+
+    void resizeEvent(QResizeEvent *e) ;
+    void paintEvent(QPaintEvent *e) ;
+    void mousePressEvent(QMouseEvent *event) ;
+    void mouseMoveEvent(QMouseEvent *event) ;
+    void mouseReleaseEvent(QMouseEvent *event) ;
+    void contextMenuEvent(QContextMenuEvent *event) ;
+    void wheelEvent(QWheelEvent *event) ;
+    void timerEvent(QTimerEvent *event) ;
+    bool event(QEvent *event) ;
+
+//    QSize sizeHint(void) const ;
+
+   public slots:
+    void addSignalTrace(const QString &id, const QString &label, const QString &units,
+                        bool visible=true) ;
+//TODO                        const bsml::data::TimeSeries::Ptr &data=nullptr,
+//TODO                        float ymin=NAN, float ymax=NAN) ;
+    void addEventTrace(const QString &id, const QString &label, bool visible=true) ;
+//TODO                       const EventMap &mapping=[](float x) { return QString("%1").arg(x) ; },
+//TODO                       const bsml::data::TimeSeries::Ptr &data=nullptr) ;
+    void appendData(const QString &id, const bsml::data::TimeSeries::Ptr &data) ;
+    void setTraceVisible(const QString &id, bool visible=true) ;
+    /** Show or hide several traces with a single relayout. */
+    void setTracesVisible(const QStringList &ids, bool visible=true) ;
+    void setTraceOverview(const QString &id, const SignalOverview::Ptr &overview) ;
+    void setTraceCapacity(const QString &id, int points) ;
+    void orderTraces(const QStringList &ids) ;
+    void moveTrace(const QString &from, const QString &to) ;
+    void plotSelected(const int &row) ;
+    void resetAnnotations(void) ;
+    void addAnnotation(const QString &id, float start, float end, const QString &text,
+                       const QStringList &tags=QStringList(), bool edit=false) ;
+    void deleteAnnotation(const QString &id) ;
+    void setTimeRange(float start, float duration) ;
+    void setTimeZoom(float scale) ;
+    void setMessage(const QString &message) ;
+
+    /** Zoom by a factor, keeping the time at an x-position fixed. */
+    void zoomAt(int xpos, float factor) ;
+
+    void setMarker(float time) ;
+
+   signals:
+    void chartPosition(int offset, int width, int bottom) ;
+    void updateTimeScroll(bool visible) ;
+    void updateTraceScroll(bool visible) ;
+    /** Traces have been scrolled into view and need their data loading. */
+    void tracesExposed(const QStringList &ids) ;
+    void annotationAdded(float start, float end, const QString &text, const QStringList &tags) ;
+    void annotationModified(const QString &id, const QString &text, const QStringList &tags) ;
+    void annotationDeleted(const QString &id) ;
+    void exportRecording(const QString &filename, float start, float end) ;
+    void zoomChart(float scale) ;
+    /** The visible window has changed and data should be (re)loaded for it. */
+    void windowChanged(float start, float duration) ;
+
+   private:
+    void update_layout(void) ;
+    void start_refinetimer(void) ;
+
+    QList<TraceLayout> m_layout ;  //!< Visible traces intersecting the widget's viewport
+    QSet<QString> m_inview ;       //!< Ids of traces in m_layout
+    float m_layoutheight ;         //!< Height of all visible traces, in pixels
+
+    int m_marker ;                 //!< Index of marker being dragged
+    int m_selectmove ;
+    bool m_selecting ;
+
+    Qt::MouseButton m_mousebutton ;
+    int m_refinetimer ;            //!< Reload data once zooming stops
+    } ;
+
   } ;
 
 #endif
@@ -0,0 +1,140 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "eventindex.h"
+#include "recordinglock.h"
+
+#include <algorithm>
+
+using namespace browser ;
+
+
+EventIndex::EventIndex()
+/*====================*/
+: m_uris(QStringList()),
+  m_types(QVector<int>()),
+  m_starts(QVector<double>()),
+  m_durations(QVector<double>()),
+  m_typeuris(QStringList()),
+  m_typeids(QHash<QString, int>()),
+  m_bytype(QVector<QVector<int>>()),
+  m_bytime(QVector<int>())
+{
+  }
+
+void EventIndex::add(const QString &uri, const QString &type, double start, double duration)
+/*----------------------------------------------------------------------------------------*/
+{
+  int t = m_typeids.value(type, -1) ;
+  if (t < 0) {
+    t = m_typeuris.size() ;
+    m_typeids.insert(type, t) ;
+    m_typeuris.append(type) ;
+    m_bytype.append(QVector<int>()) ;
+    }
+  m_bytype[t].append(m_uris.size()) ;
+  m_bytime.append(m_uris.size()) ;
+  m_uris.append(uri) ;
+  m_types.append(t) ;
+  m_starts.append(start) ;
+  m_durations.append(duration) ;
+  }
+
+void EventIndex::order_by_time(void)
+/*--------------------------------*/
+{
+  std::stable_sort(m_bytime.begin(), m_bytime.end(),
+    [this](int a, int b) { return m_starts.at(a) < m_starts.at(b) ; }) ;
+  for (auto &events : m_bytype) events.clear() ;
+  for (auto n : m_bytime) m_bytype[m_types.at(n)].append(n) ;
+  }
+
+EventIndex::Ptr EventIndex::read(bsml::Recording::Ptr recording, const std::atomic<bool> *cancel)
+/*---------------------------------------------------------------------------------------------*/
+{
+  auto index = std::make_shared<EventIndex>() ;
+  decltype(recording->get_event_uris(bsml::BSML::Instant)) uris ;
+  {
+    RecordingLock lock ;
+    uris = recording->get_event_uris(bsml::BSML::Instant) ;
+    }
+  for (auto const &u : uris) {
+    if (cancel && *cancel) break ;
+    RecordingLock lock ;   // For each event, so others can use the recording
+    auto event = recording->get_event(u) ;
+    if (event->is_valid()) {
+      auto time = event->time() ;
+      index->add(((std::string)u).c_str(), ((std::string)event->eventtype()).c_str(),
+                 time->start(), time->duration()) ;
+      }
+    }
+  index->order_by_time() ;
+  return index ;
+  }
+
+QVector<int> EventIndex::events(int type) const
+/*-------------------------------------------*/
+{
+  return (type >= 0) ? m_bytype.at(type) : m_bytime ;   // Shared, not copied
+  }
+
+
+EventIndexThread::EventIndexThread(bsml::Recording::Ptr recording)
+/*==============================================================*/
+: QObject(),
+  m_recording(recording),
+  m_exit(true)
+{
+  QObject::connect(&m_thread, &QThread::started, this, &EventIndexThread::run) ;
+  moveToThread(&m_thread) ;
+  }
+
+void EventIndexThread::start(void)
+/*------------------------------*/
+{
+  m_exit = false ;
+  m_thread.start() ;
+  }
+
+void EventIndexThread::run(void)
+/*----------------------------*/
+{
+  try {
+    auto index = EventIndex::read(m_recording, &m_exit) ;
+    emit loaded(m_exit ? nullptr : index) ;
+    }
+  catch (std::exception &e) {
+    qCritical("Events: %s", e.what()) ;
+    emit loaded(nullptr) ;
+    }
+  m_thread.exit(0) ;
+  }
+
+void EventIndexThread::stop(void)
+/*-----------------------------*/
+{
+  m_exit = true ;
+  }
+
+bool EventIndexThread::wait(unsigned long time)
+/*-------------------------------------------*/
+{
+  return m_thread.wait(time) ;
+  }
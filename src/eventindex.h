@@ -0,0 +1,116 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_EVENTINDEX_H
+#define BROWSER_EVENTINDEX_H
+
+#include "typedefs.h"
+
+#include <biosignalml/biosignalml.h>
+
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <QThread>
+
+#include <atomic>
+#include <memory>
+
+
+namespace browser {
+
+  /**
+   * The instantaneous events of a recording.
+   *
+   * Events are held in columns, with each event's type stored as
+   * an index into a table of event types, along with the events of
+   * each type. Recordings with beat annotations can have hundreds of
+   * thousands of events so an index is built in one pass and event
+   * rows are then displayed directly from it.
+   */
+  class EventIndex
+  /*============*/
+  {
+   public:
+    typedef std::shared_ptr<EventIndex> Ptr ;
+
+    EventIndex() ;
+
+    /** Index a recording's events, stopping early if `cancel` becomes set. */
+    static Ptr read(bsml::Recording::Ptr recording, const std::atomic<bool> *cancel=nullptr) ;
+
+    void add(const QString &uri, const QString &type, double start, double duration) ;
+    /** Order event positions by time once all events have been added. */
+    void order_by_time(void) ;
+
+    inline int size(void) const { return m_uris.size() ; }
+    inline const QString &uri(int n) const { return m_uris.at(n) ; }
+    inline int type(int n) const { return m_types.at(n) ; }
+    inline double start(int n) const { return m_starts.at(n) ; }
+    inline double duration(int n) const { return m_durations.at(n) ; }
+
+    /** The URIs of event types, in the order first seen. */
+    inline const QStringList &types(void) const { return m_typeuris ; }
+    inline int count(int type) const { return m_bytype.at(type).size() ; }
+
+    /** Positions of the events of a type, or of all events if type < 0, in time order. */
+    QVector<int> events(int type) const ;
+
+   private:
+    QStringList m_uris ;
+    QVector<int> m_types ;
+    QVector<double> m_starts ;
+    QVector<double> m_durations ;
+    QStringList m_typeuris ;
+    QHash<QString, int> m_typeids ;
+    QVector<QVector<int>> m_bytype ;
+    QVector<int> m_bytime ;
+    } ;
+
+
+  /**
+   * Build a recording's event index in a separate thread.
+   */
+  class EventIndexThread : public QObject
+  /*===================================*/
+  {
+   Q_OBJECT
+
+   public:
+    EventIndexThread(bsml::Recording::Ptr recording) ;
+    void start(void) ;
+    void stop(void) ;
+    bool wait(unsigned long time) ;
+
+   public slots:
+    void run(void) ;
+
+   signals:
+    void loaded(EventIndex::Ptr) ;
+
+   private:
+    bsml::Recording::Ptr m_recording ;
+    std::atomic<bool> m_exit ;
+    QThread m_thread ;
+    } ;
+
+  } ;
+
+#endif
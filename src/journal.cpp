@@ -0,0 +1,109 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "journal.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+
+#include <cmath>
+
+using namespace browser ;
+
+
+AnnotationJournal::AnnotationJournal(const QString &filename)
+/*=========================================================*/
+: m_file(filename)
+{
+  QDir().mkpath(QFileInfo(filename).path()) ;
+  if (!m_file.open(QIODevice::ReadWrite | QIODevice::Append))
+    qWarning("Cannot open journal %s", qPrintable(filename)) ;
+  }
+
+QString AnnotationJournal::filename(const QString &uri)
+/*---------------------------------------------------*/
+{
+  QString hash = QCryptographicHash::hash(uri.toUtf8(), QCryptographicHash::Sha1).toHex() ;
+  return QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation))
+           .filePath("journals/" + hash + ".journal") ;
+  }
+
+QList<AnnotationJournal::Entry> AnnotationJournal::read(void)
+/*---------------------------------------------------------*/
+{
+  QList<Entry> entries ;
+  if (!m_file.isOpen()) return entries ;
+  m_file.seek(0) ;
+  while (!m_file.atEnd()) {
+    QJsonObject json = QJsonDocument::fromJson(m_file.readLine()).object() ;
+    if (json.isEmpty()) continue ;     // Partly written when we stopped
+    Entry e ;
+    e.add = (json["op"].toString() == "add") ;
+    e.uri = json["uri"].toString() ;
+    e.start = json["start"].isDouble() ? (float)json["start"].toDouble() : NAN ;
+    e.end = json["end"].isDouble() ? (float)json["end"].toDouble() : NAN ;
+    e.text = json["text"].toString() ;
+    for (auto const &t : json["tags"].toArray()) e.tags.append(t.toString()) ;
+    e.predecessor = json["predecessor"].toString() ;
+    entries.append(e) ;
+    }
+  return entries ;
+  }
+
+QByteArray AnnotationJournal::line(const Entry &entry)
+/*-------------------------------------------------*/
+{
+  QJsonObject json ;
+  json["op"] = entry.add ? "add" : "delete" ;
+  json["uri"] = entry.uri ;
+  if (entry.add) {
+    if (!isnan(entry.start)) json["start"] = entry.start ;
+    if (!isnan(entry.end)) json["end"] = entry.end ;
+    json["text"] = entry.text ;
+    json["tags"] = QJsonArray::fromStringList(entry.tags) ;
+    if (entry.predecessor != "") json["predecessor"] = entry.predecessor ;
+    }
+  return QJsonDocument(json).toJson(QJsonDocument::Compact) + "\n" ;
+  }
+
+void AnnotationJournal::append(const Entry &entry)
+/*----------------------------------------------*/
+{
+  m_file.write(line(entry)) ;
+  m_file.flush() ;
+  }
+
+void AnnotationJournal::append(const QList<Entry> &entries)
+/*-------------------------------------------------------*/
+{
+  for (auto const &entry : entries) m_file.write(line(entry)) ;
+  m_file.flush() ;
+  }
+
+void AnnotationJournal::clear(void)
+/*-------------------------------*/
+{
+  m_file.resize(0) ;
+  }
@@ -0,0 +1,77 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_JOURNAL_H
+#define BROWSER_JOURNAL_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+
+namespace browser {
+
+  /**
+   * An append-only log of annotation edits.
+   *
+   * Edits are written here as they are made and applied to the
+   * recording later, in a batch. Each edit is a line of JSON, so a
+   * journal that was not cleared (because the browser stopped before
+   * the recording was saved) can be read back and replayed.
+   */
+  class AnnotationJournal
+  /*===================*/
+  {
+   public:
+    struct Entry {
+      bool add ;                 //!< Otherwise delete
+      QString uri ;              //!< Of the annotation
+      float start ;
+      float end ;                //!< NAN for an instant
+      QString text ;
+      QStringList tags ;
+      QString predecessor ;      //!< URI of an annotation being replaced
+      } ;
+
+    AnnotationJournal(const QString &filename) ;
+
+    /** The default journal file for a recording. */
+    static QString filename(const QString &uri) ;
+
+    /** Read entries left from a previous session. */
+    QList<Entry> read(void) ;
+    /** Append an entry, returning once it has been written. */
+    void append(const Entry &entry) ;
+    /** Append several entries, as from an import, with a single flush. */
+    void append(const QList<Entry> &entries) ;
+    /** Empty the journal, once its entries have been saved. */
+    void clear(void) ;
+
+   private:
+    static QByteArray line(const Entry &entry) ;
+
+    QFile m_file ;
+    } ;
+
+  } ;
+
+#endif
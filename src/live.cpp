@@ -0,0 +1,327 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "live.h"
+
+#include <QAbstractSocket>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalSocket>
+#include <QTcpSocket>
+#include <QtEndian>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+
+using namespace browser ;
+
+
+static float little_endian_float(const char *data)
+/*==============================================*/
+{
+  quint32 bits = qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(data)) ;
+  float value ;
+  std::memcpy(&value, &bits, sizeof(value)) ;
+  return value ;
+  }
+
+static bool is_connected(QIODevice *socket)
+/*---------------------------------------*/
+{
+  auto tcp = qobject_cast<QAbstractSocket *>(socket) ;
+  if (tcp != nullptr) return tcp->state() == QAbstractSocket::ConnectedState ;
+  auto local = qobject_cast<QLocalSocket *>(socket) ;
+  return local != nullptr && local->state() == QLocalSocket::ConnectedState ;
+  }
+
+
+LiveSource::LiveSource(const QString &address, SpscQueue<LiveBlock *> *queue)
+/*=========================================================================*/
+: QObject(),
+  m_address(address),
+  m_queue(queue),
+  m_channels(0),
+  m_dropped(0),
+  m_exit(false)
+{
+  QObject::connect(&m_thread, &QThread::started, this, &LiveSource::run) ;
+  moveToThread(&m_thread) ;
+  }
+
+void LiveSource::start(void)
+/*------------------------*/
+{
+  m_thread.start() ;
+  }
+
+void LiveSource::stop(void)
+/*-----------------------*/
+{
+  m_exit = true ;
+  }
+
+bool LiveSource::wait(unsigned long time)
+/*-------------------------------------*/
+{
+  return m_thread.wait(time) ;
+  }
+
+void LiveSource::run(void)
+/*----------------------*/
+{
+  QString error ;
+  try {
+    std::unique_ptr<QIODevice> socket(open_socket()) ;
+    while (!m_exit) {
+      char length[4] ;
+      if (!read_bytes(socket.get(), length, sizeof(length))) break ;
+      quint32 size = qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(length)) ;
+      if (size == 0 || size > LIVE_FRAME_MAX)
+        throw std::runtime_error("Invalid frame from live source") ;
+      QByteArray frame(size, Qt::Uninitialized) ;
+      if (!read_bytes(socket.get(), frame.data(), size)) break ;
+      read_frame(frame) ;
+      }
+    if (!m_exit) error = "Live source closed" ;
+    }
+  catch (std::exception &e) {
+    error = e.what() ;
+    }
+  emit finished(error) ;
+  m_thread.exit(0) ;
+  }
+
+QIODevice *LiveSource::open_socket(void)
+/*------------------------------------*/
+{
+  if (m_address.startsWith("unix:")) {
+    auto socket = new QLocalSocket() ;
+    socket->connectToServer(m_address.mid(5)) ;
+    if (!socket->waitForConnected(LIVE_CONNECT)) {
+      QString error = socket->errorString() ;
+      delete socket ;
+      throw std::runtime_error(QString("Cannot connect to %1: %2").arg(m_address).arg(error).toStdString()) ;
+      }
+    return socket ;
+    }
+  int colon = m_address.lastIndexOf(':') ;
+  bool ok = false ;
+  int port = (colon > 0) ? m_address.mid(colon + 1).toInt(&ok) : 0 ;
+  if (!ok || port <= 0 || port > 65535)
+    throw std::runtime_error(QString("Invalid live source %1").arg(m_address).toStdString()) ;
+  auto socket = new QTcpSocket() ;
+  socket->connectToHost(m_address.left(colon), port) ;
+  if (!socket->waitForConnected(LIVE_CONNECT)) {
+    QString error = socket->errorString() ;
+    delete socket ;
+    throw std::runtime_error(QString("Cannot connect to %1: %2").arg(m_address).arg(error).toStdString()) ;
+    }
+  socket->setSocketOption(QAbstractSocket::LowDelayOption, 1) ;
+  return socket ;
+  }
+
+bool LiveSource::read_bytes(QIODevice *socket, char *data, qint64 size)
+/*-------------------------------------------------------------------*/
+{
+  // Wait in short steps, so that stopping isn't held up by a quiet source
+  qint64 got = 0 ;
+  while (got < size) {
+    if (m_exit) return false ;
+    qint64 n = socket->read(data + got, size - got) ;
+    if (n < 0) return false ;
+    got += n ;
+    if (got < size && socket->bytesAvailable() == 0
+     && !socket->waitForReadyRead(100) && !is_connected(socket)) return false ;
+    }
+  return true ;
+  }
+
+void LiveSource::read_frame(const QByteArray &frame)
+/*------------------------------------------------*/
+{
+  const char *data = frame.constData() ;
+  if (frame[0] == 'H') {
+    QJsonObject header = QJsonDocument::fromJson(frame.mid(1)).object() ;
+    double rate = header["rate"].toDouble() ;
+    QStringList labels ;
+    QStringList units ;
+    for (auto const &s : header["signals"].toArray()) {
+      labels.append(s.toObject()["label"].toString()) ;
+      units.append(s.toObject()["units"].toString()) ;
+      }
+    if (rate <= 0.0 || labels.isEmpty())
+      throw std::runtime_error("Invalid header from live source") ;
+    m_channels = labels.size() ;
+    emit connected(rate, labels, units) ;
+    }
+  else if (frame[0] == 'D') {
+    if (m_channels == 0)
+      throw std::runtime_error("Live source sent data before its header") ;
+    if (frame.size() < 21)
+      throw std::runtime_error("Short data frame from live source") ;
+    int samples = (int)qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(data + 17)) ;
+    if (frame.size() != (21 + (qint64)sizeof(float)*m_channels*samples))
+      throw std::runtime_error("Data frame from live source has the wrong size") ;
+    auto block = new LiveBlock ;
+    block->sent = qFromLittleEndian<qint64>(reinterpret_cast<const uchar *>(data + 1)) ;
+    block->first = qFromLittleEndian<qint64>(reinterpret_cast<const uchar *>(data + 9)) ;
+    block->channels = m_channels ;
+    block->samples = samples ;
+    block->values.resize(m_channels*samples) ;
+    for (size_t n = 0 ;  n < block->values.size() ;  ++n)
+      block->values[n] = little_endian_float(data + 21 + sizeof(float)*n) ;
+    if (!m_queue->push(block)) {    // The chart has fallen behind
+      delete block ;
+      m_dropped += 1 ;
+      }
+    }
+  }
+
+
+LiveChart::LiveChart(ChartPlot *chart, const QString &address, double window)
+/*=========================================================================*/
+: QObject(),
+  m_chart(chart),
+  m_window(window),
+  m_queue(LIVE_QUEUE),
+  m_source(new LiveSource(address, &m_queue)),
+  m_rate(NAN)
+{
+  connect(m_source, &LiveSource::connected, this, &LiveChart::source_connected) ;
+  connect(m_source, &LiveSource::finished, this, &LiveChart::source_finished) ;
+  m_timer.setTimerType(Qt::PreciseTimer) ;
+  connect(&m_timer, &QTimer::timeout, this, &LiveChart::show_frame) ;
+  m_chart->setTimeRange(0.0, m_window) ;
+  }
+
+LiveChart::~LiveChart()
+/*-------------------*/
+{
+  m_timer.stop() ;
+  m_source->stop() ;
+  m_source->wait(ULONG_MAX) ;
+  delete m_source ;
+  LiveBlock *block ;
+  while (m_queue.pop(block)) delete block ;
+  }
+
+void LiveChart::start(void)
+/*-----------------------*/
+{
+  m_chart->setMessage("Connecting...") ;
+  m_source->start() ;
+  m_timer.start(1000/LIVE_FRAME_RATE) ;
+  m_elapsed.start() ;
+  }
+
+LiveStatistics LiveChart::statistics(void) const
+/*--------------------------------------------*/
+{
+  LiveStatistics totals = m_totals ;
+  totals.dropped = m_source->dropped() ;
+  return totals ;
+  }
+
+void LiveChart::source_connected(double rate, const QStringList &labels, const QStringList &units)
+/*----------------------------------------------------------------------------------------------*/
+{
+  m_rate = rate ;
+  m_chart->clearTraces() ;
+  m_ids.clear() ;
+  int capacity = (int)std::ceil(rate*m_window) + 1 ;
+  for (int n = 0 ;  n < labels.size() ;  ++n) {
+    QString id = QString::number(n) ;
+    m_chart->addSignalTrace(id, labels[n], units.value(n)) ;
+    m_chart->setTraceCapacity(id, capacity) ;
+    m_ids.append(id) ;
+    }
+  m_chart->setMessage("") ;
+  }
+
+void LiveChart::source_finished(const QString &error)
+/*-------------------------------------------------*/
+{
+  show_frame() ;                   // What's still queued
+  m_timer.stop() ;
+  if (error != "") {
+    qWarning("%s", qPrintable(error)) ;
+    m_chart->setMessage(error) ;
+    }
+  emit finished(error) ;
+  }
+
+void LiveChart::show_frame(void)
+/*----------------------------*/
+{
+  if (m_ids.isEmpty()) return ;    // No header yet
+  int channels = m_ids.size() ;
+  std::vector<double> times ;
+  std::vector<std::vector<double>> values(channels) ;
+  double latest = NAN ;
+  qint64 now = QDateTime::currentMSecsSinceEpoch() ;
+  LiveBlock *block ;
+  while (m_queue.pop(block)) {
+    if (block->channels != channels) {   // Read before or after a header we haven't shown
+      m_interval.mismatched += 1 ;
+      m_totals.mismatched += 1 ;
+      delete block ;
+      continue ;
+      }
+    int samples = block->samples ;
+    for (int s = 0 ;  s < samples ;  ++s) times.push_back((block->first + s)/m_rate) ;
+    for (int c = 0 ;  c < channels ;  ++c)
+      values[c].insert(values[c].end(), block->values.begin() + c*samples,
+                                        block->values.begin() + (c + 1)*samples) ;
+    latest = (block->first + samples)/m_rate ;
+    qint64 latency = now - block->sent ;
+    for (auto stats : {&m_interval, &m_totals}) {
+      stats->latency += latency ;
+      stats->maxlatency = std::max(stats->maxlatency, latency) ;
+      stats->blocks += 1 ;
+      stats->samples += (qint64)channels*samples ;
+      }
+    delete block ;
+    }
+  if (!times.empty()) {
+    for (int c = 0 ;  c < channels ;  ++c)
+      m_chart->appendData(m_ids[c], std::make_shared<bsml::data::TimeSeries>(times, values[c])) ;
+    m_chart->setTimeRange(std::max(0.0, latest - m_window), m_window) ;
+    }
+  if (m_elapsed.elapsed() >= LIVE_STATISTICS) report_statistics() ;
+  }
+
+void LiveChart::report_statistics(void)
+/*-----------------------------------*/
+{
+  double seconds = m_elapsed.restart()/1000.0 ;
+  if (m_interval.blocks > 0)
+    qInfo("Live: %.0f samples/s, latency mean %.1f ms, max %lld ms, %d blocks dropped, %d mismatched",
+          m_interval.samples/seconds, m_interval.mean_latency(), m_interval.maxlatency,
+          m_source->dropped(), m_interval.mismatched) ;
+  m_interval = LiveStatistics() ;
+  }
+
@@ -0,0 +1,227 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_LIVE_H
+#define BROWSER_LIVE_H
+
+#include "chartplot.h"
+
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+
+#include <atomic>
+#include <vector>
+
+
+namespace browser {
+
+  static const int LIVE_FRAME_RATE = 30 ;       // Chart updates a second
+  static const double LIVE_WINDOW = 10.0 ;      // Default seconds shown
+  static const int LIVE_QUEUE = 1024 ;          // Blocks queued between source and chart
+  static const int LIVE_FRAME_MAX = 1 << 24 ;   // Largest frame accepted, in bytes
+  static const int LIVE_CONNECT = 5000 ;        // Msecs to wait for a source
+  static const int LIVE_STATISTICS = 5000 ;     // Msecs between throughput reports
+
+
+  /**
+   * A fixed-size queue between one producer thread and one consumer
+   * thread, without locks.
+   *
+   * The capacity is rounded up to a power of two. :meth:`push` fails
+   * rather than waits when the queue is full.
+   */
+  template<typename T> class SpscQueue
+  /*================================*/
+  {
+   public:
+    SpscQueue(size_t capacity)
+    : m_mask(0),
+      m_head(0),
+      m_tail(0)
+    {
+      size_t size = 1 ;
+      while (size < capacity) size <<= 1 ;
+      m_slots.resize(size) ;
+      m_mask = size - 1 ;
+      }
+
+    bool push(const T &item)
+    {
+      size_t tail = m_tail.load(std::memory_order_relaxed) ;
+      if ((tail - m_head.load(std::memory_order_acquire)) == m_slots.size()) return false ;
+      m_slots[tail & m_mask] = item ;
+      m_tail.store(tail + 1, std::memory_order_release) ;
+      return true ;
+      }
+
+    bool pop(T &item)
+    {
+      size_t head = m_head.load(std::memory_order_relaxed) ;
+      if (head == m_tail.load(std::memory_order_acquire)) return false ;
+      item = m_slots[head & m_mask] ;
+      m_head.store(head + 1, std::memory_order_release) ;
+      return true ;
+      }
+
+   private:
+    std::vector<T> m_slots ;
+    size_t m_mask ;
+    alignas(64) std::atomic<size_t> m_head ;   //!< Only changed by the consumer
+    alignas(64) std::atomic<size_t> m_tail ;   //!< Only changed by the producer
+    } ;
+
+
+  /**
+   * Samples of every channel of a live source, from one data frame.
+   */
+  struct LiveBlock
+  /*============*/
+  {
+    qint64 sent ;                  //!< Msecs since the epoch, by the source's clock
+    qint64 first ;                 //!< Index of the first sample
+    int channels ;                 //!< As given by the header in force when read
+    int samples ;                  //!< In each channel
+    std::vector<float> values ;    //!< Channel by channel
+    } ;
+
+
+  /**
+   * Counts of what a :class:`LiveChart` has shown of its source.
+   */
+  struct LiveStatistics
+  /*=================*/
+  {
+    qint64 samples = 0 ;           //!< Added to the chart, over all channels
+    qint64 latency = 0 ;           //!< Total msecs from sending to showing, over blocks
+    qint64 maxlatency = 0 ;
+    int blocks = 0 ;               //!< Added to the chart
+    int mismatched = 0 ;           //!< Not matching the chart's traces
+    int dropped = 0 ;              //!< Not queued by the source
+
+    inline double mean_latency(void) const { return (blocks > 0) ? (double)latency/blocks : 0.0 ; }
+    } ;
+
+
+  /**
+   * Read frames from a live source in a separate thread.
+   *
+   * A source is a Unix socket, given as `unix:PATH`, or a TCP socket,
+   * as `HOST:PORT`. Every frame is a little-endian 32-bit length
+   * followed by that many bytes, the first a frame type:
+   *
+   * `H`
+   *   The header, sent first, as JSON with the sampling `rate` and a
+   *   list of `signals`, each with a `label` and `units`.
+   *
+   * `D`
+   *   Data, as a 64-bit send time in msecs since the epoch, the 64-bit
+   *   index of the first sample, a 32-bit count of samples in each channel,
+   *   and then each channel's samples as 32-bit floats.
+   *
+   * All numbers are little-endian. Data blocks are passed on through a
+   * :class:`SpscQueue` and are dropped if the queue is full.
+   */
+  class LiveSource : public QObject
+  /*=============================*/
+  {
+   Q_OBJECT
+
+   public:
+    LiveSource(const QString &address, SpscQueue<LiveBlock *> *queue) ;
+    void start(void) ;
+    void stop(void) ;
+    bool wait(unsigned long time) ;
+    inline int dropped(void) const { return m_dropped ; }
+
+   public slots:
+    void run(void) ;
+
+   signals:
+    void connected(double rate, const QStringList &labels, const QStringList &units) ;
+    void finished(const QString &error) ;
+
+   private:
+    QIODevice *open_socket(void) ;
+    bool read_bytes(QIODevice *socket, char *data, qint64 size) ;
+    void read_frame(const QByteArray &frame) ;
+
+    QString m_address ;
+    SpscQueue<LiveBlock *> *m_queue ;
+    int m_channels ;               //!< Zero until the header is read
+    std::atomic<int> m_dropped ;   //!< Blocks not queued
+    std::atomic<bool> m_exit ;
+    QThread m_thread ;
+    } ;
+
+
+  /**
+   * Show a live source in a chart that scrolls to its most recent samples.
+   *
+   * The chart is updated :data:`LIVE_FRAME_RATE` times a second, with
+   * the blocks queued since the last update, and keeps only enough of
+   * each trace for its window. Blocks read under a different header
+   * than the chart's traces, as when a source changes its signals, are
+   * dropped. Throughput and the latency from a block
+   * being sent to its being added to the chart are reported every
+   * :data:`LIVE_STATISTICS` msecs, and :meth:`statistics` gives
+   * their totals since the chart was started.
+   */
+  class LiveChart : public QObject
+  /*============================*/
+  {
+   Q_OBJECT
+
+   public:
+    LiveChart(ChartPlot *chart, const QString &address, double window=LIVE_WINDOW) ;
+    ~LiveChart() ;
+    void start(void) ;
+    LiveStatistics statistics(void) const ;
+
+   signals:
+    void finished(const QString &error) ;
+
+   private slots:
+    void source_connected(double rate, const QStringList &labels, const QStringList &units) ;
+    void source_finished(const QString &error) ;
+    void show_frame(void) ;
+
+   private:
+    void report_statistics(void) ;
+
+    ChartPlot *m_chart ;
+    double m_window ;
+    SpscQueue<LiveBlock *> m_queue ;
+    LiveSource *m_source ;
+    QTimer m_timer ;
+    double m_rate ;
+    QStringList m_ids ;            //!< Empty until the source has connected
+    LiveStatistics m_interval ;    //!< Since the last report
+    LiveStatistics m_totals ;      //!< Since starting
+    QElapsedTimer m_elapsed ;
+    } ;
+
+  } ;
+
+#endif
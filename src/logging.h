@@ -0,0 +1,38 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_LOGGING_H
+#define BROWSER_LOGGING_H
+
+#include <QLoggingCategory>
+
+
+namespace browser {
+
+  /**
+   * Progress and timing messages, such as startup times and the number of
+   * annotations imported. They are off by default and are enabled with
+   * QT_LOGGING_RULES="biosignalml.browser.info=true".
+   */
+  Q_DECLARE_LOGGING_CATEGORY(browserLog)
+
+  } ;
+
+#endif
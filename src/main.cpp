@@ -19,6 +19,14 @@
  *****************************************************************************/
 
 #include "browser.h"
+#include "batchrender.h"
+#include "report.h"
+#include "repository.h"
+#include "live.h"
+#include "tileserver.h"
+#include "tail.h"
+#include "recordinglock.h"
+#include "logging.h"
 
 #include <biosignalml/data/hdf5.h>
 
@@ -28,6 +36,7 @@
 #include <cmath>
 #include <iostream>
 #include <exception>
+#include <stdexcept>
 
 
 int main(int argc, char *argv[])
@@ -61,24 +70,176 @@ int main(int argc, char *argv[])
   return app.exec() ;
 #else
   if (argc <= 1) {
-    std::cerr << "Usage: "<< argv[0] << " RECORDING [start] [duration]" << std::endl ;
+    std::cerr << "Usage: "<< argv[0] << " [--follow] RECORDING [start] [duration]" << std::endl
+              << "       "<< argv[0] << " --render JOBS [WIDTHxHEIGHT] [threads]" << std::endl
+              << "       "<< argv[0] << " --report RECORDING PDF [page seconds] [threads]" << std::endl
+              << "       "<< argv[0] << " --serve PORT DIRECTORY [threads] [origin]" << std::endl
+              << "       "<< argv[0] << " --live unix:PATH|HOST:PORT [window seconds]" << std::endl ;
     exit(1) ;
     }
 
-  QString uri(argv[1]) ;
+  if (QString(argv[1]) == "--render") {
+    if (argc < 3) {
+      std::cerr << "No job list" << std::endl ;
+      exit(1) ;
+      }
+    QSize size(1200, 800) ;
+    int threads = 0 ;
+    bool ok = true ;
+    if (argc >= 4) {
+      QStringList wh = QString(argv[3]).split("x") ;
+      if (wh.size() == 2) size = QSize(wh[0].toInt(&ok), ok ? wh[1].toInt(&ok) : 0) ;
+      if (wh.size() != 2 || !ok || size.width() <= 0 || size.height() <= 0) {
+        std::cerr << "Invalid image size" << std::endl ;
+        exit(1) ;
+        }
+      }
+    if (argc >= 5) {
+      threads = QString(argv[4]).toInt(&ok) ;
+      if (!ok) {
+        std::cerr << "Invalid thread count" << std::endl ;
+        exit(1) ;
+        }
+      }
+    qputenv("QT_QPA_PLATFORM", "offscreen") ;    // No window
+    QApplication app(argc, argv) ;
+    app.setStyle("fusion") ;
+    try {
+      auto jobs = browser::BatchRenderer::read_jobs(argv[2]) ;
+      return (browser::BatchRenderer(size, threads).render(jobs) == 0) ? 0 : 2 ;
+      }
+    catch (std::exception &e) {
+      qCritical("Exception: %s", e.what()) ;
+      exit(1) ;
+      }
+    }
+
+  if (QString(argv[1]) == "--report") {
+    if (argc < 4) {
+      std::cerr << "No recording or output file" << std::endl ;
+      exit(1) ;
+      }
+    double pagetime = browser::REPORT_PAGE_TIME ;
+    int threads = 0 ;
+    bool ok = true ;
+    if (argc >= 5) {
+      pagetime = QString(argv[4]).toDouble(&ok) ;
+      if (!ok || pagetime <= 0.0) {
+        std::cerr << "Invalid page duration" << std::endl ;
+        exit(1) ;
+        }
+      }
+    if (argc >= 6) {
+      threads = QString(argv[5]).toInt(&ok) ;
+      if (!ok) {
+        std::cerr << "Invalid thread count" << std::endl ;
+        exit(1) ;
+        }
+      }
+    qputenv("QT_QPA_PLATFORM", "offscreen") ;    // No window
+    QApplication app(argc, argv) ;
+    app.setStyle("fusion") ;
+    try {
+      auto recording = bsml::HDF5::Recording::create(std::string(argv[2]), true) ;  // Read only
+      browser::ReportGenerator(recording, pagetime, threads).write(argv[3]) ;
+      recording->close() ;
+      return 0 ;
+      }
+    catch (std::exception &e) {
+      qCritical("Exception: %s", e.what()) ;
+      exit(1) ;
+      }
+    }
+
+  if (QString(argv[1]) == "--serve") {
+    bool ok = false ;
+    int port = (argc >= 3) ? QString(argv[2]).toInt(&ok) : 0 ;
+    if (!ok || port <= 0 || port > 65535) {
+      std::cerr << "Invalid port" << std::endl ;
+      exit(1) ;
+      }
+    if (argc < 4) {
+      std::cerr << "No directory to serve" << std::endl ;
+      exit(1) ;
+      }
+    int threads = 0 ;
+    if (argc >= 5) {
+      threads = QString(argv[4]).toInt(&ok) ;
+      if (!ok) {
+        std::cerr << "Invalid thread count" << std::endl ;
+        exit(1) ;
+        }
+      }
+    QString origin = (argc >= 6) ? QString(argv[5]) : QString() ;   // For cross-origin pages
+    qputenv("QT_QPA_PLATFORM", "offscreen") ;    // No window
+    QApplication app(argc, argv) ;
+    app.setStyle("fusion") ;
+    try {
+      browser::TileServer server(argv[3], threads, origin) ;
+      if (!server.listen(QHostAddress::LocalHost, port)) {
+        qCritical("Cannot listen on port %d: %s", port, server.errorString().toLocal8Bit().constData()) ;
+        exit(1) ;
+        }
+      qCInfo(browser::browserLog, "Serving chart tiles from %s at http://localhost:%d/tile",
+             argv[3], port) ;
+      return app.exec() ;
+      }
+    catch (std::exception &e) {
+      qCritical("Exception: %s", e.what()) ;
+      exit(1) ;
+      }
+    }
+
+  if (QString(argv[1]) == "--live") {
+    if (argc < 3) {
+      std::cerr << "No live source" << std::endl ;
+      exit(1) ;
+      }
+    double window = browser::LIVE_WINDOW ;
+    if (argc >= 4) {
+      bool ok = false ;
+      window = QString(argv[3]).toDouble(&ok) ;
+      if (!ok || window <= 0.0) {
+        std::cerr << "Invalid window duration" << std::endl ;
+        exit(1) ;
+        }
+      }
+    QApplication app(argc, argv) ;
+    app.setStyle("fusion") ;
+    browser::ChartPlot chart ;
+    chart.setWindowTitle(QString("Live: %1").arg(argv[2])) ;
+    chart.resize(1200, 800) ;
+    browser::LiveChart live(&chart, argv[2], window) ;
+    chart.show() ;
+    live.start() ;
+    return app.exec() ;
+    }
+
+  // Follow a recording that is still being written
+  bool follow = (QString(argv[1]) == "--follow") ;
+  int arg = follow ? 2 : 1 ;
+  if (argc <= arg) {
+    std::cerr << "No recording" << std::endl ;
+    exit(1) ;
+    }
+  QString uri(argv[arg]) ;
+  if (follow && uri.contains("://")) {
+    std::cerr << "Only HDF5 files can be followed" << std::endl ;
+    exit(1) ;
+    }
 
   float start = 0.0 ;
   float end = NAN ;
   bool ok = false ;
-  if (argc >= 3) {
-    start = QString(argv[2]).toFloat(&ok) ;
+  if (argc >= (arg + 2)) {
+    start = QString(argv[arg + 1]).toFloat(&ok) ;
     if (!ok) {
       std::cerr << "Invalid start time" << std::endl ;
       exit(1) ;
       }
     }
-  if (argc >= 4) {
-    end = QString(argv[3]).toFloat(&ok) ;
+  if (argc >= (arg + 3)) {
+    end = QString(argv[arg + 2]).toFloat(&ok) ;
     if (!ok) {
       std::cerr << "Invalid duration" << std::endl ;
       exit(1) ;
@@ -89,15 +250,25 @@ int main(int argc, char *argv[])
   app.setStyle("fusion") ;   //# For Ubuntu 14.04
 
   auto semantic_tags = browser::StringDictionary{} ;
-  bsml::HDF5::Recording::Ptr hdf5 = nullptr ;
+  bsml::Recording::Ptr recording = nullptr ;
+  double duration = NAN ;
+  hid_t swmr = -1 ;
   try {
-    if (uri.startsWith("http://")) {
-//TODO      store = biosignalml.client.Repository(uri) ;
-//TODO      recording = store.get_recording(uri) ;
+    if (uri.startsWith("http://") || uri.startsWith("https://")) {
+      recording = browser::RemoteRecording::open(uri) ;
 //TODO      semantic_tags = store.get_semantic_tags() ;
       }
+    else if (follow) {
+      qputenv("HDF5_USE_FILE_LOCKING", "FALSE") ;   // The writer has the file open
+      // Opened first so that the recording shares its SWMR access
+      swmr = browser::TailThread::open_swmr(uri) ;
+      if (swmr < 0)
+        throw std::runtime_error("Cannot follow a recording not being written for SWMR access") ;
+      recording = bsml::HDF5::Recording::create(uri.toStdString(), true) ;  // Read only
+      duration = recording->duration() ;
+      }
     else {                        //open ??
-      hdf5 = bsml::HDF5::Recording::create(uri.toStdString(), false) ;  // Open for reading, read/write
+      recording = bsml::HDF5::Recording::create(uri.toStdString(), false) ;  // Open for reading, read/write
       semantic_tags = browser::StringDictionary {  // Load from file
           {"http://standards/org/ontology#tag1", "Tag 1"},
           {"http://standards/org/ontology#tag2", "Tag 2"},
@@ -112,9 +283,15 @@ int main(int argc, char *argv[])
     exit(1) ;
     }
 
-  browser::Browser viewer(hdf5, start, end, semantic_tags) ; //TODO, annotator=wfdbAnnotation) ;
+  browser::Browser viewer(recording, start, end, semantic_tags) ; //TODO, annotator=wfdbAnnotation) ;
+  if (follow) viewer.follow(uri, duration) ;
   viewer.show() ;
 
-  return app.exec() ;
+  int status = app.exec() ;
+  if (swmr >= 0) {                 // The file stays open until its last handle is closed
+    browser::RecordingLock lock ;
+    H5Fclose(swmr) ;
+    }
+  return status ;
 #endif
   }
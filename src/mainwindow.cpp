@@ -19,6 +19,7 @@
  *****************************************************************************/
 
 #include "mainwindow.h"
+#include "recordinglock.h"
 
 #include <QMetaType>
 #include <QMessageLogger>
@@ -78,39 +79,84 @@ void Ui::MainWindow::setupUi(QMainWindow *mainWindow, QWidget *signalsWidget,
 
 SignalReadThread::SignalReadThread(bsml::Signal::Ptr signal, bsml::Interval::Ptr interval,
 /*======================================================================================*/
-                                   ChartPlot *plotter)
+                                   ChartPlot *plotter, SignalOverview::Ptr overview, int pixels)
 : QObject(),
   m_signal(signal),
   m_interval(interval),
+  m_overview(overview),
+  m_pixels(pixels),
   m_id(signal_uri(signal)),
   m_exit(true)
 {
   QObject::connect(this, &SignalReadThread::append_points, plotter, &ChartPlot::appendData) ;
+  QObject::connect(&m_thread, &QThread::started, this, &SignalReadThread::run) ;
+  QObject::connect(&m_thread, &QThread::finished, this, &SignalReadThread::finished) ;
   moveToThread(&m_thread) ;
   }
 
 void SignalReadThread::start(void)
 /*------------------------------*/
 {
-  m_thread.start() ;
   m_exit = false ;
+  m_thread.start() ;
+  }
+
+void SignalReadThread::run(void)
+/*----------------------------*/
+{
   emit append_points(m_id, nullptr) ;
   try {
-    while (!m_exit) {
-      auto d = m_signal->read(m_interval, 20000) ;
-      if (d->size() == 0) break ;
-      emit append_points(m_id, d) ;
-      break ;       // Read needs to be sequential, not absolute....
+    double duration = m_interval->duration() ;
+    if (m_overview == nullptr
+     || SignalOverview::use_raw(m_overview->rate(), duration, m_pixels)) {
+      int maxpoints = (m_overview == nullptr) ? 20000
+                    : (int)(m_overview->rate()*duration) + 2 ;
+      while (!m_exit) {
+        bsml::data::TimeSeries::Ptr d ;
+        {
+          RecordingLock lock ;
+          d = m_signal->read(m_interval, maxpoints) ;
+          }
+        if (m_exit || d->size() == 0) break ;
+        emit append_points(m_id, d) ;
+        break ;       // Read needs to be sequential, not absolute....
+        }
+      }
+    else {
+      double start = m_interval->start() ;
+      if (m_overview->end() < (start + duration)) build_overview() ;
+      if (!m_exit) emit append_points(m_id, m_overview->envelope(start, start + duration, m_pixels)) ;
       }
     }
   catch (std::exception &e) {
     // throw ;  //#######################################
     qCritical("Read thread: %s", e.what()) ;
+    emit read_done() ;
     m_thread.exit(1) ;
+    return ;
     }
+  emit read_done() ;
   m_thread.exit(0) ;
   }
 
+void SignalReadThread::build_overview(void)
+/*---------------------------------------*/
+{
+  while (!m_exit && !m_overview->complete()) {
+    // By sample position, as a chunk's times may round to overlap or leave a gap
+    size_t first = (size_t)m_overview->samples() ;
+    bsml::data::TimeSeries::Ptr d ;
+    {
+      RecordingLock lock ;    // For each chunk, so other readers interleave
+      d = m_signal->read(first, OVERVIEW_CHUNK) ;
+      }
+    if (d->size() == 0) m_overview->setComplete() ;
+    // A reader that has been stopped may still be finishing its last chunk
+    // as another starts on the same overview, so only one adds a chunk.
+    else                m_overview->appendSamples(d->data(), (long)first) ;
+    }
+  }
+
 void SignalReadThread::stop(void)
 /*-----------------------------*/
 {
@@ -122,3 +168,38 @@ bool SignalReadThread::wait(unsigned long time)
 {
   return m_thread.wait(time) ;
   }
+
+
+SignalTableThread::SignalTableThread(bsml::Recording::Ptr recording)
+/*================================================================*/
+: QObject(),
+  m_recording(recording)
+{
+  QObject::connect(&m_thread, &QThread::started, this, &SignalTableThread::run) ;
+  moveToThread(&m_thread) ;
+  }
+
+void SignalTableThread::start(void)
+/*-------------------------------*/
+{
+  m_thread.start() ;
+  }
+
+void SignalTableThread::run(void)
+/*-----------------------------*/
+{
+  try {
+    emit loaded(std::make_shared<SignalTable>(m_recording)) ;
+    }
+  catch (std::exception &e) {
+    qCritical("Signal metadata: %s", e.what()) ;
+    emit loaded(nullptr) ;
+    }
+  m_thread.exit(0) ;
+  }
+
+bool SignalTableThread::wait(unsigned long time)
+/*--------------------------------------------*/
+{
+  return m_thread.wait(time) ;
+  }
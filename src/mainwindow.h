@@ -27,6 +27,8 @@
 #include "signallist.h"
 #include "annotationlist.h"
 #include "scroller.h"
+#include "overview.h"
+#include "signaltable.h"
 
 #include <biosignalml/biosignalml.h>
 
@@ -35,6 +37,8 @@
 #include <QVBoxLayout>
 #include <QThread>
 
+#include <atomic>
+
 
 namespace Ui {
 
@@ -64,20 +68,63 @@ namespace browser {
    Q_OBJECT
 
    public:
+    /**
+     * Read a signal for display over an interval `pixels` wide.
+     *
+     * Raw samples are only read when they are sparse enough to be seen,
+     * otherwise data comes from the signal's overview, which is first
+     * built by a single chunked pass over the signal if need be.
+     */
     SignalReadThread(bsml::Signal::Ptr signal, bsml::Interval::Ptr interval,
-                     ChartPlot *plotter) ;
+                     ChartPlot *plotter, SignalOverview::Ptr overview=nullptr,
+                     int pixels=0) ;
     void start(void) ;
     void stop(void) ;
     bool wait(unsigned long time) ;
+    inline const QString &id(void) const { return m_id ; }
+
+   public slots:
+    void run(void) ;               //!< In m_thread, once started
 
    signals:
     void append_points(QString, const bsml::data::TimeSeries::Ptr &) ;
+    void read_done(void) ;         //!< Emitted by every reader, stopped or not
+    void finished(void) ;          //!< Once its thread has finished, so it can be deleted
 
    private:
+    void build_overview(void) ;
+
     bsml::Signal::Ptr m_signal ;
     bsml::Interval::Ptr m_interval ;
+    SignalOverview::Ptr m_overview ;
+    int m_pixels ;
     QString m_id ;
-    bool m_exit ;
+    std::atomic<bool> m_exit ;
+    QThread m_thread ;
+    } ;
+
+
+  /**
+   * Build a recording's SignalTable in the background.
+   */
+  class SignalTableThread : public QObject
+  /*====================================*/
+  {
+   Q_OBJECT
+
+   public:
+    SignalTableThread(bsml::Recording::Ptr recording) ;
+    void start(void) ;
+    bool wait(unsigned long time) ;
+
+   public slots:
+    void run(void) ;
+
+   signals:
+    void loaded(SignalTable::Ptr) ;
+
+   private:
+    bsml::Recording::Ptr m_recording ;
     QThread m_thread ;
     } ;
 
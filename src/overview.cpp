@@ -0,0 +1,183 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "overview.h"
+
+#include <QMutexLocker>
+
+#include <cmath>
+#include <algorithm>
+
+using namespace browser ;
+
+
+SignalOverview::SignalOverview(double rate, double start)
+/*=====================================================*/
+: m_rate(rate),
+  m_start(start),
+  m_samples(0),
+  m_complete(false),
+  m_levels(QList<Level>())
+{
+  }
+
+void SignalOverview::add_bucket(int level, float min, float max)
+/*------------------------------------------------------------*/
+{
+  if (level == m_levels.size()) m_levels.append(Level{QVector<float>(), QVector<float>(), min, max, 0}) ;
+  Level &l = m_levels[level] ;
+  if (l.pcount == 0) {
+    l.pmin = min ;
+    l.pmax = max ;
+    }
+  else {
+    if (min < l.pmin) l.pmin = min ;
+    if (max > l.pmax) l.pmax = max ;
+    }
+  l.pcount += 1 ;
+  if (l.pcount == ((level == 0) ? OVERVIEW_BASE : OVERVIEW_FACTOR)) {
+    l.mins.append(l.pmin) ;
+    l.maxs.append(l.pmax) ;
+    l.pcount = 0 ;
+    add_bucket(level + 1, l.pmin, l.pmax) ;  // May append to m_levels
+    }
+  }
+
+void SignalOverview::appendSamples(const std::vector<double> &data)
+/*---------------------------------------------------------------*/
+{
+  QMutexLocker lock(&m_mutex) ;
+  for (auto const &v : data) add_bucket(0, v, v) ;
+  m_samples += data.size() ;
+  }
+
+bool SignalOverview::appendSamples(const std::vector<double> &data, long first)
+/*---------------------------------------------------------------------------*/
+{
+  QMutexLocker lock(&m_mutex) ;
+  if (first != m_samples) return false ;
+  for (auto const &v : data) add_bucket(0, v, v) ;
+  m_samples += data.size() ;
+  return true ;
+  }
+
+double SignalOverview::end(void) const
+/*----------------------------------*/
+{
+  QMutexLocker lock(&m_mutex) ;
+  return m_start + m_samples/m_rate ;
+  }
+
+long SignalOverview::samples(void) const
+/*------------------------------------*/
+{
+  QMutexLocker lock(&m_mutex) ;
+  return m_samples ;
+  }
+
+bool SignalOverview::complete(void) const
+/*-------------------------------------*/
+{
+  QMutexLocker lock(&m_mutex) ;
+  return m_complete ;
+  }
+
+void SignalOverview::setComplete(void)
+/*----------------------------------*/
+{
+  QMutexLocker lock(&m_mutex) ;
+  for (int n = m_levels.size() - 1 ;  n >= 0 ;  --n) {  // Flush partially filled buckets
+    float min, max ;
+    if (pending_bucket(n, min, max)) {
+      m_levels[n].mins.append(min) ;
+      m_levels[n].maxs.append(max) ;
+      }
+    }
+  for (auto &l : m_levels) l.pcount = 0 ;
+  m_complete = true ;
+  }
+
+bool SignalOverview::pending_bucket(int level, float &min, float &max) const
+/*------------------------------------------------------------------------*/
+{
+  bool found = false ;
+  for (int n = 0 ;  n <= level ;  ++n) {   // Lower levels' partial buckets lie within this one
+    const Level &l = m_levels[n] ;
+    if (l.pcount > 0) {
+      if (!found || l.pmin < min) min = l.pmin ;
+      if (!found || l.pmax > max) max = l.pmax ;
+      found = true ;
+      }
+    }
+  return found ;
+  }
+
+bsml::data::TimeSeries::Ptr SignalOverview::envelope(double start, double end, int pixels) const
+/*--------------------------------------------------------------------------------------------*/
+{
+  QMutexLocker lock(&m_mutex) ;
+  std::vector<double> times ;
+  std::vector<double> values ;
+  if (m_levels.size() > 0 && pixels > 0 && end > start) {
+    double pixelduration = (end - start)/pixels ;
+    int level = 0 ;
+    double bucketduration = OVERVIEW_BASE/m_rate ;
+    while ((level + 1) < m_levels.size()
+        && m_levels[level + 1].mins.size() > 0
+        && bucketduration*OVERVIEW_FACTOR <= pixelduration) {
+      bucketduration *= OVERVIEW_FACTOR ;
+      level += 1 ;
+      }
+    const Level &l = m_levels[level] ;
+    float tailmin, tailmax ;        // Samples not yet in a full bucket at this level
+    bool tail = !m_complete && pending_bucket(level, tailmin, tailmax) ;
+    int count = l.mins.size() + (tail ? 1 : 0) ;
+    int first = std::max(0, (int)floor((start - m_start)/bucketduration)) ;
+    int last = std::min(count, (int)ceil((end - m_start)/bucketduration) + 1) ;
+    if (first < last) {
+      times.reserve(2*(last - first)) ;
+      values.reserve(2*(last - first)) ;
+      }
+    for (int n = first ;  n < last ;  ++n) {
+      if (n < l.mins.size()) {
+        double t = m_start + (n + 0.5)*bucketduration ;
+        times.push_back(t) ;
+        values.push_back(l.mins[n]) ;
+        times.push_back(t) ;
+        values.push_back(l.maxs[n]) ;
+        }
+      else {
+        double t = (m_start + n*bucketduration + m_start + m_samples/m_rate)/2.0 ;
+        times.push_back(t) ;
+        values.push_back(tailmin) ;
+        times.push_back(t) ;
+        values.push_back(tailmax) ;
+        }
+      }
+    }
+  return std::make_shared<bsml::data::TimeSeries>(times, values) ;
+  }
+
+bool SignalOverview::use_raw(double rate, double duration, int pixels)
+/*------------------------------------------------------------------*/
+{
+  return isnan(rate) || rate <= 0.0 || pixels <= 0
+      || rate*duration <= (double)RAW_PER_PIXEL*pixels ;
+  }
@@ -0,0 +1,118 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_OVERVIEW_H
+#define BROWSER_OVERVIEW_H
+
+#include "typedefs.h"
+
+#include <biosignalml/data/data.h>
+
+#include <QMutex>
+#include <QVector>
+
+#include <memory>
+#include <vector>
+
+
+namespace browser {
+
+  static const int OVERVIEW_BASE   = 16 ;      // Raw samples in a level 0 bucket
+  static const int OVERVIEW_FACTOR =  4 ;      // Buckets combined at each level up
+  static const int RAW_PER_PIXEL   =  4 ;      // Read raw samples up to this density
+  static const int OVERVIEW_CHUNK  = 1 << 20 ; // Samples per read when building
+
+
+  /**
+   * A min/max pyramid over a uniformly sampled signal.
+   *
+   * Level 0 holds the minimum and maximum of each OVERVIEW_BASE raw samples
+   * and every level above combines OVERVIEW_FACTOR buckets of the one below.
+   * A window `pixels` wide is drawn from the coarsest level that still has a
+   * bucket per pixel, so the points returned depend on the width of the view
+   * and not on the duration of the window.
+   *
+   * Buckets are appended by a reader thread while the GUI thread takes
+   * envelopes, so access is serialised. Samples not yet making up a full
+   * bucket are still included in an envelope as a final, partial bucket.
+   */
+  class SignalOverview
+  /*================*/
+  {
+   public:
+    typedef std::shared_ptr<SignalOverview> Ptr ;
+
+    SignalOverview(double rate, double start=0.0) ;
+
+    inline double rate(void) const { return m_rate ; }
+
+    /** Add the next block of raw samples. */
+    void appendSamples(const std::vector<double> &data) ;
+
+    /**
+     * Add a block of raw samples starting at sample `first`, only if it
+     * follows on from those already added.
+     */
+    bool appendSamples(const std::vector<double> &data, long first) ;
+
+    /** The time up to which raw samples have been added. */
+    double end(void) const ;
+
+    /** The number of raw samples added, so the index of the next. */
+    long samples(void) const ;
+
+    bool complete(void) const ;
+    void setComplete(void) ;
+
+    /**
+     * A min/max envelope of the overview.
+     *
+     * Each bucket contributes its minimum and maximum at the bucket's
+     * mid-time, so drawing the result as a polyline fills the range
+     * of the signal in each pixel column.
+     */
+    bsml::data::TimeSeries::Ptr envelope(double start, double end, int pixels) const ;
+
+    /** Are raw samples sparse enough to be worth reading for a window? */
+    static bool use_raw(double rate, double duration, int pixels) ;
+
+   private:
+    struct Level {
+      QVector<float> mins ;
+      QVector<float> maxs ;
+      float pmin ;                 //!< Bucket being accumulated
+      float pmax ;
+      int pcount ;
+      } ;
+
+    void add_bucket(int level, float min, float max) ;
+    bool pending_bucket(int level, float &min, float &max) const ;
+
+    double m_rate ;
+    double m_start ;
+    long m_samples ;               //!< Raw samples seen
+    bool m_complete ;
+    QList<Level> m_levels ;
+    mutable QMutex m_mutex ;
+    } ;
+
+  } ;
+
+#endif
@@ -0,0 +1,53 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_RECORDINGLOCK_H
+#define BROWSER_RECORDINGLOCK_H
+
+#include <QMutex>
+#include <QMutexLocker>
+
+
+namespace browser {
+
+  /**
+   * Serialise access to recordings.
+   *
+   * Neither the HDF5 library, which need not be built thread-safe, nor a
+   * recording's RDF graph can be used from several threads at once, so every
+   * call into a :class:`bsml::Recording` or :class:`bsml::Signal` that reads or
+   * changes it is made while holding this process-wide lock, whichever thread
+   * it is made from. Locks are held for a single call, or a single block of
+   * samples, so threads interleave. The lock isn't recursive, so a holder must
+   * not call a function that takes it, such as :meth:`EventIndex::read`.
+   */
+  class RecordingLock
+  /*===============*/
+  {
+   public:
+    RecordingLock() ;
+
+   private:
+    QMutexLocker m_locker ;
+    } ;
+
+  } ;
+
+#endif
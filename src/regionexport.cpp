@@ -0,0 +1,228 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "regionexport.h"
+#include "uritable.h"
+#include "recordinglock.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QThreadPool>
+#include <QUrl>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+
+using namespace browser ;
+
+
+SignalCopyTask::SignalCopyTask(RegionExportThread *exporter, const SignalTable::Entry &entry,
+/*=========================================================================================*/
+                               bsml::HDF5::Signal::Ptr output)
+: QRunnable(),
+  m_exporter(exporter),
+  m_entry(entry),
+  m_output(output)
+{
+  }
+
+void SignalCopyTask::run(void)
+/*--------------------------*/
+{
+  m_exporter->copy_signal(m_entry, m_output) ;
+  }
+
+
+ExportThread::ExportThread(bsml::Recording::Ptr recording, const QString &filename,
+/*==============================================================================*/
+                           float start, float end, const QVector<SignalTable::Entry> &exported)
+: QObject(),
+  m_recording(recording),
+  m_filename(filename),
+  m_start(std::min(start, end)),
+  m_end(std::max(start, end)),
+  m_signals(exported),
+  m_exit(true)
+{
+  QObject::connect(&m_thread, &QThread::started, this, &ExportThread::run) ;
+  moveToThread(&m_thread) ;
+  }
+
+ExportThread::~ExportThread()
+/*-------------------------*/
+{
+  }
+
+void ExportThread::start(void)
+/*--------------------------*/
+{
+  m_exit = false ;
+  m_thread.start() ;
+  }
+
+void ExportThread::stop(void)
+/*-------------------------*/
+{
+  m_exit = true ;
+  }
+
+bool ExportThread::wait(unsigned long time)
+/*---------------------------------------*/
+{
+  return m_thread.wait(time) ;
+  }
+
+
+RegionExportThread::RegionExportThread(bsml::Recording::Ptr recording, const QString &filename,
+/*===========================================================================================*/
+                                       float start, float end,
+                                       const QVector<SignalTable::Entry> &exported,
+                                       AnnotationBatch annotations, EventIndex::Ptr events)
+: ExportThread(recording, filename, start, end, exported),
+  m_annotations(annotations),
+  m_events(events),
+  m_copied(0)
+{
+  }
+
+void RegionExportThread::run(void)
+/*------------------------------*/
+{
+  QString error ;
+  try {
+    std::string uri = QUrl::fromLocalFile(QFileInfo(m_filename).absoluteFilePath()).toString().toStdString() ;
+    bsml::HDF5::Recording::Ptr output ;
+    {
+      RecordingLock lock ;
+      output = bsml::HDF5::Recording::create(rdf::URI(uri), m_filename.toStdString(), true) ;
+      output->set_duration(m_end - m_start) ;
+      output->set_source(m_recording->uri()) ;
+      output->set_description(QString("Region from %1 to %2 seconds of %3")
+                                .arg(m_start).arg(m_end)
+                                .arg(((std::string)m_recording->uri()).c_str()).toStdString()) ;
+      }
+
+    // Signals are read in parallel, each by a pool thread copying
+    // a chunk at a time, with progress reported as chunks are written.
+    QThreadPool pool ;
+    qint64 total = 0 ;
+    int n = 0 ;
+    for (auto const &e : m_signals) {
+      n += 1 ;
+      if (isnan(e.rate)) continue ;     // Only uniformly sampled signals
+      QString id = e.id.contains("://") ? QString("/signal/%1").arg(n) : e.id ;
+      bsml::HDF5::Signal::Ptr signal ;
+      {
+        RecordingLock lock ;
+        signal = output->new_signal(uri + id.toStdString(), e.signal->units(), e.rate) ;
+        signal->set_label(e.label.toStdString()) ;
+        }
+      total += (qint64)std::ceil(e.rate*m_end) - (qint64)std::ceil(e.rate*m_start) ;
+      pool.start(new SignalCopyTask(this, e, signal)) ;
+      }
+    int percent = -1 ;
+    while (!pool.waitForDone(EXPORT_PROGRESS)) {
+      int done = (total > 0) ? (int)((100*m_copied)/total) : 0 ;
+      if (done != percent) {
+        percent = done ;
+        emit progress(done) ;
+        }
+      }
+    {
+      RecordingLock lock ;
+      if (!m_exit) {
+        copy_annotations(output) ;
+        copy_events(output) ;
+        }
+      output->close() ;
+      }
+    QMutexLocker lock(&m_errorlock) ;
+    error = m_exit && m_error == "" ? "Export cancelled" : m_error ;
+    }
+  catch (std::exception &e) {
+    error = e.what() ;
+    }
+  if (error == "") emit progress(100) ;
+  else             QFile::remove(m_filename) ;   // Don't leave a partial export
+  emit finished(error) ;
+  m_thread.exit(0) ;
+  }
+
+void RegionExportThread::copy_signal(const SignalTable::Entry &entry, bsml::HDF5::Signal::Ptr output)
+/*-------------------------------------------------------------------------------------------------*/
+{
+  try {
+    // Copy by sample index so chunks neither overlap nor leave gaps,
+    // as they can when time windows are rounded to samples.
+    qint64 pos = (qint64)std::ceil(entry.rate*m_start) ;
+    qint64 last = (qint64)std::ceil(entry.rate*m_end) ;    // Exclusive
+    while (!m_exit && pos < last) {
+      RecordingLock lock ;      // Held for a chunk's read and write
+      auto d = entry.signal->read((size_t)pos, std::min((qint64)EXPORT_CHUNK, last - pos)) ;
+      if (d->size() == 0) break ;
+      output->extend(d->data()) ;
+      m_copied += d->size() ;
+      pos += d->size() ;
+      }
+    }
+  catch (std::exception &e) {
+    QMutexLocker lock(&m_errorlock) ;
+    if (m_error == "") m_error = QString("%1: %2").arg(entry.id, e.what()) ;
+    m_exit = true ;
+    }
+  }
+
+void RegionExportThread::copy_annotations(bsml::Recording::Ptr output)
+/*------------------------------------------------------------------*/
+{
+  if (m_annotations == nullptr) return ;
+  auto uri = output->uri() ;
+  for (auto const &a : *m_annotations) {
+    float end = isnan(a.end) ? a.start : a.end ;
+    if (m_exit) break ;
+    if (end < m_start || a.start > m_end) continue ;
+    float start = std::max(a.start, m_start) - m_start ;
+    double duration = isnan(a.end) ? 0.0 : std::min(end, m_end) - m_start - start ;
+    auto segment = bsml::Segment::create(uri.make_URI(), uri, output->new_interval(start, duration)) ;
+    std::set<rdf::Node> taglist ;
+    for (auto t : a.tags) taglist.insert(rdf::URI(UriTable::uri(t).toStdString())) ;
+    auto annotation = bsml::Annotation::create(uri.make_URI(), segment, a.text.toStdString(), taglist) ;
+    output->add_resource<bsml::Segment>(segment) ;
+    output->add_resource<bsml::Annotation>(annotation) ;
+    }
+  }
+
+void RegionExportThread::copy_events(bsml::Recording::Ptr output)
+/*-------------------------------------------------------------*/
+{
+  if (m_events == nullptr) return ;
+  auto uri = output->uri() ;
+  for (auto const &n : m_events->events(-1)) {    // In time order
+    if (m_exit || m_events->start(n) > m_end) break ;
+    double end = m_events->start(n) + m_events->duration(n) ;
+    if (end < m_start) continue ;
+    double start = std::max(m_events->start(n), (double)m_start) - m_start ;
+    double duration = std::min(end, (double)m_end) - m_start - start ;
+    auto type = rdf::URI(m_events->types().at(m_events->type(n)).toStdString()) ;
+    auto event = bsml::Event::create(uri.make_URI(), type, output->new_interval(start, duration)) ;
+    output->add_resource<bsml::Event>(event) ;
+    }
+  }
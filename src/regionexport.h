@@ -0,0 +1,147 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_REGIONEXPORT_H
+#define BROWSER_REGIONEXPORT_H
+
+#include "annotationlist.h"
+#include "eventindex.h"
+#include "signaltable.h"
+
+#include <biosignalml/biosignalml.h>
+#include <biosignalml/data/hdf5.h>
+
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <QMutex>
+#include <QRunnable>
+
+#include <atomic>
+
+
+namespace browser {
+
+  static const int EXPORT_CHUNK = 65536 ;      // Samples copied from a signal at a time
+  static const int EXPORT_PROGRESS = 100 ;     // Msecs between progress reports
+
+
+  /**
+   * Export signals over a region of a recording, in a separate thread.
+   *
+   * Derived classes write a particular format from :meth:`run`, emitting
+   * :meth:`progress` as they go and :meth:`finished` when done, with an
+   * empty error string if the export succeeded.
+   */
+  class ExportThread : public QObject
+  /*===============================*/
+  {
+   Q_OBJECT
+
+   public:
+    ExportThread(bsml::Recording::Ptr recording, const QString &filename,
+                 float start, float end, const QVector<SignalTable::Entry> &exported) ;
+    virtual ~ExportThread() ;
+    void start(void) ;
+    void stop(void) ;
+    bool wait(unsigned long time) ;
+
+   public slots:
+    virtual void run(void) = 0 ;
+
+   signals:
+    void progress(int) ;           //!< Percentage exported
+    void finished(const QString &error) ;
+
+   protected:
+    bsml::Recording::Ptr m_recording ;
+    QString m_filename ;
+    float m_start ;
+    float m_end ;
+    QVector<SignalTable::Entry> m_signals ;
+    std::atomic<bool> m_exit ;
+    QThread m_thread ;
+    } ;
+
+
+  class RegionExportThread ;
+
+  /**
+   * Copy a signal as part of an export, in a pool thread.
+   */
+  class SignalCopyTask : public QRunnable
+  /*===================================*/
+  {
+   public:
+    SignalCopyTask(RegionExportThread *exporter, const SignalTable::Entry &entry,
+                   bsml::HDF5::Signal::Ptr output) ;
+    void run(void) ;
+
+   private:
+    RegionExportThread *m_exporter ;
+    SignalTable::Entry m_entry ;
+    bsml::HDF5::Signal::Ptr m_output ;
+    } ;
+
+
+  /**
+   * Export a region of a recording as a new BSML (HDF5) recording.
+   *
+   * Signals are copied by sample index in chunks of at most :data:`EXPORT_CHUNK`
+   * samples, with a pool of worker threads each copying a signal. A chunk is
+   * read and written while holding the :class:`RecordingLock`, so at most
+   * one chunk per worker is held in memory, however long the region or
+   * however many signals are exported.
+   *
+   * Annotations and events overlapping the region are copied with times
+   * made relative to its start, and the new recording's source is set to
+   * the original.
+   */
+  class RegionExportThread : public ExportThread
+  /*==========================================*/
+  {
+   Q_OBJECT
+
+   public:
+    RegionExportThread(bsml::Recording::Ptr recording, const QString &filename,
+                       float start, float end,
+                       const QVector<SignalTable::Entry> &exported,
+                       AnnotationBatch annotations, EventIndex::Ptr events) ;
+
+    /** Copy one signal's samples; called by worker threads. */
+    void copy_signal(const SignalTable::Entry &entry, bsml::HDF5::Signal::Ptr output) ;
+
+   public slots:
+    void run(void) ;
+
+   private:
+    void copy_annotations(bsml::Recording::Ptr output) ;
+    void copy_events(bsml::Recording::Ptr output) ;
+
+    AnnotationBatch m_annotations ;
+    EventIndex::Ptr m_events ;
+    std::atomic<qint64> m_copied ;   //!< Samples written so far
+    QMutex m_errorlock ;             //!< Guards m_error
+    QString m_error ;                //!< First error from a worker
+    } ;
+
+  } ;
+
+#endif
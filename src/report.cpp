@@ -0,0 +1,279 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "report.h"
+#include "batchrender.h"
+#include "uritable.h"
+#include "recordinglock.h"
+#include "logging.h"
+
+#include <QPageLayout>
+#include <QPageSize>
+#include <QPainter>
+#include <QPdfWriter>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+
+using namespace browser ;
+
+
+static const int REPORT_DPI = 96 ;      // Chart pixels per inch on a page
+
+
+ReportPages::ReportPages(int count, int ahead)
+/*==========================================*/
+: m_count(count),
+  m_ahead(ahead),
+  m_next(0),
+  m_writing(0),
+  m_aborted(false),
+  m_pages(QHash<int, std::shared_ptr<QPicture>>())
+{
+  }
+
+int ReportPages::claim(void)
+/*------------------------*/
+{
+  QMutexLocker lock(&m_mutex) ;
+  while (!m_aborted && m_next < m_count && m_next >= (m_writing + m_ahead))
+    m_changed.wait(&m_mutex) ;
+  if (m_aborted || m_next >= m_count) return -1 ;
+  return m_next++ ;
+  }
+
+void ReportPages::done(int page, std::shared_ptr<QPicture> picture)
+/*---------------------------------------------------------------*/
+{
+  QMutexLocker lock(&m_mutex) ;
+  m_pages.insert(page, picture) ;
+  m_changed.wakeAll() ;
+  }
+
+std::shared_ptr<QPicture> ReportPages::take(int page)
+/*-------------------------------------------------*/
+{
+  QMutexLocker lock(&m_mutex) ;
+  m_writing = page ;
+  m_changed.wakeAll() ;                  // Allow pages further ahead to be claimed
+  while (!m_aborted && !m_pages.contains(page)) m_changed.wait(&m_mutex) ;
+  if (m_aborted) return nullptr ;
+  return m_pages.take(page) ;
+  }
+
+void ReportPages::abort(void)
+/*-------------------------*/
+{
+  QMutexLocker lock(&m_mutex) ;
+  m_aborted = true ;
+  m_pages.clear() ;
+  m_changed.wakeAll() ;
+  }
+
+
+ReportPageThread::ReportPageThread(const QString &id, ReportPages *pages, SignalTable::Ptr table,
+/*=============================================================================================*/
+                                   const QVector<ReportAnnotation> &annotations, float longest,
+                                   EventIndex::Ptr events, double pagetime, const QSize &size)
+: QObject(),
+  m_chart(),
+  m_pages(pages),
+  m_signals(table),
+  m_annotations(annotations),
+  m_longest(longest),
+  m_events(events),
+  m_eventorder(events != nullptr ? events->events(-1) : QVector<int>()),
+  m_pagetime(pagetime),
+  m_size(size)
+{
+  m_chart.setId(id) ;
+  QObject::connect(&m_thread, &QThread::started, this, &ReportPageThread::run) ;
+  moveToThread(&m_thread) ;
+  }
+
+void ReportPageThread::start(void)
+/*------------------------------*/
+{
+  m_thread.start() ;
+  }
+
+void ReportPageThread::run(void)
+/*----------------------------*/
+{
+  int page ;
+  while ((page = m_pages->claim()) >= 0) {
+    std::shared_ptr<QPicture> picture = nullptr ;
+    try {
+      picture = draw_page(page) ;
+      }
+    catch (std::exception &e) {
+      qCritical("Page %d: %s", page + 1, e.what()) ;
+      }
+    m_pages->done(page, picture) ;
+    }
+  m_thread.exit(0) ;
+  }
+
+std::shared_ptr<QPicture> ReportPageThread::draw_page(int page)
+/*-----------------------------------------------------------*/
+{
+  double start = page*m_pagetime ;
+  double finish = start + m_pagetime ;
+  m_chart.clearTraces() ;
+  m_chart.resetAnnotations() ;
+  m_chart.setTimeRange(start, m_pagetime) ;
+
+  auto interval = bsml::Interval::create(rdf::URI(), start, m_pagetime) ;
+  int pixels = std::max(m_size.width() - (MARGIN_LEFT + MARGIN_RIGHT), 1) ;
+  for (auto const &e : m_signals->entries()) {
+    m_chart.addSignalTrace(e.id, e.label, e.units) ;
+    m_chart.appendData(e.id, BatchRenderer::read_window(e, interval, pixels)) ;
+    }
+
+  // Annotations are in start order so only those that could overlap are looked at
+  auto a = std::lower_bound(m_annotations.begin(), m_annotations.end(), start - m_longest,
+                            [](const ReportAnnotation &ann, double t) { return ann.start < t ; }) ;
+  for ( ;  a != m_annotations.end() && a->start < finish ;  ++a)
+    m_chart.addAnnotation(a->uri, a->start, a->end, a->text, a->tags) ;
+  if (m_events != nullptr) {
+    auto e = std::lower_bound(m_eventorder.begin(), m_eventorder.end(), start,
+                              [this](int n, double t) { return m_events->start(n) < t ; }) ;
+    for ( ;  e != m_eventorder.end() && m_events->start(*e) < finish ;  ++e) {
+      double t = m_events->start(*e) ;
+      m_chart.addAnnotation(m_events->uri(*e), t, t + m_events->duration(*e),
+                             UriTable::abbreviate(m_events->types().at(m_events->type(*e)))) ;
+      }
+    }
+
+  auto picture = std::make_shared<QPicture>() ;
+  m_chart.drawTile(picture.get(), m_size, QPoint()) ;
+  return picture ;
+  }
+
+bool ReportPageThread::wait(unsigned long time)
+/*-------------------------------------------*/
+{
+  return m_thread.wait(time) ;
+  }
+
+
+ReportGenerator::ReportGenerator(bsml::Recording::Ptr recording, double pagetime, int threads)
+/*==========================================================================================*/
+: m_recording(recording),
+  m_pagetime(pagetime),
+  m_threads(threads),
+  m_annotations(QVector<ReportAnnotation>()),
+  m_longest(0.0)
+{
+  }
+
+void ReportGenerator::read_annotations(void)
+/*----------------------------------------*/
+{
+  m_annotations.clear() ;
+  m_longest = 0.0 ;
+  decltype(m_recording->get_annotation_uris()) uris ;
+  {
+    RecordingLock lock ;
+    uris = m_recording->get_annotation_uris() ;
+    }
+  for (auto const &u : uris) {
+    RecordingLock lock ;
+    auto a = m_recording->get_annotation(u) ;
+    auto tm = a->time() ;
+    if (!tm->is_valid()) continue ;
+    ReportAnnotation ann{((std::string)u).c_str(), (float)tm->start(), NAN, a->comment().c_str(), QStringList()} ;
+    float d = (float)tm->duration() ;
+    if (!isnan(d) && d != 0.0) {
+      ann.end = ann.start + d ;
+      m_longest = std::max(m_longest, d) ;
+      }
+    for (auto const &t : a->tags()) ann.tags << ((std::string)t).c_str() ;
+    m_annotations.append(ann) ;
+    }
+  std::stable_sort(m_annotations.begin(), m_annotations.end(),
+                   [](const ReportAnnotation &a, const ReportAnnotation &b) { return a.start < b.start ; }) ;
+  }
+
+void ReportGenerator::write(const QString &filename)
+/*------------------------------------------------*/
+{
+  double duration ;
+  QString uri ;
+  {
+    RecordingLock lock ;
+    duration = m_recording->duration() ;
+    uri = ((std::string)m_recording->uri()).c_str() ;
+    }
+  if (isnan(duration) || duration <= 0.0)
+    throw std::runtime_error("Recording has no duration") ;
+  int count = (int)std::ceil(duration/m_pagetime - 1e-6) ;
+
+  auto table = std::make_shared<SignalTable>(m_recording) ;
+  read_annotations() ;
+  auto events = EventIndex::read(m_recording) ;
+
+  QPdfWriter pdf(filename) ;
+  pdf.setResolution(REPORT_DPI) ;
+  pdf.setPageSize(QPageSize(QPageSize::A4)) ;
+  pdf.setPageOrientation(QPageLayout::Landscape) ;
+  pdf.setPageMargins(QMarginsF(0, 0, 0, 0)) ;
+  pdf.setTitle(uri) ;
+  QSize size(pdf.width(), pdf.height()) ;
+
+  ReportPages pages(count, REPORT_AHEAD) ;
+  int threads = (m_threads > 0) ? m_threads : QThread::idealThreadCount() ;
+  threads = std::max(1, std::min(threads, count)) ;
+  QList<ReportPageThread *> workers ;
+  for (int n = 0 ;  n < threads ;  ++n)
+    workers.append(new ReportPageThread(uri, &pages, table, m_annotations, m_longest,
+                                        events, m_pagetime, size)) ;
+  for (auto const &w : workers) w->start() ;
+
+  QString error ;
+  QPainter painter ;
+  if (!painter.begin(&pdf)) {
+    error = QString("Cannot create %1").arg(filename) ;
+    pages.abort() ;
+    }
+  else {
+    for (int n = 0 ;  n < count ;  ++n) {
+      auto picture = pages.take(n) ;
+      if (n > 0) pdf.newPage() ;
+      if (picture != nullptr) painter.drawPicture(0, 0, *picture) ;
+      painter.setPen(QPen(textColour, 0)) ;
+      painter.drawText(QPointF(MARGIN_LEFT, size.height() - 8),
+                       QString("%1    %2 - %3 seconds    Page %4 of %5")
+                         .arg(uri).arg(n*m_pagetime).arg(std::min((n + 1)*m_pagetime, duration))
+                         .arg(n + 1).arg(count)) ;
+      }
+    painter.end() ;
+    }
+
+  for (auto const &w : workers) {
+    w->wait(ULONG_MAX) ;
+    delete w ;
+    }
+  if (error != "") throw std::runtime_error(error.toStdString()) ;
+  qCInfo(browserLog, "Wrote %d pages", count) ;
+  }
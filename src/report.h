@@ -0,0 +1,162 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_REPORT_H
+#define BROWSER_REPORT_H
+
+#include "chartplot.h"
+#include "eventindex.h"
+#include "signaltable.h"
+
+#include <biosignalml/biosignalml.h>
+
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QPicture>
+#include <QSize>
+#include <QString>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <memory>
+
+
+namespace browser {
+
+  static const double REPORT_PAGE_TIME = 30.0 ;  // Default seconds on a page
+  static const int REPORT_AHEAD = 16 ;           // Pages drawn ahead of the one being written
+
+
+  /**
+   * Pages of a report being drawn by several threads and written in order.
+   *
+   * Page numbers are handed out in order but never more than `ahead` past
+   * the page waiting to be written, which bounds the pages held in memory.
+   */
+  class ReportPages
+  /*=============*/
+  {
+   public:
+    ReportPages(int count, int ahead) ;
+
+    /** The next page to draw, or -1 when there are none left. */
+    int claim(void) ;
+    void done(int page, std::shared_ptr<QPicture> picture) ;
+    /** Wait for a page to be drawn, or return nullptr if aborted. */
+    std::shared_ptr<QPicture> take(int page) ;
+    void abort(void) ;
+
+   private:
+    int m_count ;
+    int m_ahead ;
+    int m_next ;                   //!< Page to claim
+    int m_writing ;                //!< Page being waited for
+    bool m_aborted ;
+    QHash<int, std::shared_ptr<QPicture>> m_pages ;
+    QMutex m_mutex ;
+    QWaitCondition m_changed ;
+    } ;
+
+
+  /**
+   * An annotation as shown in a report.
+   */
+  struct ReportAnnotation
+  /*===================*/
+  {
+    QString uri ;
+    float start ;
+    float end ;
+    QString text ;
+    QStringList tags ;
+    } ;
+
+
+  /**
+   * Draw report pages, with a :class:`ChartRenderer` of its own,
+   * in a separate thread.
+   */
+  class ReportPageThread : public QObject
+  /*===================================*/
+  {
+   Q_OBJECT
+
+   public:
+    ReportPageThread(const QString &id, ReportPages *pages, SignalTable::Ptr table,
+                     const QVector<ReportAnnotation> &annotations, float longest,
+                     EventIndex::Ptr events, double pagetime, const QSize &size) ;
+    void start(void) ;
+    bool wait(unsigned long time) ;
+
+   public slots:
+    void run(void) ;
+
+   private:
+    std::shared_ptr<QPicture> draw_page(int page) ;
+
+    ChartRenderer m_chart ;
+    ReportPages *m_pages ;
+    SignalTable::Ptr m_signals ;
+    const QVector<ReportAnnotation> &m_annotations ;  //!< In start time order
+    float m_longest ;              //!< Duration of the longest annotation
+    EventIndex::Ptr m_events ;
+    QVector<int> m_eventorder ;    //!< Event positions in time order
+    double m_pagetime ;
+    QSize m_size ;
+    QThread m_thread ;
+    } ;
+
+
+  /**
+   * Write a whole recording as a PDF report of fixed-duration pages, for
+   * the `--report` option.
+   *
+   * Each A4 landscape page is a chart of all signals, with annotations and
+   * events, drawn by one of a pool of :class:`ReportPageThread`, each reading
+   * its own page's data. Pages are drawn as pictures, up to
+   * :data:`REPORT_AHEAD` pages in advance, and then written to the PDF
+   * in order.
+   */
+  class ReportGenerator
+  /*=================*/
+  {
+   public:
+    ReportGenerator(bsml::Recording::Ptr recording, double pagetime=REPORT_PAGE_TIME,
+                    int threads=0) ;
+
+    /** Write the report, throwing a `std::runtime_error` if it can't be. */
+    void write(const QString &filename) ;
+
+   private:
+    void read_annotations(void) ;
+
+    bsml::Recording::Ptr m_recording ;
+    double m_pagetime ;
+    int m_threads ;
+    QVector<ReportAnnotation> m_annotations ;
+    float m_longest ;
+    } ;
+
+  } ;
+
+#endif
@@ -0,0 +1,335 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "repository.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QUrlQuery>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+using namespace browser ;
+
+
+static double little_endian_double(const char *data)
+/*================================================*/
+{
+  quint64 bits = qFromLittleEndian<quint64>(reinterpret_cast<const uchar *>(data)) ;
+  double value ;
+  std::memcpy(&value, &bits, sizeof(value)) ;
+  return value ;
+  }
+
+
+BlockCache::BlockCache(const QString &directory, qint64 maxbytes)
+/*=============================================================*/
+: m_directory(directory),
+  m_maxbytes(maxbytes),
+  m_bytes(0)
+{
+  QDir().mkpath(directory) ;
+  for (auto const &f : QDir(directory).entryInfoList(QStringList("*.block"), QDir::Files))
+    m_bytes += f.size() ;
+  }
+
+QString BlockCache::default_directory(void)
+/*---------------------------------------*/
+{
+  return QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("blocks") ;
+  }
+
+QString BlockCache::path(const QString &key) const
+/*----------------------------------------------*/
+{
+  QString hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex() ;
+  return QDir(m_directory).filePath(hash + ".block") ;
+  }
+
+bool BlockCache::get(const QString &key, QByteArray &data) const
+/*------------------------------------------------------------*/
+{
+  QFile file(path(key)) ;
+  if (!file.open(QIODevice::ReadOnly)) return false ;
+  data = file.readAll() ;
+  file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime) ;  // Recently used
+  return true ;
+  }
+
+void BlockCache::put(const QString &key, const QByteArray &data)
+/*------------------------------------------------------------*/
+{
+  QSaveFile file(path(key)) ;   // Renamed into place when committed
+  if (!file.open(QIODevice::WriteOnly)
+   || file.write(data) != data.size()
+   || !file.commit()) {
+    qWarning("Cannot cache block in %s", qPrintable(m_directory)) ;
+    return ;
+    }
+  QMutexLocker lock(&m_mutex) ;
+  m_bytes += data.size() ;
+  if (m_bytes > m_maxbytes) evict() ;
+  }
+
+void BlockCache::evict(void)
+/*------------------------*/
+{
+  // Recount, as other browsers may share the directory, then remove the
+  // least recently used blocks until well under the limit, so that
+  // eviction isn't needed again straight away.
+  auto blocks = QDir(m_directory).entryInfoList(QStringList("*.block"), QDir::Files,
+                                                QDir::Time | QDir::Reversed) ;  // Oldest first
+  m_bytes = 0 ;
+  for (auto const &f : blocks) m_bytes += f.size() ;
+  qint64 target = m_maxbytes - m_maxbytes/10 ;
+  for (auto const &f : blocks) {
+    if (m_bytes <= target) break ;
+    if (QFile::remove(f.filePath())) m_bytes -= f.size() ;
+    }
+  }
+
+
+RepositoryClient::RepositoryClient()
+/*================================*/
+: QObject(),
+  m_network(nullptr)
+{
+  QObject::connect(&m_thread, &QThread::started, this, &RepositoryClient::started) ;
+  moveToThread(&m_thread) ;
+  m_thread.start() ;
+  }
+
+RepositoryClient::~RepositoryClient()
+/*---------------------------------*/
+{
+  m_thread.quit() ;
+  m_thread.wait() ;
+  }
+
+void RepositoryClient::started(void)
+/*--------------------------------*/
+{
+  m_network = new QNetworkAccessManager(this) ;  // In the client's thread
+  }
+
+QVector<QByteArray> RepositoryClient::get(const QList<QUrl> &urls, const QByteArray &accept)
+/*----------------------------------------------------------------------------------------*/
+{
+  if (urls.isEmpty()) return QVector<QByteArray>() ;
+  auto fetch = std::make_shared<Fetch>() ;
+  fetch->urls = urls ;
+  fetch->accept = accept ;
+  fetch->replies.resize(urls.size()) ;
+  fetch->remaining = urls.size() ;
+  QMetaObject::invokeMethod(this, [this, fetch]() { issue(fetch) ; }, Qt::QueuedConnection) ;
+
+  QMutexLocker lock(&fetch->mutex) ;
+  while (fetch->remaining > 0) {
+    if (!fetch->done.wait(&fetch->mutex, REMOTE_TIMEOUT))
+      throw std::runtime_error("Repository is not responding") ;
+    }
+  if (fetch->error != "") throw std::runtime_error(fetch->error.toStdString()) ;
+  return fetch->replies ;
+  }
+
+void RepositoryClient::issue(std::shared_ptr<Fetch> fetch)
+/*------------------------------------------------------*/
+{
+  for (int n = 0 ;  n < fetch->urls.size() ;  ++n) {
+    QNetworkRequest request(fetch->urls.at(n)) ;
+    request.setAttribute(QNetworkRequest::HttpPipeliningAllowedAttribute, true) ;
+    request.setRawHeader("Accept", fetch->accept) ;
+    QNetworkReply *reply = m_network->get(request) ;
+    connect(reply, &QNetworkReply::finished, this, [fetch, reply, n]() {
+      QMutexLocker lock(&fetch->mutex) ;
+      if (reply->error() != QNetworkReply::NoError) {
+        if (fetch->error == "")
+          fetch->error = QString("%1: %2").arg(reply->url().toString()).arg(reply->errorString()) ;
+        }
+      else {
+        fetch->replies[n] = reply->readAll() ;
+        }
+      fetch->remaining -= 1 ;
+      fetch->done.wakeAll() ;
+      reply->deleteLater() ;
+      }) ;
+    }
+  }
+
+
+RemoteSignal::RemoteSignal(const std::string &uri, const std::string &units, double rate, qint64 length,
+/*====================================================================================================*/
+                           const QString &version, RepositoryClient::Ptr client,
+                           std::shared_ptr<BlockCache> cache)
+: bsml::Signal(rdf::URI(uri), rdf::URI(units), rate),
+  m_url(QUrl(QString::fromStdString(uri))),
+  m_rate(rate),
+  m_length(length),
+  m_version(version),
+  m_client(client),
+  m_cache(cache)
+{
+  }
+
+bsml::data::TimeSeries::Ptr RemoteSignal::read(bsml::Interval::Ptr interval, ssize_t maxpoints)
+/*-------------------------------------------------------------------------------------------*/
+{
+  double start = interval->start() ;
+  double duration = interval->duration() ;
+  if (isnan(m_rate) || m_rate <= 0.0) return read_times(start, duration, maxpoints) ;
+
+  qint64 first = std::max((qint64)0, (qint64)std::ceil(start*m_rate)) ;
+  qint64 last = std::min(m_length, (qint64)std::ceil((start + duration)*m_rate)) ;
+  qint64 count = last - first ;
+  if (maxpoints >= 0 && count > maxpoints) count = maxpoints ;
+  if (count <= 0) return std::make_shared<bsml::data::TimeSeries>(std::vector<double>(), std::vector<double>()) ;
+  return read_samples(first, count) ;
+  }
+
+QString RemoteSignal::cache_key(const QUrl &url) const
+/*-------------------------------------------------*/
+{
+  return QString("%1|%2").arg(m_version, url.toString()) ;
+  }
+
+bsml::data::TimeSeries::Ptr RemoteSignal::read_samples(qint64 first, qint64 count)
+/*------------------------------------------------------------------------------*/
+{
+  qint64 firstblock = first/REMOTE_BLOCK ;
+  qint64 lastblock = (first + count - 1)/REMOTE_BLOCK ;
+  QVector<QByteArray> blocks(lastblock - firstblock + 1) ;
+  QList<QUrl> urls ;
+  QList<int> missing ;
+  for (qint64 b = firstblock ;  b <= lastblock ;  ++b) {
+    QUrl url(m_url) ;
+    QUrlQuery query ;
+    query.addQueryItem("offset", QString::number(b*REMOTE_BLOCK)) ;
+    query.addQueryItem("count", QString::number(std::min((qint64)REMOTE_BLOCK, m_length - b*REMOTE_BLOCK))) ;
+    url.setQuery(query) ;
+    if (!m_cache->get(cache_key(url), blocks[b - firstblock])) {
+      urls.append(url) ;
+      missing.append(b - firstblock) ;
+      }
+    }
+  // Uncached blocks are requested together
+  QVector<QByteArray> replies = m_client->get(urls) ;
+  for (int n = 0 ;  n < missing.size() ;  ++n) {
+    blocks[missing[n]] = replies[n] ;
+    m_cache->put(cache_key(urls[n]), replies[n]) ;
+    }
+
+  std::vector<double> times ;
+  std::vector<double> values ;
+  times.reserve(count) ;
+  values.reserve(count) ;
+  for (qint64 n = first ;  n < (first + count) ;  ++n) {
+    const QByteArray &block = blocks[n/REMOTE_BLOCK - firstblock] ;
+    qint64 offset = sizeof(double)*(n % REMOTE_BLOCK) ;
+    if ((offset + (qint64)sizeof(double)) > block.size())
+      throw std::runtime_error("Short block of samples from repository") ;
+    times.push_back(n/m_rate) ;
+    values.push_back(little_endian_double(block.constData() + offset)) ;
+    }
+  return std::make_shared<bsml::data::TimeSeries>(times, values) ;
+  }
+
+bsml::data::TimeSeries::Ptr RemoteSignal::read_times(double start, double duration, ssize_t maxpoints)
+/*--------------------------------------------------------------------------------------------------*/
+{
+  QUrl url(m_url) ;
+  QUrlQuery query ;
+  query.addQueryItem("start", QString::number(start, 'g', 17)) ;
+  query.addQueryItem("duration", QString::number(duration, 'g', 17)) ;
+  if (maxpoints >= 0) query.addQueryItem("maxpoints", QString::number(maxpoints)) ;
+  url.setQuery(query) ;
+  QByteArray data ;
+  if (!m_cache->get(cache_key(url), data)) {
+    data = m_client->get(QList<QUrl>{url})[0] ;
+    m_cache->put(cache_key(url), data) ;
+    }
+
+  int points = data.size()/(2*sizeof(double)) ;
+  std::vector<double> times ;
+  std::vector<double> values ;
+  times.reserve(points) ;
+  values.reserve(points) ;
+  for (int n = 0 ;  n < points ;  ++n) {
+    times.push_back(little_endian_double(data.constData() + 2*n*sizeof(double))) ;
+    values.push_back(little_endian_double(data.constData() + (2*n + 1)*sizeof(double))) ;
+    }
+  return std::make_shared<bsml::data::TimeSeries>(times, values) ;
+  }
+
+
+RemoteRecording::RemoteRecording(const std::string &uri)
+/*====================================================*/
+: bsml::Recording(rdf::URI(uri)),
+  m_client(nullptr),
+  m_cache(nullptr)
+{
+  }
+
+RemoteRecording::Ptr RemoteRecording::open(const QString &uri)
+/*----------------------------------------------------------*/
+{
+  auto client = std::make_shared<RepositoryClient>() ;
+  QByteArray json = client->get(QList<QUrl>{QUrl(uri)}, "application/json")[0] ;
+  QJsonParseError error ;
+  QJsonObject metadata = QJsonDocument::fromJson(json, &error).object() ;
+  if (error.error != QJsonParseError::NoError || metadata.isEmpty())
+    throw std::runtime_error(QString("Invalid metadata for %1").arg(uri).toStdString()) ;
+
+  // Blocks are only reused while the repository reports the same version
+  QString version = metadata["version"].isUndefined() ? metadata["modified"].toVariant().toString()
+                                                      : metadata["version"].toVariant().toString() ;
+
+  // The recording isn't shared until it's returned, so needs no RecordingLock
+  auto recording = std::make_shared<RemoteRecording>(uri.toStdString()) ;
+  recording->m_client = client ;
+  recording->m_cache = std::make_shared<BlockCache>() ;
+  if (metadata["duration"].isDouble()) recording->set_duration(metadata["duration"].toDouble()) ;
+  for (auto const &s : metadata["signals"].toArray()) {
+    QJsonObject o = s.toObject() ;
+    QString signaluri = QUrl(uri).resolved(QUrl(o["uri"].toString())).toString() ;
+    double rate = o["rate"].isDouble() ? o["rate"].toDouble() : NAN ;
+    auto signal = std::make_shared<RemoteSignal>(signaluri.toStdString(),
+                                                 o["units"].toString().toStdString(),
+                                                 rate, (qint64)o["length"].toDouble(),
+                                                 version, client, recording->m_cache) ;
+    signal->set_label(o["label"].toString().toStdString()) ;
+    recording->add_resource<bsml::Signal>(signal) ;
+    }
+  return recording ;
+  }
+
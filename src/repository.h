@@ -0,0 +1,207 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_REPOSITORY_H
+#define BROWSER_REPOSITORY_H
+
+#include <biosignalml/biosignalml.h>
+#include <biosignalml/data/data.h>
+
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QNetworkAccessManager>
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <QUrl>
+#include <QVector>
+#include <QWaitCondition>
+
+#include <memory>
+
+
+namespace browser {
+
+  static const int REMOTE_BLOCK = 8192 ;       // Samples in a fetched and cached block
+  static const int REMOTE_TIMEOUT = 30000 ;    // Msecs to wait for a response
+  static const qint64 REMOTE_CACHE_BYTES = 1024*1024*1024 ;  // Disk used by cached blocks
+
+
+  /**
+   * Blocks of remote data kept on disk, so that revisiting part of a
+   * recording doesn't go back to the repository.
+   *
+   * Each block is a file named by a hash of its key and written
+   * atomically, so concurrent readers and writers need no locking.
+   * Reading a block marks it as recently used, and once the cache
+   * exceeds its size the least recently used blocks are removed.
+   */
+  class BlockCache
+  /*============*/
+  {
+   public:
+    BlockCache(const QString &directory=default_directory(), qint64 maxbytes=REMOTE_CACHE_BYTES) ;
+
+    static QString default_directory(void) ;
+
+    /** Read a block, returning false if it isn't cached. */
+    bool get(const QString &key, QByteArray &data) const ;
+    void put(const QString &key, const QByteArray &data) ;
+
+   private:
+    QString path(const QString &key) const ;
+    void evict(void) ;
+
+    QString m_directory ;
+    qint64 m_maxbytes ;
+    qint64 m_bytes ;               //!< Size of cached blocks, as last counted
+    QMutex m_mutex ;               //!< Guards m_bytes and eviction
+    } ;
+
+
+  /**
+   * Make HTTP requests to a repository from any thread.
+   *
+   * Requests are made by a network manager running in a thread of its
+   * own. Those made together by :meth:`get` are all issued at once, so
+   * they are pipelined and sent over parallel connections, and the caller
+   * waits for all of them. :meth:`get` must not be called from the
+   * client's own thread.
+   */
+  class RepositoryClient : public QObject
+  /*===================================*/
+  {
+   Q_OBJECT
+
+   public:
+    typedef std::shared_ptr<RepositoryClient> Ptr ;
+
+    RepositoryClient() ;
+    ~RepositoryClient() ;
+
+    /** Fetch URLs, throwing `std::runtime_error` if any request fails. */
+    QVector<QByteArray> get(const QList<QUrl> &urls, const QByteArray &accept="application/octet-stream") ;
+
+   private slots:
+    void started(void) ;
+
+   private:
+    struct Fetch {
+      QList<QUrl> urls ;
+      QByteArray accept ;
+      QVector<QByteArray> replies ;
+      int remaining ;
+      QString error ;
+      QMutex mutex ;
+      QWaitCondition done ;
+      } ;
+
+    void issue(std::shared_ptr<Fetch> fetch) ;
+
+    QNetworkAccessManager *m_network ;
+    QThread m_thread ;
+    } ;
+
+
+  /**
+   * A signal in a remote recording.
+   *
+   * `bsml::Signal::read` is virtual, so a :class:`RemoteRecording`'s
+   * `get_signal()`, which returns the signal registered with
+   * `add_resource`, reads through this class wherever a signal is read.
+   *
+   * Uniformly sampled signals are read a block of :data:`REMOTE_BLOCK`
+   * samples at a time, by sample range::
+   *
+   *   GET SIGNAL?offset=N&count=M
+   *
+   * returning M little-endian doubles. Blocks are kept in a
+   * :class:`BlockCache`, and the blocks a read needs that aren't cached
+   * are requested together. Other signals are read by time::
+   *
+   *   GET SIGNAL?start=T&duration=D&maxpoints=M
+   *
+   * returning (time, value) pairs of doubles, cached by query.
+   *
+   * Cache keys include the recording's version, so blocks of a recording
+   * that has changed in the repository aren't reused.
+   */
+  class RemoteSignal : public bsml::Signal
+  /*====================================*/
+  {
+   public:
+    typedef std::shared_ptr<RemoteSignal> Ptr ;
+
+    RemoteSignal(const std::string &uri, const std::string &units, double rate, qint64 length,
+                 const QString &version, RepositoryClient::Ptr client,
+                 std::shared_ptr<BlockCache> cache) ;
+
+    bsml::data::TimeSeries::Ptr read(bsml::Interval::Ptr interval, ssize_t maxpoints=-1) override ;
+
+   private:
+    bsml::data::TimeSeries::Ptr read_samples(qint64 first, qint64 count) ;
+    bsml::data::TimeSeries::Ptr read_times(double start, double duration, ssize_t maxpoints) ;
+    QString cache_key(const QUrl &url) const ;
+
+    QUrl m_url ;
+    double m_rate ;
+    qint64 m_length ;              //!< Samples in a uniform signal
+    QString m_version ;            //!< Of the recording, for cache keys
+    RepositoryClient::Ptr m_client ;
+    std::shared_ptr<BlockCache> m_cache ;
+    } ;
+
+
+  /**
+   * A recording held in a BioSignalML repository, for `http://` URIs.
+   *
+   * Its metadata is fetched once, when opened, as JSON from::
+   *
+   *   GET RECORDING  (Accept: application/json)
+   *
+   * giving the recording's `duration` and its `signals`, each with a
+   * `uri`, `label`, `units`, `rate` and `length` in samples, and optionally
+   * a `version` or `modified` time that changes when the recording does.
+   * Sample data is then read by each :class:`RemoteSignal`, with requests
+   * shared across signals by one :class:`RepositoryClient`.
+   *
+   * Each signal is registered with `add_resource`, so `get_signal()` returns
+   * the :class:`RemoteSignal` itself.
+   */
+  class RemoteRecording : public bsml::Recording
+  /*==========================================*/
+  {
+   public:
+    typedef std::shared_ptr<RemoteRecording> Ptr ;
+
+    RemoteRecording(const std::string &uri) ;
+
+    /** Open a recording, throwing `std::runtime_error` if it can't be. */
+    static Ptr open(const QString &uri) ;
+
+   private:
+    RepositoryClient::Ptr m_client ;
+    std::shared_ptr<BlockCache> m_cache ;
+    } ;
+
+  } ;
+
+#endif
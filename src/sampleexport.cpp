@@ -0,0 +1,403 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "sampleexport.h"
+#include "recordinglock.h"
+
+#include <QFileInfo>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+
+using namespace browser ;
+
+
+SampleBlockQueue::SampleBlockQueue(int capacity)
+/*============================================*/
+: m_blocks(QList<SampleBlockPtr>()),
+  m_capacity(capacity),
+  m_closed(false),
+  m_aborted(false)
+{
+  }
+
+bool SampleBlockQueue::put(SampleBlockPtr block)
+/*--------------------------------------------*/
+{
+  QMutexLocker lock(&m_mutex) ;
+  while (!m_aborted && m_blocks.size() >= m_capacity) m_notfull.wait(&m_mutex) ;
+  if (m_aborted) return false ;
+  m_blocks.append(block) ;
+  m_notempty.wakeOne() ;
+  return true ;
+  }
+
+SampleBlockPtr SampleBlockQueue::take(void)
+/*---------------------------------------*/
+{
+  QMutexLocker lock(&m_mutex) ;
+  while (!m_aborted && !m_closed && m_blocks.isEmpty()) m_notempty.wait(&m_mutex) ;
+  if (m_aborted || m_blocks.isEmpty()) return nullptr ;
+  m_notfull.wakeOne() ;
+  return m_blocks.takeFirst() ;
+  }
+
+void SampleBlockQueue::close(void)
+/*------------------------------*/
+{
+  QMutexLocker lock(&m_mutex) ;
+  m_closed = true ;
+  m_notempty.wakeAll() ;
+  }
+
+void SampleBlockQueue::abort(void)
+/*------------------------------*/
+{
+  QMutexLocker lock(&m_mutex) ;
+  m_aborted = true ;
+  m_blocks.clear() ;
+  m_notempty.wakeAll() ;
+  m_notfull.wakeAll() ;
+  }
+
+
+SampleWriter::SampleWriter(const QString &filename, const QVector<SignalTable::Entry> &exported)
+/*============================================================================================*/
+: m_file(filename),
+  m_signals(exported)
+{
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    throw std::runtime_error(QString("Cannot create %1: %2")
+                               .arg(filename, m_file.errorString()).toStdString()) ;
+  }
+
+SampleWriter::~SampleWriter()
+/*-------------------------*/
+{
+  }
+
+void SampleWriter::finish(void)
+/*---------------------------*/
+{
+  if (!m_file.flush())
+    throw std::runtime_error(m_file.errorString().toStdString()) ;
+  m_file.close() ;
+  }
+
+void SampleWriter::write_bytes(const QByteArray &bytes)
+/*---------------------------------------------------*/
+{
+  if (m_file.write(bytes) != bytes.size())
+    throw std::runtime_error(m_file.errorString().toStdString()) ;
+  }
+
+double SampleWriter::interpolate(const std::vector<double> &samples, qint64 first,
+/*------------------------------------------------------------------------------*/
+                                 double rate, double time)
+{
+  if (samples.size() == 0) return NAN ;
+  double posn = std::max(0.0, time*rate - first) ;
+  size_t n = (size_t)posn ;
+  if (n + 1 >= samples.size()) return samples.back() ;
+  return samples[n] + (posn - n)*(samples[n + 1] - samples[n]) ;
+  }
+
+
+CsvWriter::CsvWriter(const QString &filename, const QVector<SignalTable::Entry> &exported)
+/*======================================================================================*/
+: SampleWriter(filename, exported),
+  m_rate(0.0)
+{
+  QByteArray header("Time") ;
+  for (auto const &e : m_signals) {
+    QString heading = (e.units == "") ? e.label : QString("%1 (%2)").arg(e.label, e.units) ;
+    heading.replace("\"", "\"\"") ;
+    header.append(",\"").append(heading.toUtf8()).append("\"") ;
+    m_rate = std::max(m_rate, e.rate) ;
+    }
+  header.append("\n") ;
+  write_bytes(header) ;
+  }
+
+void CsvWriter::write(const SampleBlock &block)
+/*-------------------------------------------*/
+{
+  // Rows are on a grid from the export's start, continuing across blocks
+  qint64 first = (qint64)std::ceil(block.start*m_rate - 1e-6) ;
+  qint64 last = (qint64)std::ceil((block.start + block.duration)*m_rate - 1e-6) ;
+  QByteArray text ;
+  text.reserve((last - first)*(12 + 16*m_signals.size())) ;
+  for (qint64 r = first ; r < last ; ++r) {
+    double time = r/m_rate ;
+    text.append(QByteArray::number(time, 'f', 6)) ;
+    for (int s = 0 ; s < m_signals.size() ; ++s) {
+      double value = interpolate(block.samples.at(s), block.first.at(s), m_signals.at(s).rate,
+                                 block.origin + time) ;
+      text.append(',') ;
+      if (!isnan(value)) text.append(QByteArray::number(value, 'g', 8)) ;
+      }
+    text.append('\n') ;
+    }
+  write_bytes(text) ;
+  }
+
+
+EdfWriter::EdfWriter(const QString &filename, const QVector<SignalTable::Entry> &exported,
+/*======================================================================================*/
+                     const QVector<floatPair> &ranges, int records, const QString &recording)
+: SampleWriter(filename, exported),
+  m_samples(QVector<int>()),
+  m_ranges(ranges)
+{
+  int count = m_signals.size() ;
+  QByteArray header ;
+  header.reserve(256*(count + 1)) ;
+  header.append(field("0", 8)) ;
+  header.append(field("X", 80)) ;                // Patient
+  header.append(field(recording, 80)) ;
+  header.append(field("01.01.85", 8)) ;          // Start date and time aren't known
+  header.append(field("00.00.00", 8)) ;
+  header.append(field(QString::number(256*(count + 1)), 8)) ;
+  header.append(field("", 44)) ;
+  header.append(field(QString::number(records), 8)) ;
+  header.append(number(EDF_RECORD, 8)) ;
+  header.append(field(QString::number(count), 4)) ;
+
+  // Signal fields are stored field by field
+  for (auto const &e : m_signals) header.append(field(e.label, 16)) ;
+  for (int s = 0 ; s < count ; ++s) header.append(field("", 80)) ;
+  for (auto const &e : m_signals) header.append(field(e.units, 8)) ;
+  for (auto const &r : m_ranges) header.append(number(r.first, 8)) ;
+  for (auto const &r : m_ranges) header.append(number(r.second, 8)) ;
+  for (int s = 0 ; s < count ; ++s) header.append(field("-32768", 8)) ;
+  for (int s = 0 ; s < count ; ++s) header.append(field("32767", 8)) ;
+  for (int s = 0 ; s < count ; ++s) header.append(field("", 80)) ;
+  for (auto const &e : m_signals) {
+    m_samples.append(std::max(1, (int)std::round(e.rate*EDF_RECORD))) ;
+    header.append(field(QString::number(m_samples.last()), 8)) ;
+    }
+  for (int s = 0 ; s < count ; ++s) header.append(field("", 32)) ;
+  write_bytes(header) ;
+  }
+
+QByteArray EdfWriter::field(const QString &text, int width)
+/*-------------------------------------------------------*/
+{
+  QByteArray ascii = text.toLatin1().left(width) ;
+  return ascii.leftJustified(width, ' ') ;
+  }
+
+QByteArray EdfWriter::number(double value, int width)
+/*-------------------------------------------------*/
+{
+  for (int precision = width ;  precision > 1 ;  --precision) {
+    QString text = QString::number(value, 'g', precision) ;
+    if (text.size() <= width) return field(text, width) ;
+    }
+  return field(QString::number(value, 'g', 1), width) ;
+  }
+
+void EdfWriter::write(const SampleBlock &block)
+/*-------------------------------------------*/
+{
+  int records = (int)std::ceil(block.duration/EDF_RECORD - 1e-6) ;
+  QByteArray data ;
+  int size = 0 ;
+  for (auto n : m_samples) size += 2*n ;
+  data.reserve(records*size) ;
+  for (int r = 0 ; r < records ; ++r) {
+    for (int s = 0 ; s < m_signals.size() ; ++s) {
+      double pmin = m_ranges.at(s).first ;
+      double scale = 65535.0/(m_ranges.at(s).second - pmin) ;
+      int count = m_samples.at(s) ;
+      for (int n = 0 ; n < count ; ++n) {
+        double time = block.origin + block.start + (r + (double)n/count)*EDF_RECORD ;
+        double value = interpolate(block.samples.at(s), block.first.at(s), m_signals.at(s).rate, time) ;
+        int digital = isnan(value) ? -32768
+                    : std::min(32767, std::max(-32768, (int)std::lround((value - pmin)*scale) - 32768)) ;
+        data.append((char)(digital & 0xFF)) ;          // Little-endian
+        data.append((char)((digital >> 8) & 0xFF)) ;
+        }
+      }
+    }
+  write_bytes(data) ;
+  }
+
+
+SampleWriteThread::SampleWriteThread(SampleWriter *writer, SampleBlockQueue *queue)
+/*===============================================================================*/
+: QObject(),
+  m_writer(writer),
+  m_queue(queue)
+{
+  QObject::connect(&m_thread, &QThread::started, this, &SampleWriteThread::run) ;
+  moveToThread(&m_thread) ;
+  }
+
+void SampleWriteThread::start(void)
+/*-------------------------------*/
+{
+  m_thread.start() ;
+  }
+
+void SampleWriteThread::run(void)
+/*-----------------------------*/
+{
+  try {
+    SampleBlockPtr block ;
+    while ((block = m_queue->take()) != nullptr) m_writer->write(*block) ;
+    m_writer->finish() ;
+    }
+  catch (std::exception &e) {
+    m_error = e.what() ;
+    m_queue->abort() ;      // Stop the reader
+    }
+  m_thread.exit(0) ;
+  }
+
+bool SampleWriteThread::wait(unsigned long time)
+/*--------------------------------------------*/
+{
+  return m_thread.wait(time) ;
+  }
+
+
+SampleExportThread::SampleExportThread(bsml::Recording::Ptr recording, const QString &filename,
+/*===========================================================================================*/
+                                       float start, float end,
+                                       const QVector<SignalTable::Entry> &exported,
+                                       const QHash<QString, SignalOverview::Ptr> &overviews)
+: ExportThread(recording, filename, start, end, QVector<SignalTable::Entry>()),
+  m_overviews(overviews)
+{
+  for (auto const &e : exported) {
+    if (!isnan(e.rate)) m_signals.append(e) ;    // Only uniformly sampled signals
+    }
+  }
+
+bool SampleExportThread::handles(const QString &filename)
+/*-----------------------------------------------------*/
+{
+  QString suffix = QFileInfo(filename).suffix().toLower() ;
+  return suffix == "csv" || suffix == "edf" ;
+  }
+
+SampleWriter *SampleExportThread::create_writer(void)
+/*-------------------------------------------------*/
+{
+  if (QFileInfo(m_filename).suffix().toLower() == "csv")
+    return new CsvWriter(m_filename, m_signals) ;
+  QVector<floatPair> ranges ;
+  for (auto const &e : m_signals) {
+    if (m_exit) return nullptr ;
+    ranges.append(signal_range(e)) ;
+    }
+  int records = (int)std::ceil((m_end - m_start)/EDF_RECORD - 1e-6) ;
+  return new EdfWriter(m_filename, m_signals, ranges, records,
+                       ((std::string)m_recording->uri()).c_str()) ;
+  }
+
+floatPair SampleExportThread::signal_range(const SignalTable::Entry &entry)
+/*-----------------------------------------------------------------------*/
+{
+  float min = INFINITY ;
+  float max = -INFINITY ;
+  auto overview = m_overviews.value(entry.id, nullptr) ;
+  if (overview != nullptr && overview->end() >= m_end) {
+    auto envelope = overview->envelope(m_start, m_end, 1) ;
+    for (auto const &v : envelope->data()) {
+      min = std::min(min, (float)v) ;
+      max = std::max(max, (float)v) ;
+      }
+    }
+  if (min > max) {            // Read the region in chunks to find its range
+    double chunk = OVERVIEW_CHUNK/entry.rate ;
+    for (double start = m_start ;  !m_exit && start < m_end ;  start += chunk) {
+      RecordingLock lock ;
+      auto d = entry.signal->read(bsml::Interval::create(rdf::URI(), start,
+                                  std::min(chunk, m_end - start)), OVERVIEW_CHUNK) ;
+      if (d->size() == 0) break ;
+      for (auto const &v : d->data()) {
+        min = std::min(min, (float)v) ;
+        max = std::max(max, (float)v) ;
+        }
+      }
+    }
+  if (min > max) return floatPair(-1.0, 1.0) ;          // No data
+  else if (min == max) return floatPair(min - 1.0, max + 1.0) ;
+  else return floatPair(min, max) ;
+  }
+
+void SampleExportThread::run(void)
+/*------------------------------*/
+{
+  QString error ;
+  std::unique_ptr<SampleWriter> writer ;
+  try {
+    writer.reset(create_writer()) ;
+    }
+  catch (std::exception &e) {
+    error = e.what() ;
+    }
+  if (writer != nullptr) {
+    SampleBlockQueue queue(EXPORT_QUEUE) ;
+    SampleWriteThread writethread(writer.get(), &queue) ;
+    writethread.start() ;
+    double duration = m_end - m_start ;
+    double blocktime = EXPORT_BLOCK_RECORDS*EDF_RECORD ;
+    int blocks = (int)std::ceil(duration/blocktime - 1e-6) ;
+    try {
+      for (int n = 0 ;  n < blocks && !m_exit ;  ++n) {
+        auto block = std::make_shared<SampleBlock>() ;
+        block->origin = m_start ;
+        block->start = n*blocktime ;
+        block->duration = std::min(blocktime, duration - block->start) ;
+        double start = m_start + block->start ;
+        for (auto const &e : m_signals) {
+          // Read by sample index, up to and including the first sample
+          // of the next block, to interpolate across the boundary
+          qint64 first = std::max((qint64)0, (qint64)std::floor(start*e.rate)) ;
+          qint64 last = (qint64)std::floor((start + block->duration)*e.rate) + 1 ;
+          RecordingLock lock ;
+          block->samples.append(e.signal->read((size_t)first, last - first + 1)->data()) ;
+          block->first.append(first) ;
+          }
+        if (!queue.put(block)) break ;       // Writer has failed
+        emit progress((100*(n + 1))/blocks) ;
+        }
+      }
+    catch (std::exception &e) {
+      error = e.what() ;
+      m_exit = true ;
+      }
+    if (m_exit) queue.abort() ;
+    else        queue.close() ;
+    writethread.wait(ULONG_MAX) ;
+    writer.reset() ;                         // Closes the file
+    if (error == "") error = writethread.error() ;
+    }
+  if (error == "" && m_exit) error = "Export cancelled" ;
+  if (error != "") QFile::remove(m_filename) ;
+  emit finished(error) ;
+  m_thread.exit(0) ;
+  }
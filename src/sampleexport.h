@@ -0,0 +1,228 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_SAMPLEEXPORT_H
+#define BROWSER_SAMPLEEXPORT_H
+
+#include "regionexport.h"
+#include "overview.h"
+
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <memory>
+#include <vector>
+
+
+namespace browser {
+
+  static const double EDF_RECORD = 1.0 ;         // Seconds in an EDF data record
+  static const int EXPORT_BLOCK_RECORDS = 10 ;   // Records read from each signal at a time
+  static const int EXPORT_QUEUE = 4 ;            // Blocks read ahead of the writer
+
+
+  /**
+   * A block of samples from each exported signal, covering
+   * the same interval of time.
+   */
+  struct SampleBlock
+  /*==============*/
+  {
+    double origin ;                //!< Recording time of the export's start
+    double start ;                 //!< Seconds from the start of the export
+    double duration ;
+    QVector<std::vector<double>> samples ;   //!< One vector per signal
+    QVector<qint64> first ;        //!< Index in its signal of each vector's first sample
+    } ;
+
+  using SampleBlockPtr = std::shared_ptr<SampleBlock> ;
+
+
+  /**
+   * A bounded queue of blocks between a reader and a writer.
+   *
+   * :meth:`put` waits while the queue is full and :meth:`take` while it is
+   * empty. Once the queue is closed, :meth:`take` returns nullptr when it
+   * is empty; once aborted, :meth:`put` fails and :meth:`take` returns
+   * nullptr straight away.
+   */
+  class SampleBlockQueue
+  /*==================*/
+  {
+   public:
+    SampleBlockQueue(int capacity) ;
+
+    bool put(SampleBlockPtr block) ;
+    SampleBlockPtr take(void) ;
+    void close(void) ;
+    void abort(void) ;
+
+   private:
+    QList<SampleBlockPtr> m_blocks ;
+    int m_capacity ;
+    bool m_closed ;
+    bool m_aborted ;
+    QMutex m_mutex ;
+    QWaitCondition m_notfull ;
+    QWaitCondition m_notempty ;
+    } ;
+
+
+  /**
+   * Format sample blocks and write them to a file.
+   *
+   * A `std::runtime_error` is thrown if the file can't be written.
+   */
+  class SampleWriter
+  /*==============*/
+  {
+   public:
+    SampleWriter(const QString &filename, const QVector<SignalTable::Entry> &exported) ;
+    virtual ~SampleWriter() ;
+
+    virtual void write(const SampleBlock &block) = 0 ;
+    virtual void finish(void) ;
+
+    /**
+     * The value of a signal at a recording time, linearly interpolated between
+     * samples, where `first` is the signal index of `samples[0]`. A block's
+     * samples run to the first of the next block, so only the end of a
+     * signal holds its last value.
+     */
+    static double interpolate(const std::vector<double> &samples, qint64 first,
+                              double rate, double time) ;
+
+   protected:
+    void write_bytes(const QByteArray &bytes) ;
+
+    QFile m_file ;
+    QVector<SignalTable::Entry> m_signals ;
+    } ;
+
+
+  /**
+   * Write CSV, with a row of values for each sample time.
+   *
+   * Signals are aligned on the timebase of the fastest, with slower
+   * signals linearly interpolated.
+   */
+  class CsvWriter : public SampleWriter
+  /*=================================*/
+  {
+   public:
+    CsvWriter(const QString &filename, const QVector<SignalTable::Entry> &exported) ;
+    void write(const SampleBlock &block) ;
+
+   private:
+    double m_rate ;                //!< Of the fastest signal
+    } ;
+
+
+  /**
+   * Write EDF, with data records of :data:`EDF_RECORD` seconds.
+   *
+   * Each signal has a whole number of samples in a record; signals whose
+   * rate doesn't give this are resampled to the nearest that does.
+   */
+  class EdfWriter : public SampleWriter
+  /*=================================*/
+  {
+   public:
+    EdfWriter(const QString &filename, const QVector<SignalTable::Entry> &exported,
+              const QVector<floatPair> &ranges, int records, const QString &recording) ;
+    void write(const SampleBlock &block) ;
+
+   private:
+    static QByteArray field(const QString &text, int width) ;
+    static QByteArray number(double value, int width) ;
+
+    QVector<int> m_samples ;       //!< Per record, for each signal
+    QVector<floatPair> m_ranges ;  //!< Physical minimum and maximum
+    } ;
+
+
+  /**
+   * Format and write blocks from a queue, in a separate thread.
+   */
+  class SampleWriteThread : public QObject
+  /*====================================*/
+  {
+   Q_OBJECT
+
+   public:
+    SampleWriteThread(SampleWriter *writer, SampleBlockQueue *queue) ;
+    void start(void) ;
+    bool wait(unsigned long time) ;
+    inline const QString &error(void) const { return m_error ; }
+
+   public slots:
+    void run(void) ;
+
+   private:
+    SampleWriter *m_writer ;
+    SampleBlockQueue *m_queue ;
+    QString m_error ;
+    QThread m_thread ;
+    } ;
+
+
+  /**
+   * Export signals over a region as CSV or EDF, chosen by the
+   * file's extension.
+   *
+   * Blocks of :data:`EXPORT_BLOCK_RECORDS` seconds are read from each
+   * signal and queued for a :class:`SampleWriteThread`, so reading overlaps
+   * with formatting and writing and at most :data:`EXPORT_QUEUE` blocks are
+   * held in memory, however long the region.
+   *
+   * EDF needs the range of each signal before any data is written; this is
+   * taken from a signal's overview when it covers the region and otherwise
+   * found by first reading the signal.
+   */
+  class SampleExportThread : public ExportThread
+  /*==========================================*/
+  {
+   Q_OBJECT
+
+   public:
+    SampleExportThread(bsml::Recording::Ptr recording, const QString &filename,
+                       float start, float end,
+                       const QVector<SignalTable::Entry> &exported,
+                       const QHash<QString, SignalOverview::Ptr> &overviews) ;
+
+    /** Is a file's format one we export? */
+    static bool handles(const QString &filename) ;
+
+   public slots:
+    void run(void) ;
+
+   private:
+    SampleWriter *create_writer(void) ;
+    floatPair signal_range(const SignalTable::Entry &entry) ;
+
+    QHash<QString, SignalOverview::Ptr> m_overviews ;
+    } ;
+
+  } ;
+
+#endif
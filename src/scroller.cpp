@@ -19,6 +19,7 @@
  *****************************************************************************/
 
 #include "scroller.h"
+#include "recordinglock.h"
 
 using namespace browser ;
 
@@ -83,6 +84,26 @@ void Scroller::setup_slider(void)
   set_slidertime(m_ui.rec_end, duration) ;
   }
 
+void Scroller::extend_range(void)
+/*-----------------------------*/
+{
+  QScrollBar *sb = m_ui.segment ;
+  float duration ;
+  {
+    RecordingLock lock ;           // Being extended while it's followed
+    duration = (float)m_recording->duration() ;
+    }
+  if (duration == 0.0 || sb->isSliderDown()) return ;  // Until the slider is let go
+
+  int scrollwidth = 10000 ;
+  m_sliding = true ;            // So setting the value doesn't move_plot()
+  sb->setPageStep(scrollwidth*m_duration/duration) ;
+  sb->setMaximum(scrollwidth - sb->pageStep()) ;
+  sb->setValue(scrollwidth*m_start/duration) ;
+  m_sliding = false ;
+  set_slidertime(m_ui.rec_end, duration) ;
+  }
+
 void Scroller::stop_movetimer(void)
 /*-------------------------------*/
 {
@@ -40,6 +40,8 @@ namespace browser {
     Scroller(QWidget *parent, bsml::Recording::Ptr recording, float start, float duration) ;
 
     void setup_slider(void) ;
+    /** Update the slider for a recording that has grown, leaving the plot where it is. */
+    void extend_range(void) ;
     void timerEvent(QTimerEvent *event) ;
     void on_segment_valueChanged(int position) ;
     void on_segment_sliderReleased(void) ;
@@ -20,6 +20,8 @@
 
 #include "signallist.h"
 
+#include <algorithm>
+
 using namespace browser ;
 
 
@@ -37,15 +39,22 @@ static const QStringList HEADER{"", "Label", "Uri"} ;
 static const int         ID_COLUMN = 2 ;               // Uri is ID
 
 
-SignalModel::SignalModel(QObject *parent, bsml::Recording::Ptr recording)
-/*---------------------------------------------------------------------*/
+SignalModel::SignalModel(QObject *parent)
+/*-------------------------------------*/
 : QAbstractTableModel(parent),
   m_rows(SigList())
 {
-  for (auto const &u : recording->get_signal_uris()) {
-    auto s = recording->get_signal(u) ;
-    m_rows.append(SigInfo(true, QVariant(QString(s->label().c_str())), QVariant(signal_uri(s)))) ;
-    }
+  }
+
+void SignalModel::setSignals(const SignalTable::Ptr &table)
+/*-------------------------------------------------------*/
+{
+  beginResetModel() ;
+  m_rows.clear() ;
+  m_rows.reserve(table->size()) ;
+  for (auto const &e : table->entries())
+    m_rows.append(SigInfo(true, QVariant(e.label), QVariant(e.id))) ;
+  endResetModel() ;
   }
 
 int SignalModel::rowCount(const QModelIndex &index) const
@@ -116,8 +125,32 @@ Qt::ItemFlags SignalModel::flags(const QModelIndex &index) const
 void SignalModel::setVisibility(bool visible)
 /*-----------------------------------------*/
 {
-  for (auto r = 0 ;  r < m_rows.size() ;  ++r)
-    setData(createIndex(r, 0), visible ? Qt::Checked : Qt::Unchecked, Qt::CheckStateRole) ;
+  QStringList ids ;
+  for (auto const &r : m_rows) ids.append(std::get<ID_COLUMN>(r).toString()) ;
+  setRowsVisible(ids, visible) ;
+  }
+
+void SignalModel::setRowsVisible(const QStringList &ids, bool visible)
+/*------------------------------------------------------------------*/
+{
+  QSet<QString> wanted(ids.begin(), ids.end()) ;
+  QStringList changed ;
+  int first = m_rows.size() ;
+  int last = -1 ;
+  for (auto r = 0 ;  r < m_rows.size() ;  ++r) {
+    SigInfo &row = m_rows[r] ;
+    QString id = std::get<ID_COLUMN>(row).toString() ;
+    if (std::get<0>(row) != visible && wanted.contains(id)) {
+      std::get<0>(row) = visible ;
+      changed.append(id) ;
+      first = std::min(first, r) ;
+      last = r ;
+      }
+    }
+  if (changed.size() > 0) {
+    emit rowsVisible(changed, visible) ;
+    emit dataChanged(createIndex(first, 0), createIndex(last, 0)) ;
+    }
   }
 
 bool SignalModel::move_rows(int from, const QModelIndex &index)
@@ -137,11 +170,11 @@ bool SignalModel::move_rows(int from, const QModelIndex &index)
   }
 
 
-SignalList::SignalList(QWidget *parent, bsml::Recording::Ptr recording) //, annotator
-/*===================================================================*/
+SignalList::SignalList(QWidget *parent) //, annotator
+/*===================================*/
 : QWidget(parent),
-  m_recording(recording),
-  m_model(new SignalModel(parent, recording)),
+  m_signals(nullptr),
+  m_model(new SignalModel(parent)),
 // m_annotator(annotator),
   m_ui(Ui::SignalView())
 {
@@ -152,26 +185,24 @@ SignalList::SignalList(QWidget *parent, bsml::Recording::Ptr recording) //, anno
   // Connect m_model.moveRow slot and m_ui.signallist.?? signal
   }
 
+void SignalList::setSignals(const SignalTable::Ptr &table)
+/*------------------------------------------------------*/
+{
+  m_signals = table ;
+  m_model->setSignals(table) ;
+  }
+
 void SignalList::plot_signals(float start, float duration)
 /*------------------------------------------------------*/
 {
+  if (m_signals == nullptr) return ;
   auto interval = bsml::Interval::create(rdf::URI(), start, duration) ;
-  for (auto const &u : m_recording->get_signal_uris()) {
-    auto s = m_recording->get_signal(u) ;
-    QString uri = signal_uri(s) ;
+  for (auto const &e : m_signals->entries()) {   // Units are resolved by SignalTable
 // TODO    if (s->units() == uom::UNITS::AnnotationData.uri()) {
-// TODO      emit add_event_trace(uri, s->label().c_str(), m_annotator) ;
+// TODO      emit add_event_trace(e.id, e.label, m_annotator) ;
 // TODO      }
 // TODO    else {
-      QString units ;
-// TODO      try {
-// TODO        units = uom::RESOURCES[s->units()].label().c_str() ;
-// TODO        }
-// TODO      catch {
-        QString unit = ((std::string)s->units()).c_str() ;
-        units = unit.mid(unit.indexOf('#')+1) ;
-// TODO        }
-      emit add_signal_trace(uri, s->label().c_str(), units, true) ;
+      emit add_signal_trace(e.id, e.label, e.units, true) ;
       // , ymin=s.minValue, ymax=s.maxValue)
 // TODO      }
     }
@@ -22,6 +22,7 @@
 #define BROWSER_SIGNALLIST_H
 
 #include "typedefs.h"
+#include "signaltable.h"
 
 #include "ui_signalview.h"
 
@@ -29,6 +30,7 @@
 
 #include <QWidget>
 #include <QAbstractTableModel>
+#include <QSet>
 
 
 namespace browser {
@@ -42,7 +44,10 @@ namespace browser {
    Q_OBJECT
 
    public:
-    SignalModel(QObject *parent, bsml::Recording::Ptr recording) ;
+    SignalModel(QObject *parent) ;
+
+    /** Populate the model once a recording's signals are known. */
+    void setSignals(const SignalTable::Ptr &table) ;
 
     int rowCount(const QModelIndex &parent=QModelIndex()) const ;
     int columnCount(const QModelIndex &parent=QModelIndex()) const ;
@@ -55,9 +60,18 @@ namespace browser {
     void setVisibility(bool visible) ;
     bool move_rows(int from, const QModelIndex &index) ;
 
+    /**
+     * Show or hide several rows at once.
+     *
+     * There is a single `dataChanged` for the range of rows affected
+     * and a single `rowsVisible` with the ids that changed.
+     */
+    void setRowsVisible(const QStringList &ids, bool visible) ;
+
    signals:
     void rowVisible(QString, bool) ;   // id, state
     void rowMoved(QString, QString) ;  // from_id, to_id
+    void rowsVisible(QStringList, bool) ;  // ids, state
 
    private:
     typedef std::tuple<bool, QVariant, QVariant> SigInfo ;
@@ -73,8 +87,9 @@ namespace browser {
    Q_OBJECT
 
    public:
-    SignalList(QWidget *parent, bsml::Recording::Ptr recording) ; //, annotator) ;
+    SignalList(QWidget *parent) ; //, annotator) ;
 
+    void setSignals(const SignalTable::Ptr &table) ;
     void plot_signals(float start, float duration) ;
     const Ui::SignalView &ui(void) const { return m_ui ; }
     SignalModel *model(void) const { return m_model ; }
@@ -90,7 +105,7 @@ namespace browser {
    private:
     Ui::SignalView m_ui ;
     SignalModel *m_model ;
-    bsml::Recording::Ptr m_recording ;
+    SignalTable::Ptr m_signals ;
     } ;
 
   } ;
@@ -0,0 +1,69 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "signaltable.h"
+#include "signallist.h"
+#include "recordinglock.h"
+
+#include <cmath>
+
+using namespace browser ;
+
+
+SignalTable::SignalTable(bsml::Recording::Ptr recording)
+/*====================================================*/
+: m_entries(QVector<Entry>()),
+  m_index(QHash<QString, int>())
+{
+  RecordingLock lock ;
+  auto uris = recording->get_signal_uris() ;
+  m_entries.reserve(uris.size()) ;
+  for (auto const &u : uris) {
+    auto s = recording->get_signal(u) ;
+    Entry e ;
+    e.id = signal_uri(s) ;
+    e.label = s->label().c_str() ;
+// TODO    try {
+// TODO      units = uom::RESOURCES[s->units()].label().c_str() ;
+// TODO      }
+// TODO    catch {
+    QString unit = ((std::string)s->units()).c_str() ;
+    e.units = unit.mid(unit.indexOf('#')+1) ;
+// TODO      }
+    e.rate = s->rate() ;
+    if (e.rate <= 0.0) e.rate = NAN ;
+    e.signal = s ;
+    m_index.insert(e.id, m_entries.size()) ;
+    m_entries.append(e) ;
+    }
+  }
+
+int SignalTable::index(const QString &id) const
+/*-------------------------------------------*/
+{
+  return m_index.value(id, -1) ;
+  }
+
+bsml::Signal::Ptr SignalTable::signal(const QString &id) const
+/*----------------------------------------------------------*/
+{
+  int n = m_index.value(id, -1) ;
+  return (n >= 0) ? m_entries.at(n).signal : nullptr ;
+  }
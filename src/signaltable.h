@@ -0,0 +1,75 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_SIGNALTABLE_H
+#define BROWSER_SIGNALTABLE_H
+
+#include "typedefs.h"
+
+#include <biosignalml/biosignalml.h>
+
+#include <QHash>
+#include <QVector>
+
+#include <memory>
+
+
+namespace browser {
+
+  /**
+   * The signals of a recording.
+   *
+   * Signal metadata is read in one pass when a recording is opened
+   * and the resulting handles are then shared by the signal list,
+   * the chart and data readers, so that nothing goes back to the
+   * recording's metadata when plotting or scrolling.
+   */
+  class SignalTable
+  /*=============*/
+  {
+   public:
+    typedef std::shared_ptr<SignalTable> Ptr ;
+
+    struct Entry {
+      QString id ;                 //!< Signal URI relative to recording (see signal_uri())
+      QString label ;
+      QString units ;              //!< Abbreviated for display
+      double rate ;                //!< NAN if not uniformly sampled
+      bsml::Signal::Ptr signal ;
+      } ;
+
+    SignalTable(bsml::Recording::Ptr recording) ;
+
+    inline int size(void) const { return m_entries.size() ; }
+    inline const Entry &at(int n) const { return m_entries.at(n) ; }
+    inline const QVector<Entry> &entries(void) const { return m_entries ; }
+
+    /** The index of a signal's entry, or -1 if the id is unknown. */
+    int index(const QString &id) const ;
+    bsml::Signal::Ptr signal(const QString &id) const ;
+
+   private:
+    QVector<Entry> m_entries ;
+    QHash<QString, int> m_index ;
+    } ;
+
+  } ;
+
+#endif
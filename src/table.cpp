@@ -23,6 +23,8 @@
 #include <QHeaderView>
 #include <QApplication>
 
+#include <algorithm>
+
 using namespace browser ;
 
 
@@ -34,7 +36,7 @@ TableView::TableView(QWidget *parent)
   setShowGrid(false) ;
   setWordWrap(true) ;
   verticalHeader()->setVisible(false) ;
-  verticalHeader()->sectionResizeMode(QHeaderView::Fixed) ;
+  verticalHeader()->setSectionResizeMode(QHeaderView::Fixed) ;  // Uniform row heights
   verticalHeader()->setDefaultSectionSize(18) ;        // Magic constant...
   horizontalHeader()->setStretchLastSection(true) ;
   horizontalHeader()->setHighlightSections(false) ;
@@ -46,14 +48,21 @@ TableView::TableView(QWidget *parent)
 void TableView::resizeCells(void)  // Needs to be done after table is populated
 /*-----------------------------*/
 {
-  QModelIndexList selected = selectedIndexes() ;
-  hide() ;
-  resizeColumnsToContents() ;
-  show() ;
-  hide() ;
-  resizeRowsToContents() ;
-  if (selected.size() > 0) selectRow(selected[0].row()) ;
-  show() ;
+  // Size columns to the rows in view so the cost doesn't depend on
+  // how many rows the table has. Row heights are fixed.
+  if (model() == nullptr) return ;
+  int top = std::max(0, rowAt(0)) ;
+  int bottom = rowAt(viewport()->height() - 1) ;
+  if (bottom < 0) bottom = std::min(model()->rowCount(), top + RESIZE_SAMPLE_ROWS) - 1 ;
+  int last = horizontalHeader()->stretchLastSection() ? model()->columnCount() - 1
+                                                      : model()->columnCount() ;
+  for (int col = 0 ;  col < last ;  ++col) {
+    if (isColumnHidden(col)) continue ;
+    int width = horizontalHeader()->sectionSizeHint(col) ;
+    for (int row = top ;  row <= bottom ;  ++row)
+      width = std::max(width, sizeHintForIndex(model()->index(row, col)).width()) ;
+    setColumnWidth(col, width) ;
+    }
   }
 
 
@@ -61,21 +70,35 @@ TableModel::TableModel(QObject *parent, const QStringList &header, const QString
 /*=========================================================================================*/
 : QAbstractTableModel(parent),
   m_header(header),
-  m_rowids(rowids),
-  m_keys(QHash<QString, int>())
+  m_rowids(QVector<int>()),
+  m_posns(QVector<int>())
 {
+  for (auto const &r : rowids) m_rowids.append(m_ids.id(r)) ;
   set_keys() ;
   }
   
 void TableModel::set_keys(void)
 /*---------------------------*/
 {    
-  m_keys.clear() ;
+  m_posns.fill(-1, m_ids.size()) ;
   int n = 0 ;
   for (auto const &r : m_rowids) {
-    m_keys[r] = n ;
+    m_posns[r] = n ;
     n += 1 ;
     }
+  m_valid = m_rowids.size() ;
+  }
+
+int TableModel::key_row(const QString &key) const
+/*---------------------------------------------*/
+{
+  int id = m_ids.find(key) ;
+  if (id < 0 || m_posns.at(id) < 0) return -1 ;
+  if (m_posns.at(id) >= m_valid) {   // May have moved up since rows were removed
+    for (int n = m_valid ;  n < m_rowids.size() ;  ++n) m_posns[m_rowids.at(n)] = n ;
+    m_valid = m_rowids.size() ;
+    }
+  return m_posns.at(id) ;
   }
 
 int TableModel::rowCount(const QModelIndex &parent) const
@@ -125,9 +148,11 @@ RowPosns TableModel::appendRows(const QStringList &rowids)
 /*------------------------------------------------------*/
 {
   RowPosns posns(m_rowids.size(), m_rowids.size() + rowids.size() - 1) ;
-  beginInsertRows(createIndex(m_rowids.size(), 0), posns.first, posns.second) ;
-  m_rowids.append(rowids) ;
-  set_keys() ;
+  beginInsertRows(QModelIndex(), posns.first, posns.second) ;
+  for (auto const &r : rowids) m_rowids.append(m_ids.id(r)) ;
+  if (m_posns.size() < m_ids.size()) m_posns.resize(m_ids.size()) ;
+  for (int n = posns.first ;  n <= posns.second ;  ++n) m_posns[m_rowids.at(n)] = n ;
+  if (m_valid == posns.first) m_valid = m_rowids.size() ;
   endInsertRows() ;
   return posns ;
   }
@@ -135,19 +160,37 @@ RowPosns TableModel::appendRows(const QStringList &rowids)
 void TableModel::removeRows(const RowPosns &posns)
 /*----------------------------------------------*/
 {
-  beginRemoveRows(createIndex(posns.first, 0), posns.first, posns.second) ;
+  beginRemoveRows(QModelIndex(), posns.first, posns.second) ;
+  for (int n = posns.first ;  n <= posns.second ;  ++n) m_posns[m_rowids.at(n)] = -1 ;
   m_rowids.erase(m_rowids.begin()+posns.first, m_rowids.begin()+posns.second+1) ;
-  set_keys() ;
+  remove_data(posns) ;
+  // Only rows after those removed change position, and are found lazily
+  m_valid = std::min(m_valid, posns.first) ;
   endRemoveRows() ;
   }
 
 void TableModel::deleteRow(const QString &key)
 /*------------------------------------------*/
 {
-  int n = m_keys.value(key, -1) ;
+  int n = key_row(key) ;
   if (n >= 0) removeRows(RowPosns(n, n)) ;
   }
 
+bool TableModel::less_than(int left, int right, int column) const
+/*-------------------------------------------------------------*/
+{
+  // Numbers compare as numbers, anything else by its text
+  QVariant a = data(index(left, column)) ;
+  QVariant b = data(index(right, column)) ;
+  bool numeric = false ;
+  double x = a.toDouble(&numeric) ;
+  if (numeric) {
+    double y = b.toDouble(&numeric) ;
+    if (numeric) return x < y ;
+    }
+  return QString::compare(a.toString(), b.toString()) < 0 ;
+  }
+
 
 SortedTable::SortedTable(QObject *parent, TableView *view, TableModel *model)
 /*=========================================================================*/
@@ -162,27 +205,49 @@ SortedTable::SortedTable(QObject *parent, TableView *view, TableModel *model)
   view->horizontalHeader()->setSortIndicator(1, Qt::AscendingOrder) ;
   }
 
+// The model signals row insertion and removal, so the proxy only has
+// to place or drop the rows concerned instead of re-sorting everything.
+
 RowPosns SortedTable::appendRows(const QStringList &rowids)
 /*-------------------------------------------------------*/
 {
-  emit m_model->layoutAboutToBeChanged() ;
-  RowPosns posns = m_model->appendRows(rowids) ;
-  emit m_model->layoutChanged() ;
-  return posns ;
+  return m_model->appendRows(rowids) ;
   }
 
 void SortedTable::removeRows(const RowPosns &posns)
 /*-----------------------------------------------*/
 {
-  emit m_model->layoutAboutToBeChanged() ;
   m_model->removeRows(posns) ;
-  emit m_model->layoutChanged() ;
   }
 
 void SortedTable::deleteRow(const QString &key)
 /*-------------------------------------------*/
 {
-  emit m_model->layoutAboutToBeChanged() ;
   m_model->deleteRow(key) ;
-  emit m_model->layoutChanged() ;
+  }
+
+bool SortedTable::lessThan(const QModelIndex &left, const QModelIndex &right) const
+/*-------------------------------------------------------------------------------*/
+{
+  return m_model->less_than(left.row(), right.row(), left.column()) ;
+  }
+
+bool SortedTable::filterAcceptsRow(int source_row, const QModelIndex &source_parent) const
+/*--------------------------------------------------------------------------------------*/
+{
+  return m_model->accepts(source_row) ;
+  }
+
+void SortedTable::sort(int column, Qt::SortOrder order)
+/*---------------------------------------------------*/
+{
+  // Rows not yet fetched would be missing from any other order
+  m_model->setFetchAll(column != 1 || order != Qt::AscendingOrder) ;
+  QSortFilterProxyModel::sort(column, order) ;
+  }
+
+void SortedTable::refilter(void)
+/*----------------------------*/
+{
+  invalidateFilter() ;
   }
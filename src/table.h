@@ -22,6 +22,7 @@
 #define BROWSER_TABLE_H
 
 #include "typedefs.h"
+#include "uritable.h"
 
 #include <QTableView>
 #include <QAbstractTableModel>
@@ -36,8 +37,13 @@
 
 namespace browser {
 
+  static const int RESIZE_SAMPLE_ROWS = 50 ;  // Rows sized when none are in view yet
+
   /**
    * A generic table view.
+   *
+   * Rows have a fixed height and columns are sized from the rows
+   * in view, so large tables cost no more to show than small ones.
    */
   class TableView : public QTableView
   /*===============================*/
@@ -75,12 +81,40 @@ namespace browser {
     void removeRows(const RowPosns &posns) ;
     void deleteRow(const QString &key) ;
 
+    /**
+     * Compare two rows on a column, for sorting.
+     *
+     * Subclasses with typed columns should override this to compare
+     * their own values instead of :meth:`data`.
+     */
+    virtual bool less_than(int left, int right, int column) const ;
+    /** Whether a row passes any filter the model has. */
+    virtual bool accepts(int row) const { return true ; }
+    /**
+     * Models that fetch rows as the table is scrolled do so in the table's
+     * default sort order. They should fetch all their rows when `all` is
+     * set, as the table is then sorted some other way.
+     */
+    virtual void setFetchAll(bool all) {}
+
+   protected:
+    inline const QString &rowid(int row) const { return m_ids.uri(m_rowids.at(row)) ; }
+    /** The row with a key, or -1. */
+    int key_row(const QString &key) const ;
+    /** Called when rows are removed, for subclasses that hold row data. */
+    virtual void remove_data(const RowPosns &posns) {}
+
    private:
     void set_keys(void) ;
 
     QStringList m_header ;
-    QStringList m_rowids ;
-    QHash<QString, int> m_keys ;
+    UriIds m_ids ;                // Row URIs, freed with the model
+    QVector<int> m_rowids ;       // Interned row ids
+    // Interned row id --> row, or -1 once removed. Removing rows only
+    // lowers m_valid; positions from there on are found again when next
+    // looked up, so a batch of removals costs one pass over later rows.
+    mutable QVector<int> m_posns ;
+    mutable int m_valid = 0 ;     // Rows before this have current positions
     } ;
 
 
@@ -106,6 +140,14 @@ namespace browser {
     RowPosns appendRows(const QStringList &rowids) ;
     void removeRows(const RowPosns &posns) ;
     void deleteRow(const QString &key) ;
+    /** Apply the model's filter again after it has changed. */
+    void refilter(void) ;
+
+    void sort(int column, Qt::SortOrder order=Qt::AscendingOrder) ;
+
+   protected:
+    bool lessThan(const QModelIndex &left, const QModelIndex &right) const ;
+    bool filterAcceptsRow(int source_row, const QModelIndex &source_parent) const ;
 
    private:
     TableModel *m_model ;
@@ -0,0 +1,254 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "tail.h"
+#include "recordinglock.h"
+
+#include <QHash>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace browser ;
+
+
+static const char *SIGNAL_GROUP = "/recording/signal" ;  // In a BioSignalML HDF5 file
+
+
+static QStringList read_uris(hid_t dataset)
+/*=======================================*/
+// The URIs of the signals held in a dataset, one for each column.
+{
+  QStringList uris ;
+  if (H5Aexists(dataset, "uri") <= 0) return uris ;
+  hid_t attr = H5Aopen(dataset, "uri", H5P_DEFAULT) ;
+  hid_t type = H5Aget_type(attr) ;
+  hid_t space = H5Aget_space(attr) ;
+  hssize_t count = H5Sget_simple_extent_npoints(space) ;
+  if (H5Tget_class(type) == H5T_STRING && count > 0) {
+    if (H5Tis_variable_str(type) > 0) {
+      std::vector<char *> values(count) ;
+      hid_t memtype = H5Tcopy(H5T_C_S1) ;
+      H5Tset_size(memtype, H5T_VARIABLE) ;
+      if (H5Aread(attr, memtype, values.data()) >= 0) {
+        for (auto const &v : values) uris.append(QString::fromUtf8(v)) ;
+        H5Dvlen_reclaim(memtype, space, H5P_DEFAULT, values.data()) ;
+        }
+      H5Tclose(memtype) ;
+      }
+    else {
+      size_t size = H5Tget_size(type) ;
+      std::vector<char> values(size*count) ;
+      if (H5Aread(attr, type, values.data()) >= 0) {
+        for (hssize_t n = 0 ;  n < count ;  ++n) {
+          const char *v = values.data() + n*size ;
+          uris.append(QString::fromUtf8(v, (int)strnlen(v, size))) ;
+          }
+        }
+      }
+    }
+  H5Sclose(space) ;
+  H5Tclose(type) ;
+  H5Aclose(attr) ;
+  return uris ;
+  }
+
+
+TailThread::TailThread(const QString &filename, SignalTable::Ptr table, double duration)
+/*====================================================================================*/
+: QObject(),
+  m_filename(filename),
+  m_table(table),
+  m_duration(duration),
+  m_file(-1),
+  m_exit(false)
+{
+  QObject::connect(&m_thread, &QThread::started, this, &TailThread::run) ;
+  moveToThread(&m_thread) ;
+  }
+
+void TailThread::start(void)
+/*------------------------*/
+{
+  m_thread.start() ;
+  }
+
+void TailThread::stop(void)
+/*-----------------------*/
+{
+  m_exit = true ;
+  }
+
+hid_t TailThread::open_swmr(const QString &filename)
+/*------------------------------------------------*/
+{
+  RecordingLock lock ;
+  hid_t file ;
+  H5E_BEGIN_TRY {
+    file = H5Fopen(filename.toLocal8Bit().constData(), H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT) ;
+    } H5E_END_TRY ;
+  return file ;
+  }
+
+bool TailThread::wait(unsigned long time)
+/*-------------------------------------*/
+{
+  return m_thread.wait(time) ;
+  }
+
+void TailThread::run(void)
+/*----------------------*/
+{
+  QString error ;
+  if (!open_file()) {
+    error = QString("Cannot open %1 to follow it").arg(m_filename) ;
+    }
+  else {
+    find_datasets() ;
+    if (m_datasets.isEmpty()) error = "No uniformly sampled signals to follow" ;
+    }
+
+  while (!m_exit && error == "") {
+    for (int n = 0 ;  !m_exit && n < TAIL_POLL/50 ;  ++n)   // Stay responsive to stop()
+      QThread::msleep(50) ;
+    if (m_exit) break ;
+    double end = 0.0 ;
+    for (auto &d : m_datasets) {
+      read_new_rows(d) ;
+      end = std::max(end, d.rows/d.rate) ;
+      }
+    if (isnan(m_duration) || end > m_duration) {
+      m_duration = end ;
+      emit extended(end) ;
+      }
+    }
+  close_file() ;
+  emit finished(error) ;
+  m_thread.exit(0) ;
+  }
+
+bool TailThread::open_file(void)
+/*----------------------------*/
+{
+  m_file = open_swmr(m_filename) ;
+  return m_file >= 0 ;
+  }
+
+void TailThread::close_file(void)
+/*-----------------------------*/
+{
+  RecordingLock lock ;
+  for (auto &d : m_datasets) {
+    if (d.dataset >= 0) H5Dclose(d.dataset) ;
+    d.dataset = -1 ;
+    }
+  if (m_file >= 0) H5Fclose(m_file) ;
+  m_file = -1 ;
+  }
+
+void TailThread::find_datasets(void)
+/*--------------------------------*/
+{
+  RecordingLock lock ;
+  QHash<QString, int> byuri ;
+  for (int n = 0 ;  n < m_table->size() ;  ++n)
+    byuri.insert(((std::string)m_table->at(n).signal->uri()).c_str(), n) ;
+
+  hid_t group ;
+  H5E_BEGIN_TRY {
+    group = H5Gopen2(m_file, SIGNAL_GROUP, H5P_DEFAULT) ;
+    } H5E_END_TRY ;
+  if (group < 0) return ;
+  H5G_info_t info ;
+  H5Gget_info(group, &info) ;
+  for (hsize_t n = 0 ;  n < info.nlinks ;  ++n) {
+    ssize_t size = H5Lget_name_by_idx(group, ".", H5_INDEX_NAME, H5_ITER_INC, n, nullptr, 0, H5P_DEFAULT) ;
+    if (size < 0) continue ;
+    std::vector<char> name(size + 1) ;
+    H5Lget_name_by_idx(group, ".", H5_INDEX_NAME, H5_ITER_INC, n, name.data(), size + 1, H5P_DEFAULT) ;
+    hid_t dataset ;
+    H5E_BEGIN_TRY {
+      dataset = H5Dopen2(group, name.data(), H5P_DEFAULT) ;
+      } H5E_END_TRY ;
+    if (dataset < 0) continue ;    // Not a dataset
+
+    Dataset d{QString::fromUtf8(name.data()), dataset, QStringList(), NAN, 0} ;
+    for (auto const &uri : read_uris(dataset)) {
+      int e = byuri.value(uri, -1) ;
+      d.ids.append((e >= 0) ? m_table->at(e).id : QString()) ;
+      if (e >= 0 && !isnan(m_table->at(e).rate)) d.rate = m_table->at(e).rate ;
+      }
+    if (isnan(d.rate)) {           // Only uniformly sampled signals are followed
+      H5Dclose(dataset) ;
+      continue ;
+      }
+    hid_t space = H5Dget_space(dataset) ;
+    hsize_t dims[2] = {0, 1} ;
+    if (H5Sget_simple_extent_ndims(space) <= 2) H5Sget_simple_extent_dims(space, dims, nullptr) ;
+    H5Sclose(space) ;
+    d.rows = isnan(m_duration) ? dims[0]
+                               : std::min(dims[0], (hsize_t)std::ceil(m_duration*d.rate)) ;
+    m_datasets.append(d) ;
+    }
+  H5Gclose(group) ;
+  }
+
+void TailThread::read_new_rows(Dataset &d)
+/*--------------------------------------*/
+{
+  hsize_t count[2] ;
+  std::vector<double> rows ;
+  {
+    RecordingLock lock ;           // Released before the rows are emitted
+    H5Drefresh(d.dataset) ;
+    hid_t space = H5Dget_space(d.dataset) ;
+    int rank = H5Sget_simple_extent_ndims(space) ;
+    hsize_t dims[2] = {0, 1} ;
+    if (rank < 1 || rank > 2 || H5Sget_simple_extent_dims(space, dims, nullptr) < 0 || dims[0] <= d.rows) {
+      H5Sclose(space) ;
+      return ;
+      }
+    // Only the rows added since the last check are read
+    hsize_t start[2] = {d.rows, 0} ;
+    count[0] = std::min(dims[0] - d.rows, (hsize_t)TAIL_READ) ;
+    count[1] = dims[1] ;
+    H5Sselect_hyperslab(space, H5S_SELECT_SET, start, nullptr, count, nullptr) ;
+    hid_t memspace = H5Screate_simple(rank, count, nullptr) ;
+    rows.resize(count[0]*count[1]) ;
+    herr_t status = H5Dread(d.dataset, H5T_NATIVE_DOUBLE, memspace, space, H5P_DEFAULT, rows.data()) ;
+    H5Sclose(memspace) ;
+    H5Sclose(space) ;
+    if (status < 0) return ;       // Try again at the next check
+    }
+
+  std::vector<double> times(count[0]) ;
+  for (hsize_t r = 0 ;  r < count[0] ;  ++r) times[r] = (d.rows + r)/d.rate ;
+  int columns = std::min((int)count[1], d.ids.size()) ;
+  for (int c = 0 ;  c < columns ;  ++c) {
+    if (d.ids[c] == "") continue ;
+    std::vector<double> values(count[0]) ;
+    for (hsize_t r = 0 ;  r < count[0] ;  ++r) values[r] = rows[r*count[1] + c] ;
+    emit appended(d.ids[c], std::make_shared<bsml::data::TimeSeries>(times, values)) ;
+    }
+  d.rows += count[0] ;
+  }
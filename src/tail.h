@@ -0,0 +1,116 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_TAIL_H
+#define BROWSER_TAIL_H
+
+#include "signaltable.h"
+
+#include <biosignalml/data/data.h>
+
+#include <hdf5.h>
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+
+#include <atomic>
+
+
+namespace browser {
+
+  static const int TAIL_POLL = 500 ;           // Msecs between checks for new samples
+  static const int TAIL_READ = 1 << 20 ;       // Most rows read from a dataset at a check
+
+
+  /**
+   * Follow an HDF5 recording as it is written, in a separate thread.
+   *
+   * The file is opened with the HDF5 library directly, for single-writer,
+   * multiple-reader (SWMR) access, and every :data:`TAIL_POLL` msecs the
+   * extent of each uniformly sampled signal's dataset is refreshed. Only
+   * rows added since the last check are read, and are emitted as
+   * :meth:`appended` for each signal they hold, followed by the new
+   * duration of the recording in :meth:`extended`.
+   *
+   * HDF5 shares one open file between every handle in a process, with the
+   * access of the first, so the file must be opened with :meth:`open_swmr`
+   * before it is opened as a recording. HDF5 calls are made holding the
+   * :class:`RecordingLock`.
+   */
+  class TailThread : public QObject
+  /*=============================*/
+  {
+   Q_OBJECT
+
+   public:
+    /**
+     * :param duration: Of the recording when it was opened, so that samples
+     *                  since then are read; NAN to start at the current end.
+     */
+    TailThread(const QString &filename, SignalTable::Ptr table, double duration) ;
+
+    /**
+     * Open a file for SWMR reading, to be kept open while it is followed.
+     *
+     * :return: A negative id if the file isn't being written for SWMR access.
+     */
+    static hid_t open_swmr(const QString &filename) ;
+
+    void start(void) ;
+    void stop(void) ;
+    bool wait(unsigned long time) ;
+
+   public slots:
+    void run(void) ;
+
+   signals:
+    void appended(const QString &id, const bsml::data::TimeSeries::Ptr &data) ;
+    void extended(double duration) ;
+    void finished(const QString &error) ;
+
+   private:
+    struct Dataset {
+      QString name ;               //!< Within the signal group
+      hid_t dataset ;
+      QStringList ids ;            //!< Of the signal in each column; empty if not shown
+      double rate ;
+      hsize_t rows ;               //!< Rows read or already seen
+      } ;
+
+    bool open_file(void) ;
+    void close_file(void) ;
+    void find_datasets(void) ;
+    void read_new_rows(Dataset &dataset) ;
+
+    QString m_filename ;
+    SignalTable::Ptr m_table ;
+    double m_duration ;
+    hid_t m_file ;
+    QVector<Dataset> m_datasets ;
+    std::atomic<bool> m_exit ;
+    QThread m_thread ;
+    } ;
+
+  } ;
+
+#endif
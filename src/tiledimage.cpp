@@ -0,0 +1,149 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "tiledimage.h"
+
+#include <QPainter>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace browser ;
+
+
+static const int PNG_IDAT_SIZE = 1 << 18 ;   // Compressed bytes in an IDAT chunk
+
+
+PngWriter::PngWriter(const QString &filename, int width, int height)
+/*================================================================*/
+: m_file(filename),
+  m_width(width),
+  m_height(height),
+  m_rows(0)
+{
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    throw std::runtime_error(QString("Cannot create %1: %2")
+                               .arg(filename, m_file.errorString()).toStdString()) ;
+  std::memset(&m_zstream, 0, sizeof(m_zstream)) ;
+  if (deflateInit(&m_zstream, Z_DEFAULT_COMPRESSION) != Z_OK)
+    throw std::runtime_error("Cannot initialise compression") ;
+  m_compressed.resize(PNG_IDAT_SIZE) ;
+
+  m_file.write("\x89PNG\r\n\x1a\n", 8) ;
+  QByteArray header(13, 0) ;
+  for (int n = 0 ;  n < 4 ;  ++n) {            // Big-endian
+    header[n]     = (char)(width  >> (24 - 8*n)) ;
+    header[4 + n] = (char)(height >> (24 - 8*n)) ;
+    }
+  header[8] = 8 ;                              // Bits per sample
+  header[9] = 2 ;                              // RGB
+  write_chunk("IHDR", header) ;
+  }
+
+PngWriter::~PngWriter()
+/*-------------------*/
+{
+  deflateEnd(&m_zstream) ;
+  }
+
+void PngWriter::write_rows(const QImage &band)
+/*------------------------------------------*/
+{
+  QImage rgb = band.convertToFormat(QImage::Format_RGB888) ;
+  int rows = std::min(rgb.height(), m_height - m_rows) ;
+  if (rows <= 0) return ;
+  int width = std::min(rgb.width(), m_width) ;
+  m_raw.resize(rows*(1 + 3*m_width)) ;
+  m_raw.fill(0) ;
+  char *p = m_raw.data() ;
+  for (int r = 0 ;  r < rows ;  ++r) {
+    *p = 0 ;                                   // No filtering
+    std::memcpy(p + 1, rgb.constScanLine(r), 3*width) ;
+    p += 1 + 3*m_width ;
+    }
+  m_rows += rows ;
+  deflate_rows(Z_NO_FLUSH) ;
+  }
+
+void PngWriter::finish(void)
+/*------------------------*/
+{
+  if (m_rows < m_height) {                     // Pad with blank rows
+    QImage blank(m_width, m_height - m_rows, QImage::Format_RGB888) ;
+    blank.fill(Qt::white) ;
+    write_rows(blank) ;
+    }
+  m_raw.clear() ;
+  deflate_rows(Z_FINISH) ;
+  write_chunk("IEND", QByteArray()) ;
+  if (!m_file.flush())
+    throw std::runtime_error(m_file.errorString().toStdString()) ;
+  m_file.close() ;
+  }
+
+void PngWriter::deflate_rows(int flush)
+/*-----------------------------------*/
+{
+  m_zstream.next_in = (Bytef *)m_raw.data() ;
+  m_zstream.avail_in = m_raw.size() ;
+  int status ;
+  do {
+    m_zstream.next_out = (Bytef *)m_compressed.data() ;
+    m_zstream.avail_out = m_compressed.size() ;
+    status = deflate(&m_zstream, flush) ;
+    if (status == Z_STREAM_ERROR) throw std::runtime_error("Compression failed") ;
+    int size = m_compressed.size() - m_zstream.avail_out ;
+    if (size > 0) write_chunk("IDAT", m_compressed.left(size)) ;
+    } while (m_zstream.avail_out == 0 || (flush == Z_FINISH && status != Z_STREAM_END)) ;
+  }
+
+void PngWriter::write_chunk(const char *type, const QByteArray &data)
+/*-----------------------------------------------------------------*/
+{
+  QByteArray chunk(4, 0) ;
+  quint32 length = data.size() ;
+  for (int n = 0 ;  n < 4 ;  ++n) chunk[n] = (char)(length >> (24 - 8*n)) ;
+  chunk.append(type, 4).append(data) ;
+  quint32 crc = crc32(0, (const Bytef *)chunk.constData() + 4, chunk.size() - 4) ;
+  for (int n = 0 ;  n < 4 ;  ++n) chunk.append((char)(crc >> (24 - 8*n))) ;
+  if (m_file.write(chunk) != chunk.size())
+    throw std::runtime_error(m_file.errorString().toStdString()) ;
+  }
+
+
+void TiledImage::save(ChartRenderer *chart, const QSize &size, const QString &filename)
+/*===================================================================================*/
+{
+  PngWriter writer(filename, size.width(), size.height()) ;
+  for (int top = 0 ;  top < size.height() ;  top += TILE_HEIGHT) {
+    int height = std::min(TILE_HEIGHT, size.height() - top) ;
+    QImage band(size.width(), height, QImage::Format_RGB888) ;
+    QImage tile(TILE_WIDTH, height, QImage::Format_ARGB32_Premultiplied) ;
+    for (int left = 0 ;  left < size.width() ;  left += TILE_WIDTH) {
+      tile.fill(Qt::white) ;
+      chart->drawTile(&tile, size, QPoint(left, top)) ;
+      QPainter painter(&band) ;
+      painter.drawImage(left, 0, tile) ;
+      }
+    writer.write_rows(band) ;
+    }
+  writer.finish() ;
+  }
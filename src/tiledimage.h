@@ -0,0 +1,92 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_TILEDIMAGE_H
+#define BROWSER_TILEDIMAGE_H
+
+#include "chartplot.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+#include <zlib.h>
+
+
+namespace browser {
+
+  static const int TILE_WIDTH  = 4096 ;              // Pixels in a tile
+  static const int TILE_HEIGHT =   64 ;
+  static const qint64 TILED_IMAGE_PIXELS = 1 << 26 ;  // Larger images are drawn in tiles
+
+
+  /**
+   * Write a PNG file a band of rows at a time.
+   *
+   * Rows are compressed as they are written so only the band being
+   * written is held in memory. A `std::runtime_error` is thrown if
+   * the file can't be written.
+   */
+  class PngWriter
+  /*===========*/
+  {
+   public:
+    PngWriter(const QString &filename, int width, int height) ;
+    ~PngWriter() ;
+
+    /** Append the rows of an image that is as wide as the PNG. */
+    void write_rows(const QImage &band) ;
+    void finish(void) ;
+
+   private:
+    void deflate_rows(int flush) ;
+    void write_chunk(const char *type, const QByteArray &data) ;
+
+    QFile m_file ;
+    int m_width ;
+    int m_height ;
+    int m_rows ;                   //!< Rows written so far
+    QByteArray m_raw ;             //!< Filtered rows waiting to be compressed
+    QByteArray m_compressed ;
+    z_stream m_zstream ;
+    } ;
+
+
+  /**
+   * Save a chart as an image that can be much larger than will fit in
+   * memory, for long printed strips and figures.
+   *
+   * The chart is drawn a tile of at most :data:`TILE_WIDTH` by
+   * :data:`TILE_HEIGHT` pixels at a time and each band of tiles is
+   * streamed into a :class:`PngWriter`, so memory use depends on the
+   * width of the image but not on its height.
+   */
+  class TiledImage
+  /*============*/
+  {
+   public:
+    static void save(ChartRenderer *chart, const QSize &size, const QString &filename) ;
+    } ;
+
+  } ;
+
+#endif
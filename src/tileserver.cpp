@@ -0,0 +1,350 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "tileserver.h"
+#include "batchrender.h"
+#include "recordinglock.h"
+
+#include <QBuffer>
+#include <QDir>
+#include <QFileInfo>
+#include <QImage>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QThread>
+#include <QUrlQuery>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+
+using namespace browser ;
+
+
+QString TileRequest::key(void) const
+/*================================*/
+{
+  return QString("%1|%2|%3x%4|%5|%6").arg(recording).arg(ids.join(","))
+                                     .arg(size.width()).arg(size.height())
+                                     .arg(duration, 0, 'g', 9)
+                                     .arg(start/duration, 0, 'g', 9) ;
+  }
+
+
+TileRenderTask::TileRenderTask(TileServer *server, const TileRequest &request)
+/*==========================================================================*/
+: QRunnable(),
+  m_server(server),
+  m_request(request)
+{
+  }
+
+void TileRenderTask::run(void)
+/*--------------------------*/
+{
+  QByteArray png ;
+  QString error ;
+  try {
+    png = m_server->render(m_request) ;
+    }
+  catch (std::exception &e) {
+    error = e.what() ;
+    }
+  QMetaObject::invokeMethod(m_server, "tile_rendered", Qt::QueuedConnection,
+                            Q_ARG(QString, m_request.key()), Q_ARG(QByteArray, png),
+                            Q_ARG(QString, error)) ;
+  }
+
+
+static const char *status_text(int status)
+/*======================================*/
+{
+  switch (status) {
+   case 200: return "OK" ;
+   case 400: return "Bad Request" ;
+   case 403: return "Forbidden" ;
+   case 404: return "Not Found" ;
+   case 405: return "Method Not Allowed" ;
+   default:  return "Internal Server Error" ;
+    }
+  }
+
+
+TileServer::TileServer(const QString &root, int threads, const QString &origin,
+/*===========================================================================*/
+                       int cachebytes, QObject *parent)
+: QTcpServer(parent),
+  m_root(QFileInfo(root).canonicalFilePath()),
+  m_origin(origin),
+  m_cache(cachebytes)
+{
+  if (m_root == "")
+    throw std::runtime_error(QString("Cannot serve %1").arg(root).toStdString()) ;
+  if (threads <= 0) threads = QThread::idealThreadCount() ;
+  threads = std::max(threads, 1) ;
+  m_pool.setMaxThreadCount(threads) ;
+
+  for (int n = 0 ;  n < threads ;  ++n) {
+    auto renderer = new TileRenderer{ChartRenderer(), "", nullptr, nullptr} ;
+    m_renderers.append(renderer) ;
+    m_free.append(renderer) ;
+    }
+  connect(this, &QTcpServer::newConnection, this, &TileServer::new_connection) ;
+  }
+
+TileServer::~TileServer()
+/*---------------------*/
+{
+  close() ;
+  m_pool.waitForDone() ;
+  for (auto const &r : m_renderers) {
+    if (r->recording != nullptr) {
+      RecordingLock lock ;
+      r->recording->close() ;
+      }
+    delete r ;
+    }
+  }
+
+void TileServer::new_connection(void)
+/*---------------------------------*/
+{
+  while (hasPendingConnections()) {
+    QTcpSocket *socket = nextPendingConnection() ;
+    m_requests.insert(socket, QByteArray()) ;
+    connect(socket, &QTcpSocket::readyRead, this, &TileServer::read_request) ;
+    connect(socket, &QTcpSocket::disconnected, this, &TileServer::socket_closed) ;
+    }
+  }
+
+void TileServer::read_request(void)
+/*-------------------------------*/
+{
+  auto socket = qobject_cast<QTcpSocket *>(sender()) ;
+  if (socket == nullptr || !m_requests.contains(socket)) return ;  // Already answered
+  QByteArray &request = m_requests[socket] ;
+  request.append(socket->readAll()) ;
+  int end = request.indexOf("\r\n\r\n") ;
+  if (end >= 0) {
+    QByteArray header = request.left(end) ;
+    m_requests.remove(socket) ;
+    handle_request(socket, header) ;
+    }
+  else if (request.size() > TILE_REQUEST_MAX) {
+    m_requests.remove(socket) ;
+    send_error(socket, 400, "Request too long") ;
+    }
+  }
+
+void TileServer::socket_closed(void)
+/*--------------------------------*/
+{
+  auto socket = qobject_cast<QTcpSocket *>(sender()) ;
+  if (socket == nullptr) return ;
+  m_requests.remove(socket) ;
+  for (auto &w : m_waiting) w.removeAll(socket) ;
+  socket->deleteLater() ;
+  }
+
+void TileServer::handle_request(QTcpSocket *socket, const QByteArray &header)
+/*-------------------------------------------------------------------------*/
+{
+  QList<QByteArray> line = header.left(header.indexOf("\r\n")).split(' ') ;
+  if (line.size() != 3 || !line[2].startsWith("HTTP/")) {
+    send_error(socket, 400, "Invalid request") ;
+    return ;
+    }
+  if (line[0] != "GET") {
+    send_error(socket, 405, "Only GET is supported") ;
+    return ;
+    }
+  QUrl url(QString::fromLatin1(line[1])) ;
+  if (url.path() != "/tile") {
+    send_error(socket, 404, "Unknown path") ;
+    return ;
+    }
+  TileRequest request ;
+  QString error ;
+  if (!parse_tile(url, request, error)) {
+    send_error(socket, 400, error) ;
+    return ;
+    }
+  if (!resolve_recording(m_root, request.recording, request.recording, error)) {
+    send_error(socket, 403, error) ;
+    return ;
+    }
+  if (!QFileInfo(request.recording).isFile()) {
+    send_error(socket, 404, "Recording not found") ;
+    return ;
+    }
+
+  QString key = request.key() ;
+  QByteArray *png = m_cache.object(key) ;
+  if (png != nullptr) {
+    send_response(socket, 200, "image/png", *png) ;
+    }
+  else if (m_waiting.contains(key)) {   // Already being rendered
+    m_waiting[key].append(socket) ;
+    }
+  else {
+    m_waiting.insert(key, QList<QTcpSocket *>{socket}) ;
+    m_pool.start(new TileRenderTask(this, request)) ;
+    }
+  }
+
+bool TileServer::resolve_recording(const QString &root, const QString &name,
+/*------------------------------------------------------------------------*/
+                                   QString &path, QString &error)
+{
+  if (QDir::isAbsolutePath(name) || name.split('/').contains("..")) {
+    error = "Recording must be a path under the served directory" ;
+    return false ;
+    }
+  QFileInfo file(QDir(root).filePath(name)) ;
+  if (!file.exists()) {              // Found to be missing later
+    path = file.absoluteFilePath() ;
+    return true ;
+    }
+  QString canonical = file.canonicalFilePath() ;
+  if (!canonical.startsWith(root.endsWith('/') ? root : root + "/")) {
+    error = "Recording is outside the served directory" ;
+    return false ;
+    }
+  path = canonical ;
+  return true ;
+  }
+
+bool TileServer::parse_tile(const QUrl &url, TileRequest &request, QString &error)
+/*------------------------------------------------------------------------------*/
+{
+  QUrlQuery query(url) ;
+  request.recording = query.queryItemValue("recording", QUrl::FullyDecoded) ;
+  if (request.recording == "") {
+    error = "No recording" ;
+    return false ;
+    }
+  request.ids = query.queryItemValue("signals", QUrl::FullyDecoded).split(",", Qt::SkipEmptyParts) ;
+  bool ok = false ;
+  float end = 0.0 ;
+  request.start = query.queryItemValue("t0").toFloat(&ok) ;
+  if (ok) end = query.queryItemValue("t1").toFloat(&ok) ;
+  if (!ok || isnan(request.start) || isnan(end) || request.start < 0.0 || end <= request.start) {
+    error = "Invalid time range" ;
+    return false ;
+    }
+  request.duration = end - request.start ;
+  int width = query.queryItemValue("width").toInt(&ok) ;
+  int height = ok ? query.queryItemValue("height").toInt(&ok) : 0 ;
+  if (!ok || width <= 0 || height <= 0 || width > TILE_MAX_SIDE || height > TILE_MAX_SIDE) {
+    error = QString("Tile size must be 1 to %1 pixels").arg(TILE_MAX_SIDE) ;
+    return false ;
+    }
+  request.size = QSize(width, height) ;
+  return true ;
+  }
+
+void TileServer::tile_rendered(const QString &key, const QByteArray &png, const QString &error)
+/*------------------------------------------------------------------------------------------*/
+{
+  QList<QTcpSocket *> sockets = m_waiting.take(key) ;
+  if (error == "") m_cache.insert(key, new QByteArray(png), png.size()) ;
+  for (auto const &s : sockets) {
+    if (error == "") send_response(s, 200, "image/png", png) ;
+    else             send_error(s, 500, error) ;
+    }
+  }
+
+void TileServer::send_response(QTcpSocket *socket, int status, const QByteArray &type, const QByteArray &body)
+/*---------------------------------------------------------------------------------------------------------*/
+{
+  QByteArray header = QString("HTTP/1.1 %1 %2\r\n"
+                              "Content-Type: %3\r\n"
+                              "Content-Length: %4\r\n"
+                              "%5"
+                              "Connection: close\r\n\r\n")
+                        .arg(status).arg(status_text(status))
+                        .arg(QString::fromLatin1(type)).arg(body.size())
+                        .arg((m_origin != "") ? QString("Access-Control-Allow-Origin: %1\r\n"
+                                                        "Vary: Origin\r\n").arg(m_origin)
+                                              : QString()).toLatin1() ;
+  socket->write(header) ;
+  socket->write(body) ;
+  socket->disconnectFromHost() ;   // After the response has been sent
+  }
+
+void TileServer::send_error(QTcpSocket *socket, int status, const QString &message)
+/*-------------------------------------------------------------------------------*/
+{
+  send_response(socket, status, "text/plain; charset=utf-8", (message + "\n").toUtf8()) ;
+  }
+
+TileRenderer *TileServer::checkout(void)
+/*------------------------------------*/
+{
+  QMutexLocker lock(&m_freelock) ;
+  while (m_free.isEmpty()) m_released.wait(&m_freelock) ;
+  return m_free.takeLast() ;
+  }
+
+void TileServer::checkin(TileRenderer *renderer)
+/*--------------------------------------------*/
+{
+  QMutexLocker lock(&m_freelock) ;
+  m_free.append(renderer) ;
+  m_released.wakeOne() ;
+  }
+
+QByteArray TileServer::render(const TileRequest &request)
+/*-----------------------------------------------------*/
+{
+  TileRenderer *renderer = checkout() ;
+  try {
+    if (renderer->path != request.recording) {
+      renderer->path = "" ;
+      renderer->table = nullptr ;
+      {
+        RecordingLock lock ;
+        if (renderer->recording != nullptr) renderer->recording->close() ;
+        renderer->recording = nullptr ;
+        renderer->recording = bsml::HDF5::Recording::create(request.recording.toStdString(), true) ;  // Read only
+        }
+      renderer->table = std::make_shared<SignalTable>(renderer->recording) ;  // Takes the lock itself
+      renderer->path = request.recording ;
+      }
+    BatchRenderer::load_chart(&renderer->chart, renderer->table, request.ids,
+                              request.start, request.duration, request.size.width()) ;
+    QImage image(request.size, QImage::Format_ARGB32_Premultiplied) ;
+    image.fill(Qt::white) ;
+    renderer->chart.drawChart(&image) ;
+    QByteArray png ;
+    QBuffer buffer(&png) ;
+    buffer.open(QIODevice::WriteOnly) ;
+    if (!image.save(&buffer, "PNG"))
+      throw std::runtime_error("Cannot encode image") ;
+    checkin(renderer) ;
+    return png ;
+    }
+  catch (...) {
+    checkin(renderer) ;
+    throw ;
+    }
+  }
+
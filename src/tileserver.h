@@ -0,0 +1,174 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_TILESERVER_H
+#define BROWSER_TILESERVER_H
+
+#include "chartplot.h"
+#include "signaltable.h"
+
+#include <biosignalml/data/hdf5.h>
+
+#include <QByteArray>
+#include <QCache>
+#include <QHash>
+#include <QHostAddress>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QRunnable>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThreadPool>
+#include <QUrl>
+#include <QWaitCondition>
+
+
+namespace browser {
+
+  static const int TILE_CACHE_BYTES = 64*1024*1024 ;  // Rendered tiles kept in memory
+  static const int TILE_MAX_SIDE = 4096 ;             // Largest tile width or height
+  static const int TILE_REQUEST_MAX = 16384 ;         // Longest request header accepted
+
+
+  /**
+   * A chart tile to render.
+   */
+  struct TileRequest
+  /*==============*/
+  {
+    QString recording ;            //!< HDF5 file, once resolved under the server's root
+    QStringList ids ;              //!< Signal ids or labels; all signals if empty
+    float start ;
+    float duration ;
+    QSize size ;
+
+    /** Identifies the tile by recording, signals, size, zoom level and tile index. */
+    QString key(void) const ;
+    } ;
+
+
+  /**
+   * A chart renderer, with the recording it last drew, used by one
+   * render at a time.
+   */
+  struct TileRenderer
+  /*===============*/
+  {
+    ChartRenderer chart ;
+    QString path ;                 //!< Of the open recording
+    bsml::HDF5::Recording::Ptr recording ;
+    SignalTable::Ptr table ;
+    } ;
+
+
+  class TileServer ;
+
+  /**
+   * Render a tile as a PNG in a pool thread, passing the result
+   * back to the server in its own thread.
+   */
+  class TileRenderTask : public QRunnable
+  /*===================================*/
+  {
+   public:
+    TileRenderTask(TileServer *server, const TileRequest &request) ;
+    void run(void) ;
+
+   private:
+    TileServer *m_server ;
+    TileRequest m_request ;
+    } ;
+
+
+  /**
+   * Serve chart tiles over HTTP, for the `--serve` option and for embedding.
+   *
+   * A tile is requested as::
+   *
+   *   GET /tile?recording=PATH&signals=ID,ID,...&t0=START&t1=END&width=W&height=H
+   *
+   * and returned as a PNG image drawn by a :class:`ChartRenderer`, exactly as
+   * the desktop chart is drawn. `signals` may be omitted for all signals.
+   * `PATH` is relative to the server's root directory and may not leave it.
+   *
+   * A cross-origin header is only sent when an allowed origin is given.
+   *
+   * Tiles are rendered by a pool of :class:`TileRenderTask`, each using a
+   * :class:`TileRenderer` of its own, and kept in a least recently used cache of
+   * :data:`TILE_CACHE_BYTES`, keyed by zoom level (a tile's duration) and
+   * tile index (its start in tile durations). Requests for a tile that is
+   * being rendered wait for that render rather than starting another.
+   *
+   * Each connection carries one request and is closed after the response.
+   */
+  class TileServer : public QTcpServer
+  /*================================*/
+  {
+   Q_OBJECT
+
+   public:
+    TileServer(const QString &root, int threads=0, const QString &origin="",
+               int cachebytes=TILE_CACHE_BYTES, QObject *parent=nullptr) ;
+    ~TileServer() ;
+
+    /** Render a tile, throwing `std::runtime_error` if it can't be. */
+    QByteArray render(const TileRequest &request) ;
+
+    /**
+     * Resolve a requested recording to a file under a root directory. Absolute
+     * paths, `..` components and links leading out of the root are refused.
+     */
+    static bool resolve_recording(const QString &root, const QString &name,
+                                  QString &path, QString &error) ;
+
+   private slots:
+    void new_connection(void) ;
+    void read_request(void) ;
+    void socket_closed(void) ;
+    void tile_rendered(const QString &key, const QByteArray &png, const QString &error) ;
+
+   private:
+
+    void handle_request(QTcpSocket *socket, const QByteArray &header) ;
+    static bool parse_tile(const QUrl &url, TileRequest &request, QString &error) ;
+    void send_response(QTcpSocket *socket, int status, const QByteArray &type, const QByteArray &body) ;
+    void send_error(QTcpSocket *socket, int status, const QString &message) ;
+    TileRenderer *checkout(void) ;
+    void checkin(TileRenderer *renderer) ;
+
+    QString m_root ;                //!< Canonical path of the served directory
+    QString m_origin ;              //!< Allowed cross-origin requester, if any
+    QThreadPool m_pool ;
+    QList<TileRenderer *> m_renderers ;
+    QList<TileRenderer *> m_free ;
+    QMutex m_freelock ;
+    QWaitCondition m_released ;
+    QCache<QString, QByteArray> m_cache ;
+    QHash<QString, QList<QTcpSocket *>> m_waiting ;    //!< For tiles being rendered
+    QHash<QTcpSocket *, QByteArray> m_requests ;       //!< Partly read request headers
+    } ;
+
+  } ;
+
+#endif
@@ -0,0 +1,122 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "tokenindex.h"
+
+#include <algorithm>
+
+using namespace browser ;
+
+
+TokenIndex::TokenIndex()
+/*====================*/
+: m_postings(QHash<QString, QVector<int>>()),
+  m_sorted(QStringList()),
+  m_dirty(false)
+{
+  }
+
+QStringList TokenIndex::tokens(const QString &text)
+/*-----------------------------------------------*/
+{
+  QStringList result ;
+  int start = -1 ;
+  for (int n = 0 ;  n <= text.size() ;  ++n) {
+    bool word = (n < text.size()) && text.at(n).isLetterOrNumber() ;
+    if (word && start < 0) start = n ;
+    else if (!word && start >= 0) {
+      result.append(text.mid(start, n - start).toLower()) ;
+      start = -1 ;
+      }
+    }
+  return result ;
+  }
+
+void TokenIndex::add(int id, const QString &text)
+/*---------------------------------------------*/
+{
+  for (auto const &t : tokens(text)) {
+    auto postings = m_postings.find(t) ;
+    if (postings == m_postings.end()) {
+      m_postings.insert(t, QVector<int>{id}) ;
+      m_dirty = true ;
+      }
+    else {                 // Usually appended, as ids are mostly added in order
+      auto p = std::lower_bound(postings->begin(), postings->end(), id) ;
+      if (p == postings->end() || *p != id) postings->insert(p, id) ;  // Once for repeated words
+      }
+    }
+  }
+
+void TokenIndex::remove(int id, const QString &text)
+/*------------------------------------------------*/
+{
+  for (auto const &t : tokens(text)) {
+    auto postings = m_postings.find(t) ;
+    if (postings != m_postings.end()) {
+      auto p = std::lower_bound(postings->begin(), postings->end(), id) ;
+      if (p != postings->end() && *p == id) postings->erase(p) ;
+      if (postings->isEmpty()) {
+        m_postings.erase(postings) ;
+        m_dirty = true ;
+        }
+      }
+    }
+  }
+
+void TokenIndex::clear(void)
+/*------------------------*/
+{
+  m_postings.clear() ;
+  m_sorted.clear() ;
+  m_dirty = false ;
+  }
+
+QBitArray TokenIndex::match(const QString &query, int size)
+/*-------------------------------------------------------*/
+{
+  if (m_dirty) {
+    m_sorted = m_postings.keys() ;
+    std::sort(m_sorted.begin(), m_sorted.end()) ;
+    m_dirty = false ;
+    }
+  QBitArray result(size, true) ;
+  for (auto const &q : tokens(query)) {
+    QBitArray found(size) ;
+    for (auto t = std::lower_bound(m_sorted.cbegin(), m_sorted.cend(), q) ;
+         t != m_sorted.cend() && t->startsWith(q) ;  ++t) {
+      for (auto id : m_postings.value(*t))
+        if (id < size) found.setBit(id) ;
+      }
+    result &= found ;
+    }
+  return result ;
+  }
+
+bool TokenIndex::matches(const QString &query, const QString &text)
+/*---------------------------------------------------------------*/
+{
+  QStringList words = tokens(text) ;
+  for (auto const &q : tokens(query)) {
+    auto prefix = [&q](const QString &w) { return w.startsWith(q) ; } ;
+    if (std::none_of(words.cbegin(), words.cend(), prefix)) return false ;
+    }
+  return true ;
+  }
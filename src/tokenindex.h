@@ -0,0 +1,76 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_TOKENINDEX_H
+#define BROWSER_TOKENINDEX_H
+
+#include <QBitArray>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+
+namespace browser {
+
+  /**
+   * An inverted index of the words in a collection of texts.
+   *
+   * Each text is identified by a small non-negative integer. Words
+   * are lowercased and matched by prefix, so a query can be run as
+   * it is being typed. Each word's postings are kept in id order, so
+   * removing a text is a binary search for each of its words.
+   */
+  class TokenIndex
+  /*============*/
+  {
+   public:
+    TokenIndex() ;
+
+    void add(int id, const QString &text) ;
+    /** Remove a text's words, as given to :meth:`add`. */
+    void remove(int id, const QString &text) ;
+    void clear(void) ;
+
+    /**
+     * Find the texts that contain a word starting with each of the
+     * query's words.
+     *
+     * :param query: The words to look for.
+     * :param size: The number of ids to allow for in the result.
+     * :return: A bit for each id, set if its text matches.
+     */
+    QBitArray match(const QString &query, int size) ;
+
+    /** Does a text contain a word starting with each of the query's words? */
+    static bool matches(const QString &query, const QString &text) ;
+
+    /** Split text into lowercase words. */
+    static QStringList tokens(const QString &text) ;
+
+   private:
+    QHash<QString, QVector<int>> m_postings ;   // Sorted ids
+    QStringList m_sorted ;   // Words in order, for finding prefix ranges
+    bool m_dirty ;           // m_sorted needs rebuilding
+    } ;
+
+  } ;
+
+#endif
@@ -54,14 +54,17 @@ namespace browser {
 
   using TraceInfo = std::tuple<QString, bool, std::shared_ptr<Trace>> ;
   using TraceList = QList<TraceInfo> ;
+  //! <id, trace, top, height>, with top and height in pixels
+  using TraceLayout = std::tuple<QString, std::shared_ptr<Trace>, float, float> ;
 
   using PosnTime = QPair<int, float> ;
 
   //! <start, end, text, tags, editable>
   using AnnInfo = std::tuple<float, float, QString, QStringList, bool> ;
-  using AnnotationDict = QMap<QString, AnnInfo> ;
+  //! Keyed by the chart's interned annotation URI (see UriIds)
+  using AnnotationDict = QHash<int, AnnInfo> ;
 
-  using AnnRectList = QList<QPair<QRect, QString>> ; // List of tuple(rect, id)
+  using AnnRectList = QList<QPair<QRect, int>> ; // List of tuple(rect, id)
   } ;
 
 #endif
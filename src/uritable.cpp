@@ -0,0 +1,136 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "uritable.h"
+
+#include <algorithm>
+
+using namespace browser ;
+
+
+UriTable::UriTable()
+/*================*/
+: m_uris(QVector<QString>()),
+  m_ids(QHash<QString, int>()),
+  m_prefixes(QHash<QString, QString>()),
+  m_namespaces(QHash<QString, QString>())
+{
+  m_prefixes = {
+    { "http://www.biosignalml.org/ontologies/2011/04/biosignalml#",  "bsml"  },
+    { "http://purl.org/dc/terms/",                                   "dct"   },
+    { "http://www.w3.org/2000/01/rdf-schema#",                       "rdfs"  },
+    { "http://www.biosignalml.org/ontologies/examples/physiobank#",  "pbank" }
+    } ;
+  for (auto ns = m_prefixes.cbegin() ;  ns != m_prefixes.cend() ;  ++ns)
+    m_namespaces.insert(ns.value(), ns.key()) ;
+  }
+
+UriTable &UriTable::table(void)
+/*---------------------------*/
+{
+  static UriTable table ;   // Initialisation is thread-safe
+  return table ;
+  }
+
+int UriTable::id(const QString &uri)
+/*--------------------------------*/
+{
+  UriTable &t = table() ;
+  {
+    QReadLocker lock(&t.m_lock) ;
+    int n = t.m_ids.value(uri, -1) ;
+    if (n >= 0) return n ;
+    }
+  QWriteLocker lock(&t.m_lock) ;
+  int n = t.m_ids.value(uri, -1) ;  // May have been added while unlocked
+  if (n < 0) {
+    n = t.m_uris.size() ;
+    t.m_uris.append(uri) ;
+    t.m_ids.insert(uri, n) ;
+    }
+  return n ;
+  }
+
+int UriTable::find(const QString &uri)
+/*----------------------------------*/
+{
+  UriTable &t = table() ;
+  QReadLocker lock(&t.m_lock) ;
+  return t.m_ids.value(uri, -1) ;
+  }
+
+QString UriTable::uri(int id)
+/*-------------------------*/
+{
+  UriTable &t = table() ;
+  QReadLocker lock(&t.m_lock) ;
+  return (id >= 0 && id < t.m_uris.size()) ? t.m_uris.at(id) : QString() ;
+  }
+
+void UriTable::add_prefix(const QString &prefix, const QString &ns)
+/*---------------------------------------------------------------*/
+{
+  UriTable &t = table() ;
+  QWriteLocker lock(&t.m_lock) ;
+  t.m_prefixes.insert(ns, prefix) ;
+  t.m_namespaces.insert(prefix, ns) ;
+  }
+
+QString UriTable::abbreviate(const QString &uri)
+/*--------------------------------------------*/
+{
+  int split = std::max(uri.lastIndexOf('#'), uri.lastIndexOf('/')) + 1 ;
+  if (split <= 0) return uri ;
+  UriTable &t = table() ;
+  QReadLocker lock(&t.m_lock) ;
+  auto prefix = t.m_prefixes.constFind(uri.left(split)) ;
+  return (prefix != t.m_prefixes.cend()) ? prefix.value() + ":" + uri.mid(split) : uri ;
+  }
+
+QString UriTable::expand(const QString &name)
+/*-----------------------------------------*/
+{
+  int split = name.indexOf(':') ;
+  if (split < 0) return name ;
+  UriTable &t = table() ;
+  QReadLocker lock(&t.m_lock) ;
+  auto ns = t.m_namespaces.constFind(name.left(split)) ;
+  return (ns != t.m_namespaces.cend()) ? ns.value() + name.mid(split+1) : name ;
+  }
+
+
+int UriIds::id(const QString &uri)
+/*==============================*/
+{
+  int n = m_ids.value(uri, -1) ;
+  if (n < 0) {
+    n = m_uris.size() ;
+    m_uris.append(uri) ;
+    m_ids.insert(uri, n) ;
+    }
+  return n ;
+  }
+
+void UriIds::clear(void)
+/*--------------------*/
+{
+  m_uris.clear() ;
+  m_ids.clear() ;
+  }
@@ -0,0 +1,99 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_URITABLE_H
+#define BROWSER_URITABLE_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include <QReadWriteLock>
+
+
+namespace browser {
+
+  /**
+   * Process-wide interning of URIs.
+   *
+   * Each distinct URI is stored once and given a small integer id,
+   * so that tables and dictionaries can be keyed by id rather than
+   * by (often long) strings. Ids are never released, so only URIs
+   * from a small vocabulary, such as annotation tags, are interned
+   * here; row and annotation URIs, which grow with each recording
+   * opened, are interned by their model or chart in a :class:`UriIds`.
+   *
+   * A table of namespace prefixes, looked up by the namespace part
+   * of a URI, is used to abbreviate and expand URIs.
+   */
+  class UriTable
+  /*==========*/
+  {
+   public:
+    /** The id of a URI, adding it to the table if new. */
+    static int id(const QString &uri) ;
+    /** The id of a URI, or -1 if it is not in the table. */
+    static int find(const QString &uri) ;
+    static QString uri(int id) ;
+
+    static void add_prefix(const QString &prefix, const QString &ns) ;
+    /** Shorten a URI to prefix:name if its namespace has a prefix. */
+    static QString abbreviate(const QString &uri) ;
+    /** The full form of a prefix:name abbreviation. */
+    static QString expand(const QString &name) ;
+
+   private:
+    UriTable() ;
+    static UriTable &table(void) ;
+
+    QVector<QString> m_uris ;
+    QHash<QString, int> m_ids ;
+    QHash<QString, QString> m_prefixes ;    //!< namespace --> prefix
+    QHash<QString, QString> m_namespaces ;  //!< prefix --> namespace
+    QReadWriteLock m_lock ;
+    } ;
+
+
+  /**
+   * Interning of URIs for a single model or chart.
+   *
+   * Ids are given in the order URIs are added, so can index vectors,
+   * and are freed with their owner or when it's cleared. Only the
+   * owner's thread uses them, so there is no locking.
+   */
+  class UriIds
+  /*========*/
+  {
+   public:
+    /** The id of a URI, adding it if new. */
+    int id(const QString &uri) ;
+    /** The id of a URI, or -1 if it hasn't been added. */
+    inline int find(const QString &uri) const { return m_ids.value(uri, -1) ; }
+    inline const QString &uri(int id) const { return m_uris.at(id) ; }
+    inline int size(void) const { return m_uris.size() ; }
+    void clear(void) ;
+
+   private:
+    QVector<QString> m_uris ;
+    QHash<QString, int> m_ids ;
+    } ;
+
+  } ;
+
+#endif
@@ -0,0 +1,56 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef BROWSER_TESTS_CHECK_H
+#define BROWSER_TESTS_CHECK_H
+
+#include <iostream>
+#include <string>
+
+
+namespace browser {
+
+  /**
+   * Checks made by a test program, each reported as PASS or FAIL.
+   */
+  class Checks
+  /*========*/
+  {
+   public:
+    Checks() : m_failures(0) {}
+
+    /** Report a check, counting it if it failed. */
+    bool operator()(bool ok, const std::string &test)
+    {
+      std::cout << (ok ? "PASS " : "FAIL ") << test << std::endl ;
+      if (!ok) m_failures += 1 ;
+      return ok ;
+      }
+
+    /** The program's exit status. */
+    inline int result(void) const { return (m_failures == 0) ? 0 : 1 ; }
+
+   private:
+    int m_failures ;
+    } ;
+
+  } ;
+
+#endif
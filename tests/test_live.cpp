@@ -0,0 +1,187 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "live.h"
+#include "check.h"
+
+#include <QApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThread>
+#include <QWaitCondition>
+#include <QtEndian>
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+using namespace browser ;
+
+
+static const double TEST_RATE = 10000.0 ;
+static const int TEST_SAMPLES = 100 ;       // In each block
+static const int TEST_BLOCKS = 200 ;        // Sent under each header
+static const int TEST_INTERVAL = (int)(1000*TEST_SAMPLES/TEST_RATE) ;   // Msecs between blocks
+
+static const double TEST_MEAN_LATENCY = 100.0 ;   // Msecs
+static const qint64 TEST_MAX_LATENCY = 1000 ;
+
+
+/**
+ * A stand-in live source, sending blocks at its sampling rate under
+ * one header and then under another with more channels.
+ */
+class StandInSource : public QThread
+/*================================*/
+{
+ public:
+  quint16 listen(void)
+  /*================*/
+  {
+    QMutexLocker lock(&m_mutex) ;
+    start() ;
+    while (m_port == 0) m_listening.wait(&m_mutex) ;
+    return m_port ;
+    }
+
+  void run(void) override
+  /*-------------------*/
+  {
+    QTcpServer server ;
+    server.listen(QHostAddress::LocalHost) ;
+    {
+      QMutexLocker lock(&m_mutex) ;
+      m_port = server.serverPort() ;
+      m_listening.wakeAll() ;
+      }
+    if (!server.waitForNewConnection(LIVE_CONNECT)) return ;
+    QTcpSocket *socket = server.nextPendingConnection() ;
+    QElapsedTimer elapsed ;
+    elapsed.start() ;
+    qint64 first = 0 ;
+    for (int channels : {2, 3}) {
+      send(socket, header(channels)) ;
+      for (int n = 0 ;  n < TEST_BLOCKS ;  ++n) {
+        qint64 due = (first/TEST_SAMPLES)*TEST_INTERVAL ;    // Keeps to the rate without drifting
+        if (elapsed.elapsed() < due) msleep(due - elapsed.elapsed()) ;
+        send(socket, data(channels, first)) ;
+        first += TEST_SAMPLES ;
+        }
+      }
+    socket->disconnectFromHost() ;
+    if (socket->state() != QAbstractSocket::UnconnectedState) socket->waitForDisconnected() ;
+    delete socket ;
+    }
+
+ private:
+  static QByteArray header(int channels)
+  /*----------------------------------*/
+  {
+    QJsonArray list ;
+    for (int c = 0 ;  c < channels ;  ++c)
+      list.append(QJsonObject{{"label", QString("Signal %1").arg(c)}, {"units", "mV"}}) ;
+    return "H" + QJsonDocument(QJsonObject{{"rate", TEST_RATE}, {"signals", list}})
+                  .toJson(QJsonDocument::Compact) ;
+    }
+
+  static QByteArray data(int channels, qint64 first)
+  /*----------------------------------------------*/
+  {
+    QByteArray frame(21 + sizeof(float)*channels*TEST_SAMPLES, Qt::Uninitialized) ;
+    uchar *p = reinterpret_cast<uchar *>(frame.data()) ;
+    p[0] = 'D' ;
+    qToLittleEndian<qint64>(QDateTime::currentMSecsSinceEpoch(), p + 1) ;
+    qToLittleEndian<qint64>(first, p + 9) ;
+    qToLittleEndian<quint32>(TEST_SAMPLES, p + 17) ;
+    for (int n = 0 ;  n < channels*TEST_SAMPLES ;  ++n) {
+      float value = std::sin((first + n%TEST_SAMPLES)/TEST_RATE) + n/TEST_SAMPLES ;
+      quint32 bits ;
+      std::memcpy(&bits, &value, sizeof(bits)) ;
+      qToLittleEndian<quint32>(bits, p + 21 + sizeof(float)*n) ;
+      }
+    return frame ;
+    }
+
+  static void send(QTcpSocket *socket, const QByteArray &frame)
+  /*---------------------------------------------------------*/
+  {
+    uchar length[4] ;
+    qToLittleEndian<quint32>(frame.size(), length) ;
+    socket->write(reinterpret_cast<const char *>(length), sizeof(length)) ;
+    socket->write(frame) ;
+    while (socket->bytesToWrite() > 0 && socket->waitForBytesWritten(LIVE_CONNECT)) ;
+    }
+
+  QMutex m_mutex ;
+  QWaitCondition m_listening ;
+  quint16 m_port = 0 ;
+  } ;
+
+
+static Checks check ;
+
+
+int main(int argc, char *argv[])
+/*----------------------------*/
+{
+  if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM", "offscreen") ;
+  QApplication app(argc, argv) ;
+  StandInSource source ;
+  QString address = QString("127.0.0.1:%1").arg(source.listen()) ;
+
+  ChartPlot chart ;
+  chart.resize(1000, 600) ;
+  QString error ;
+  LiveStatistics stats ;
+  QElapsedTimer elapsed ;
+  {
+    LiveChart live(&chart, address, 1.0) ;
+    QObject::connect(&live, &LiveChart::finished, [&](const QString &e) {
+      error = e ;
+      app.quit() ;
+      }) ;
+    elapsed.start() ;
+    live.start() ;
+    app.exec() ;
+    stats = live.statistics() ;
+    }
+  double seconds = elapsed.elapsed()/1000.0 ;
+  source.wait() ;
+
+  check(error == "Live source closed", "Source is read until it closes") ;
+  check(chart.traceOrder().size() == 3, "Traces follow the latest header") ;
+  check(stats.dropped == 0, "No blocks are dropped at the source's rate") ;
+  check((stats.blocks + stats.mismatched + stats.dropped) == 2*TEST_BLOCKS,
+        "Every block sent is shown or counted as mismatched or dropped") ;
+  check(stats.blocks > 0 && stats.mean_latency() < TEST_MEAN_LATENCY, "Mean latency is within bounds") ;
+  check(stats.maxlatency < TEST_MAX_LATENCY, "Maximum latency is within bounds") ;
+  std::cout << "Shown " << stats.samples << " samples (" << stats.blocks << " blocks, "
+            << stats.mismatched << " mismatched, " << stats.dropped << " dropped) in "
+            << seconds << " s, " << (stats.samples/seconds) << " samples/s, latency mean "
+            << stats.mean_latency() << " ms, max " << stats.maxlatency << " ms" << std::endl ;
+  return check.result() ;
+  }
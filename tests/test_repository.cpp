@@ -0,0 +1,175 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "repository.h"
+#include "check.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStandardPaths>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QWaitCondition>
+#include <QtEndian>
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+using namespace browser ;
+
+
+static const int TEST_RATE = 100 ;
+static const qint64 TEST_LENGTH = 3*REMOTE_BLOCK ;
+
+
+/**
+ * A stand-in repository serving one recording, of a signal whose value
+ * is its sample index. It runs in a thread of its own, as a client's
+ * reads wait for their responses.
+ */
+class StandInRepository : public QThread
+/*====================================*/
+{
+ public:
+  std::atomic<int> requests{0} ;
+
+  quint16 listen(void)
+  /*================*/
+  {
+    QMutexLocker lock(&m_mutex) ;
+    start() ;
+    while (m_port == 0) m_listening.wait(&m_mutex) ;
+    return m_port ;
+    }
+
+  void run(void) override
+  /*-------------------*/
+  {
+    QTcpServer server ;
+    server.listen(QHostAddress::LocalHost) ;
+    QObject::connect(&server, &QTcpServer::newConnection, [this, &server]() {
+      while (server.hasPendingConnections()) {
+        QTcpSocket *socket = server.nextPendingConnection() ;
+        QObject::connect(socket, &QTcpSocket::readyRead, [this, socket]() { respond(socket) ; }) ;
+        QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater) ;
+        }
+      }) ;
+    {
+      QMutexLocker lock(&m_mutex) ;
+      m_port = server.serverPort() ;
+      m_listening.wakeAll() ;
+      }
+    exec() ;
+    }
+
+ private:
+  void respond(QTcpSocket *socket)
+  /*----------------------------*/
+  {
+    QByteArray buffer = socket->property("request").toByteArray() + socket->readAll() ;
+    int end ;
+    while ((end = buffer.indexOf("\r\n\r\n")) >= 0) {   // Requests may be pipelined
+      QUrl url(QString::fromLatin1(buffer.left(buffer.indexOf("\r\n")).split(' ').value(1))) ;
+      buffer.remove(0, end + 4) ;
+      requests += 1 ;
+      QByteArray body ;
+      if (url.path() == "/rec") {
+        body = QString("{\"duration\": %1, \"version\": \"1\", \"signals\": [{\"uri\": \"/rec/ramp\","
+                       " \"label\": \"Ramp\", \"units\": \"http://example.org/units#count\","
+                       " \"rate\": %2, \"length\": %3}]}")
+                 .arg(TEST_LENGTH/(double)TEST_RATE).arg(TEST_RATE).arg(TEST_LENGTH).toUtf8() ;
+        }
+      else {
+        QUrlQuery query(url) ;
+        qint64 offset = query.queryItemValue("offset").toLongLong() ;
+        qint64 count = query.queryItemValue("count").toLongLong() ;
+        for (qint64 n = offset ;  n < (offset + count) ;  ++n) {
+          double value = n ;
+          quint64 bits ;
+          std::memcpy(&bits, &value, sizeof(bits)) ;
+          uchar le[sizeof(bits)] ;
+          qToLittleEndian<quint64>(bits, le) ;
+          body.append(reinterpret_cast<const char *>(le), sizeof(le)) ;
+          }
+        }
+      socket->write(QString("HTTP/1.1 200 OK\r\nContent-Length: %1\r\n\r\n")
+                      .arg(body.size()).toLatin1() + body) ;
+      }
+    socket->setProperty("request", buffer) ;
+    }
+
+  QMutex m_mutex ;
+  QWaitCondition m_listening ;
+  quint16 m_port = 0 ;
+  } ;
+
+
+static Checks check ;
+
+
+int main(int argc, char *argv[])
+/*----------------------------*/
+{
+  QCoreApplication app(argc, argv) ;
+  QStandardPaths::setTestModeEnabled(true) ;    // Blocks aren't cached with the user's
+  QDir(BlockCache::default_directory()).removeRecursively() ;
+  StandInRepository repository ;
+  QString uri = QString("http://localhost:%1/rec").arg(repository.listen()) ;
+
+  try {
+    auto recording = RemoteRecording::open(uri) ;
+    auto signal = recording->get_signal(rdf::URI(QUrl(uri).resolved(QUrl("/rec/ramp")).toString().toStdString())) ;
+    check(std::dynamic_pointer_cast<RemoteSignal>(signal) != nullptr, "get_signal() returns a RemoteSignal") ;
+
+    // Spans a block boundary, so needs two blocks. Half a sample
+    // earlier, so rounding doesn't move the first sample.
+    double start = (REMOTE_BLOCK - 50.5)/TEST_RATE ;
+    auto data = signal->read(bsml::Interval::create(rdf::URI(), start, 100.0/TEST_RATE)) ;
+    bool values = (data->size() == 100) ;
+    for (size_t n = 0 ;  values && n < data->size() ;  ++n)
+      values = (data->data()[n] == (double)(REMOTE_BLOCK - 50 + n)) ;
+    check(values, "Samples are read across blocks") ;
+    check(repository.requests == 3, "Metadata and two blocks are requested") ;
+
+    signal->read(bsml::Interval::create(rdf::URI(), start, 100.0/TEST_RATE)) ;
+    check(repository.requests == 3, "Cached blocks aren't requested again") ;
+    }
+  catch (std::exception &e) {
+    check(false, e.what()) ;
+    }
+
+  QTemporaryDir directory ;
+  BlockCache cache(directory.path(), 4*1000) ;
+  for (int n = 0 ;  n < 10 ;  ++n) cache.put(QString::number(n), QByteArray(1000, 'x')) ;
+  qint64 bytes = 0 ;
+  for (auto const &f : QDir(directory.path()).entryInfoList(QDir::Files)) bytes += f.size() ;
+  check(bytes <= 4*1000, "Cache is kept within its size") ;
+
+  repository.quit() ;
+  repository.wait() ;
+  return check.result() ;
+  }
@@ -0,0 +1,67 @@
+/*****************************************************************************
+ *                                                                           *
+ *  BioSignalML Browser in C++                                               *
+ *                                                                           *
+ *  Copyright (c) 2014-2015  David Brooks                                    *
+ *                                                                           *
+ *  Licensed under the Apache License, Version 2.0 (the "License");          *
+ *  you may not use this file except in compliance with the License.         *
+ *  You may obtain a copy of the License at                                  *
+ *                                                                           *
+ *      http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                           *
+ *  Unless required by applicable law or agreed to in writing, software      *
+ *  distributed under the License is distributed on an "AS IS" BASIS,        *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *  See the License for the specific language governing permissions and      *
+ *  limitations under the License.                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "tileserver.h"
+#include "check.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+
+#include <iostream>
+
+using namespace browser ;
+
+
+static Checks check ;
+
+static void test(const QString &root, const QString &name, bool allowed)
+/*====================================================================*/
+{
+  QString path, error ;
+  bool ok = TileServer::resolve_recording(root, name, path, error) ;
+  check(ok == allowed, name.toStdString() + " ==> " + (ok ? path : error).toStdString()) ;
+  }
+
+
+int main(int argc, char *argv[])
+/*----------------------------*/
+{
+  QCoreApplication app(argc, argv) ;
+  QTemporaryDir outside ;
+  QTemporaryDir served ;
+  QString root = QFileInfo(served.path()).canonicalFilePath() ;
+  QDir(root).mkdir("sub") ;
+  for (auto const &f : {root + "/a.h5", root + "/sub/b.h5", outside.path() + "/secret.h5"}) {
+    QFile file(f) ;
+    file.open(QIODevice::WriteOnly) ;
+    }
+  QFile::link(outside.path() + "/secret.h5", root + "/link.h5") ;
+
+  test(root, "a.h5", true) ;
+  test(root, "sub/b.h5", true) ;
+  test(root, "sub/../a.h5", false) ;
+  test(root, "../secret.h5", false) ;
+  test(root, outside.path() + "/secret.h5", false) ;
+  test(root, "link.h5", false) ;
+  return check.result() ;
+  }